@@ -501,6 +501,11 @@ namespace http {
 	{
 		s << "<b>Tunnels:</b><br>\r\n<br>\r\n";
 		s << "<b>Queue size:</b> " << i2p::tunnel::tunnels.GetQueueSize () << "<br>\r\n";
+		s << "<b>I2NP buffers (size: in use/max/free, hits/misses):</b><br>\r\n";
+		for (const auto& it: i2p::GetI2NPMessagesPoolsStats ())
+			s << "&nbsp;&nbsp;" << it.bufferSize << ": " << it.numInUse << "/" << it.highWaterMark << "/" << it.numFree
+			  << ", " << it.numHits << "/" << it.numMisses << "<br>\r\n";
+		s << "<br>\r\n";
 
 		auto ExplPool = i2p::tunnel::tunnels.GetExploratoryPool ();
 
@@ -625,6 +630,10 @@ namespace http {
 			auto sessions = ntcp2Server->GetNTCP2Sessions ();
 			if (!sessions.empty ())
 				ShowNTCPTransports (s, sessions, "NTCP2");
+			std::stringstream framesPerMessage; // don't change precision of page's stream
+			framesPerMessage << std::fixed << std::setprecision(2) << ntcp2Server->GetFramesPerMessage ();
+			s << "<b>NTCP2 frames:</b> " << framesPerMessage.str ()
+				<< " per message, " << (uint64_t)ntcp2Server->GetBytesPerFrame () << " bytes per frame<br>\r\n";
 		}
 		auto ssuServer = i2p::transport::transports.GetSSUServer ();
 		if (ssuServer)
@@ -642,6 +651,8 @@ namespace http {
 					s << " [" << it.second->GetNumSentBytes () << ":" << it.second->GetNumReceivedBytes () << "]";
 					if (it.second->GetRelayTag ())
 						s << " [itag:" << it.second->GetRelayTag () << "]";
+					auto& data = it.second->GetData ();
+					s << " [cwnd:" << data.GetCongestionWindow () << " rate:" << data.GetPacingRate ()/1024 << "KB/s rtt:" << data.GetRTT () << "ms]";
 					s << "<br>\r\n" << std::endl;
 				}
 				s << "</p>\r\n</div>\r\n";
@@ -659,6 +670,8 @@ namespace http {
 					s << " [" << it.second->GetNumSentBytes () << ":" << it.second->GetNumReceivedBytes () << "]";
 					if (it.second->GetRelayTag ())
 						s << " [itag:" << it.second->GetRelayTag () << "]";
+					auto& data = it.second->GetData ();
+					s << " [cwnd:" << data.GetCongestionWindow () << " rate:" << data.GetPacingRate ()/1024 << "KB/s rtt:" << data.GetRTT () << "ms]";
 					s << "<br>\r\n" << std::endl;
 				}
 				s << "</p>\r\n</div>\r\n";
@@ -10,6 +10,18 @@
 #ifndef bit_AVX
 #define bit_AVX (1 << 28)
 #endif
+#ifndef bit_OSXSAVE
+#define bit_OSXSAVE (1 << 27)
+#endif
+#ifndef bit_SSE2
+#define bit_SSE2 (1 << 26)
+#endif
+#ifndef bit_AVX2
+#define bit_AVX2 (1 << 5)
+#endif
+#ifndef bit_AVX512F
+#define bit_AVX512F (1 << 16)
+#endif
 
 
 namespace i2p
@@ -18,9 +30,41 @@ namespace cpu
 {
 	bool aesni = false;
 	bool avx = false;
+	bool sse2 = false;
+	bool avx2 = false;
+	bool avx512 = false;
+	bool neon = false;
+
+	static void DetectSIMD ()
+	{
+#if defined(CPU_X86_DISPATCH)
+		unsigned int info[4];
+		__cpuid(0, info[0], info[1], info[2], info[3]);
+		unsigned int maxLeaf = info[0];
+		if (maxLeaf < 0x00000001) return;
+		__cpuid(0x00000001, info[0], info[1], info[2], info[3]);
+		sse2 = info[3] & bit_SSE2;
+		if (!(info[2] & bit_OSXSAVE) || !(info[2] & bit_AVX) || maxLeaf < 0x00000007) return;
+		// OS must save ymm (and zmm for AVX-512) registers on context switch
+		unsigned int xcr0, xcr0h;
+		__asm__ __volatile__ ("xgetbv" : "=a"(xcr0), "=d"(xcr0h) : "c"(0));
+		if ((xcr0 & 0x06) != 0x06) return;
+		__cpuid_count(0x00000007, 0, info[0], info[1], info[2], info[3]);
+		avx2 = info[1] & bit_AVX2;
+		if ((xcr0 & 0xe6) == 0xe6)
+			avx512 = info[1] & bit_AVX512F;
+#elif defined(CPU_NEON)
+		neon = true;
+#endif
+	}
 
 	void Detect()
 	{
+		DetectSIMD ();
+		if (avx2) LogPrint(eLogInfo, "AVX2 enabled");
+		if (avx512) LogPrint(eLogInfo, "AVX-512 enabled");
+		if (neon) LogPrint(eLogInfo, "NEON enabled");
+
 #if defined(__AES__) || defined(__AVX__)
 
 #if defined(__x86_64__) || defined(__i386__)
@@ -1,12 +1,25 @@
 #ifndef LIBI2PD_CPU_H
 #define LIBI2PD_CPU_H
 
+// x86 SIMD kernels are built with target attributes and selected at runtime
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#	define CPU_X86_DISPATCH 1
+#endif
+// NEON kernels are selected at compile time
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#	define CPU_NEON 1
+#endif
+
 namespace i2p
 {
 namespace cpu
 {
   extern bool aesni;
   extern bool avx;
+  extern bool sse2;
+  extern bool avx2;
+  extern bool avx512;
+  extern bool neon;
 
   void Detect();
 }
@@ -9,9 +9,15 @@
 *
 */
 
+#include "CPU.h"
 #include "ChaCha20.h"
 
-#if !OPENSSL_AEAD_CHACHA20_POLY1305 
+#if defined(CPU_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(CPU_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace i2p
 {
 namespace crypto
@@ -100,6 +106,316 @@ void Chacha20SetCounter (Chacha20State& state, uint32_t counter)
 	state.offset = 0;
 }	
 
+// multi-block kernels, each lane computes own block with counter + lane
+// xor numBlocks (multiple of lanes) of keystream into buf and advance counter
+#if defined(CPU_X86_DISPATCH)
+#define CHACHA20_SSE2 __attribute__ ((target ("sse2")))
+#define CHACHA20_AVX2 __attribute__ ((target ("avx2")))
+#define CHACHA20_AVX512 __attribute__ ((target ("avx512f")))
+
+template<int n>
+CHACHA20_SSE2 static inline __m128i Rotl128 (__m128i x)
+{
+	return _mm_or_si128 (_mm_slli_epi32 (x, n), _mm_srli_epi32 (x, 32 - n));
+}
+
+CHACHA20_SSE2 static inline void QuarterRound128 (__m128i& a, __m128i& b, __m128i& c, __m128i& d)
+{
+	a = _mm_add_epi32 (a, b); d = Rotl128<16>(_mm_xor_si128 (d, a));
+	c = _mm_add_epi32 (c, d); b = Rotl128<12>(_mm_xor_si128 (b, c));
+	a = _mm_add_epi32 (a, b); d = Rotl128<8>(_mm_xor_si128 (d, a));
+	c = _mm_add_epi32 (c, d); b = Rotl128<7>(_mm_xor_si128 (b, c));
+}
+
+CHACHA20_SSE2 static void BlocksSSE2 (uint32_t * st, uint8_t * buf, size_t numBlocks)
+{
+	for (size_t n = 0; n < numBlocks; n += 4, buf += 4*blocksize)
+	{
+		__m128i x[16], s[16];
+		for (int i = 0; i < 16; i++) s[i] = _mm_set1_epi32 (st[i]);
+		s[12] = _mm_add_epi32 (s[12], _mm_set_epi32 (3, 2, 1, 0));
+		for (int i = 0; i < 16; i++) x[i] = s[i];
+		for (int i = rounds; i > 0; i -= 2)
+		{
+			QuarterRound128 (x[0], x[4], x[8], x[12]);
+			QuarterRound128 (x[1], x[5], x[9], x[13]);
+			QuarterRound128 (x[2], x[6], x[10], x[14]);
+			QuarterRound128 (x[3], x[7], x[11], x[15]);
+			QuarterRound128 (x[0], x[5], x[10], x[15]);
+			QuarterRound128 (x[1], x[6], x[11], x[12]);
+			QuarterRound128 (x[2], x[7], x[8], x[13]);
+			QuarterRound128 (x[3], x[4], x[9], x[14]);
+		}
+		for (int i = 0; i < 16; i += 4)
+		{
+			// transpose 4 words of 4 blocks
+			__m128i a = _mm_add_epi32 (x[i], s[i]), b = _mm_add_epi32 (x[i + 1], s[i + 1]),
+				c = _mm_add_epi32 (x[i + 2], s[i + 2]), d = _mm_add_epi32 (x[i + 3], s[i + 3]);
+			__m128i t0 = _mm_unpacklo_epi32 (a, b), t1 = _mm_unpacklo_epi32 (c, d),
+				t2 = _mm_unpackhi_epi32 (a, b), t3 = _mm_unpackhi_epi32 (c, d);
+			__m128i y[4] = { _mm_unpacklo_epi64 (t0, t1), _mm_unpackhi_epi64 (t0, t1),
+				_mm_unpacklo_epi64 (t2, t3), _mm_unpackhi_epi64 (t2, t3) };
+			for (int j = 0; j < 4; j++)
+			{
+				__m128i * p = (__m128i *)(buf + j*blocksize + i*4);
+				_mm_storeu_si128 (p, _mm_xor_si128 (_mm_loadu_si128 (p), y[j]));
+			}
+		}
+		st[12] += 4;
+	}
+}
+
+CHACHA20_AVX2 static inline void QuarterRound256 (__m256i& a, __m256i& b, __m256i& c, __m256i& d,
+	const __m256i& rot16, const __m256i& rot8)
+{
+	a = _mm256_add_epi32 (a, b); d = _mm256_shuffle_epi8 (_mm256_xor_si256 (d, a), rot16);
+	c = _mm256_add_epi32 (c, d); b = _mm256_xor_si256 (b, c);
+	b = _mm256_or_si256 (_mm256_slli_epi32 (b, 12), _mm256_srli_epi32 (b, 20));
+	a = _mm256_add_epi32 (a, b); d = _mm256_shuffle_epi8 (_mm256_xor_si256 (d, a), rot8);
+	c = _mm256_add_epi32 (c, d); b = _mm256_xor_si256 (b, c);
+	b = _mm256_or_si256 (_mm256_slli_epi32 (b, 7), _mm256_srli_epi32 (b, 25));
+}
+
+// keystream blocks of 8 lanes from initial state s, k[j] is block of lane j
+CHACHA20_AVX2 static inline void KeystreamAVX2 (const __m256i * s, __m256i (*k)[2])
+{
+	// rotations by 16 and 8 are byte shuffles
+	const __m256i rot16 = _mm256_set_epi8 (13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+		13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+	const __m256i rot8 = _mm256_set_epi8 (14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+		14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+	__m256i x[16];
+	for (int i = 0; i < 16; i++) x[i] = s[i];
+	for (int i = rounds; i > 0; i -= 2)
+	{
+		QuarterRound256 (x[0], x[4], x[8], x[12], rot16, rot8);
+		QuarterRound256 (x[1], x[5], x[9], x[13], rot16, rot8);
+		QuarterRound256 (x[2], x[6], x[10], x[14], rot16, rot8);
+		QuarterRound256 (x[3], x[7], x[11], x[15], rot16, rot8);
+		QuarterRound256 (x[0], x[5], x[10], x[15], rot16, rot8);
+		QuarterRound256 (x[1], x[6], x[11], x[12], rot16, rot8);
+		QuarterRound256 (x[2], x[7], x[8], x[13], rot16, rot8);
+		QuarterRound256 (x[3], x[4], x[9], x[14], rot16, rot8);
+	}
+	// y[i/4][j] has words i..i+3 of lane j in low half and of lane j + 4 in high half
+	__m256i y[4][4];
+	for (int i = 0; i < 16; i += 4)
+	{
+		__m256i a = _mm256_add_epi32 (x[i], s[i]), b = _mm256_add_epi32 (x[i + 1], s[i + 1]),
+			c = _mm256_add_epi32 (x[i + 2], s[i + 2]), d = _mm256_add_epi32 (x[i + 3], s[i + 3]);
+		__m256i t0 = _mm256_unpacklo_epi32 (a, b), t1 = _mm256_unpacklo_epi32 (c, d),
+			t2 = _mm256_unpackhi_epi32 (a, b), t3 = _mm256_unpackhi_epi32 (c, d);
+		y[i/4][0] = _mm256_unpacklo_epi64 (t0, t1); y[i/4][1] = _mm256_unpackhi_epi64 (t0, t1);
+		y[i/4][2] = _mm256_unpacklo_epi64 (t2, t3); y[i/4][3] = _mm256_unpackhi_epi64 (t2, t3);
+	}
+	for (int j = 0; j < 4; j++)
+	{
+		k[j][0] = _mm256_permute2x128_si256 (y[0][j], y[1][j], 0x20);
+		k[j][1] = _mm256_permute2x128_si256 (y[2][j], y[3][j], 0x20);
+		k[j + 4][0] = _mm256_permute2x128_si256 (y[0][j], y[1][j], 0x31);
+		k[j + 4][1] = _mm256_permute2x128_si256 (y[2][j], y[3][j], 0x31);
+	}
+}
+
+CHACHA20_AVX2 static void BlocksAVX2 (uint32_t * st, uint8_t * buf, size_t numBlocks)
+{
+	for (size_t n = 0; n < numBlocks; n += 8, buf += 8*blocksize)
+	{
+		__m256i s[16], k[8][2];
+		for (int i = 0; i < 16; i++) s[i] = _mm256_set1_epi32 (st[i]);
+		s[12] = _mm256_add_epi32 (s[12], _mm256_set_epi32 (7, 6, 5, 4, 3, 2, 1, 0));
+		KeystreamAVX2 (s, k);
+		for (int j = 0; j < 8; j++)
+			for (int i = 0; i < 2; i++)
+			{
+				__m256i * p = (__m256i *)(buf + j*blocksize + i*32);
+				_mm256_storeu_si256 (p, _mm256_xor_si256 (_mm256_loadu_si256 (p), k[j][i]));
+			}
+		st[12] += 8;
+	}
+}
+
+CHACHA20_AVX2 static void LanesAVX2 (const uint32_t * states, const uint32_t * indices, const uint32_t * counters, uint8_t * const * out)
+{
+	__m256i s[16], k[8][2];
+	__m256i offsets = _mm256_slli_epi32 (_mm256_loadu_si256 ((const __m256i *)indices), 4); // 16 words per state
+	for (int i = 0; i < 16; i++)
+		s[i] = _mm256_i32gather_epi32 ((const int *)states, _mm256_add_epi32 (offsets, _mm256_set1_epi32 (i)), 4);
+	s[12] = _mm256_loadu_si256 ((const __m256i *)counters);
+	KeystreamAVX2 (s, k);
+	for (int j = 0; j < 8; j++)
+	{
+		_mm256_storeu_si256 ((__m256i *)out[j], k[j][0]);
+		_mm256_storeu_si256 ((__m256i *)(out[j] + 32), k[j][1]);
+	}
+}
+
+// avx512 intrinsics of some gcc versions trigger false -Wuninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+CHACHA20_AVX512 static inline void QuarterRound512 (__m512i& a, __m512i& b, __m512i& c, __m512i& d)
+{
+	a = _mm512_add_epi32 (a, b); d = _mm512_rol_epi32 (_mm512_xor_si512 (d, a), 16);
+	c = _mm512_add_epi32 (c, d); b = _mm512_rol_epi32 (_mm512_xor_si512 (b, c), 12);
+	a = _mm512_add_epi32 (a, b); d = _mm512_rol_epi32 (_mm512_xor_si512 (d, a), 8);
+	c = _mm512_add_epi32 (c, d); b = _mm512_rol_epi32 (_mm512_xor_si512 (b, c), 7);
+}
+
+// keystream blocks of 16 lanes from initial state s, k[j] is block of lane j
+CHACHA20_AVX512 static inline void KeystreamAVX512 (const __m512i * s, __m512i * k)
+{
+	__m512i x[16];
+	for (int i = 0; i < 16; i++) x[i] = s[i];
+	for (int i = rounds; i > 0; i -= 2)
+	{
+		QuarterRound512 (x[0], x[4], x[8], x[12]);
+		QuarterRound512 (x[1], x[5], x[9], x[13]);
+		QuarterRound512 (x[2], x[6], x[10], x[14]);
+		QuarterRound512 (x[3], x[7], x[11], x[15]);
+		QuarterRound512 (x[0], x[5], x[10], x[15]);
+		QuarterRound512 (x[1], x[6], x[11], x[12]);
+		QuarterRound512 (x[2], x[7], x[8], x[13]);
+		QuarterRound512 (x[3], x[4], x[9], x[14]);
+	}
+	// 128-bit lane l of y[i/4][j] has words i..i+3 of lane j + 4*l
+	__m512i y[4][4];
+	for (int i = 0; i < 16; i += 4)
+	{
+		__m512i a = _mm512_add_epi32 (x[i], s[i]), b = _mm512_add_epi32 (x[i + 1], s[i + 1]),
+			c = _mm512_add_epi32 (x[i + 2], s[i + 2]), d = _mm512_add_epi32 (x[i + 3], s[i + 3]);
+		__m512i t0 = _mm512_unpacklo_epi32 (a, b), t1 = _mm512_unpacklo_epi32 (c, d),
+			t2 = _mm512_unpackhi_epi32 (a, b), t3 = _mm512_unpackhi_epi32 (c, d);
+		y[i/4][0] = _mm512_unpacklo_epi64 (t0, t1); y[i/4][1] = _mm512_unpackhi_epi64 (t0, t1);
+		y[i/4][2] = _mm512_unpacklo_epi64 (t2, t3); y[i/4][3] = _mm512_unpackhi_epi64 (t2, t3);
+	}
+	for (int j = 0; j < 4; j++)
+	{
+		__m512i t0 = _mm512_shuffle_i32x4 (y[0][j], y[1][j], 0x44), t1 = _mm512_shuffle_i32x4 (y[2][j], y[3][j], 0x44),
+			t2 = _mm512_shuffle_i32x4 (y[0][j], y[1][j], 0xEE), t3 = _mm512_shuffle_i32x4 (y[2][j], y[3][j], 0xEE);
+		k[j] = _mm512_shuffle_i32x4 (t0, t1, 0x88); k[j + 4] = _mm512_shuffle_i32x4 (t0, t1, 0xDD);
+		k[j + 8] = _mm512_shuffle_i32x4 (t2, t3, 0x88); k[j + 12] = _mm512_shuffle_i32x4 (t2, t3, 0xDD);
+	}
+}
+
+CHACHA20_AVX512 static void BlocksAVX512 (uint32_t * st, uint8_t * buf, size_t numBlocks)
+{
+	for (size_t n = 0; n < numBlocks; n += 16, buf += 16*blocksize)
+	{
+		__m512i s[16], k[16];
+		for (int i = 0; i < 16; i++) s[i] = _mm512_set1_epi32 (st[i]);
+		s[12] = _mm512_add_epi32 (s[12], _mm512_set_epi32 (15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+		KeystreamAVX512 (s, k);
+		for (int j = 0; j < 16; j++)
+		{
+			uint8_t * p = buf + j*blocksize;
+			_mm512_storeu_si512 (p, _mm512_xor_si512 (_mm512_loadu_si512 (p), k[j]));
+		}
+		st[12] += 16;
+	}
+}
+
+CHACHA20_AVX512 static void LanesAVX512 (const uint32_t * states, const uint32_t * indices, const uint32_t * counters, uint8_t * const * out)
+{
+	__m512i s[16], k[16];
+	__m512i offsets = _mm512_slli_epi32 (_mm512_loadu_si512 (indices), 4); // 16 words per state
+	for (int i = 0; i < 16; i++)
+		s[i] = _mm512_i32gather_epi32 (_mm512_add_epi32 (offsets, _mm512_set1_epi32 (i)), states, 4);
+	s[12] = _mm512_loadu_si512 (counters);
+	KeystreamAVX512 (s, k);
+	for (int j = 0; j < 16; j++)
+		_mm512_storeu_si512 (out[j], k[j]);
+}
+#pragma GCC diagnostic pop
+#elif defined(CPU_NEON)
+template<int n>
+static inline uint32x4_t RotlNEON (uint32x4_t x)
+{
+	return vorrq_u32 (vshlq_n_u32 (x, n), vshrq_n_u32 (x, 32 - n));
+}
+
+static inline void QuarterRoundNEON (uint32x4_t& a, uint32x4_t& b, uint32x4_t& c, uint32x4_t& d)
+{
+	a = vaddq_u32 (a, b); d = vreinterpretq_u32_u16 (vrev32q_u16 (vreinterpretq_u16_u32 (veorq_u32 (d, a))));
+	c = vaddq_u32 (c, d); b = RotlNEON<12>(veorq_u32 (b, c));
+	a = vaddq_u32 (a, b); d = RotlNEON<8>(veorq_u32 (d, a));
+	c = vaddq_u32 (c, d); b = RotlNEON<7>(veorq_u32 (b, c));
+}
+
+static void BlocksNEON (uint32_t * st, uint8_t * buf, size_t numBlocks)
+{
+	static const uint32_t lanes[4] = { 0, 1, 2, 3 };
+	for (size_t n = 0; n < numBlocks; n += 4, buf += 4*blocksize)
+	{
+		uint32x4_t x[16], s[16];
+		for (int i = 0; i < 16; i++) s[i] = vdupq_n_u32 (st[i]);
+		s[12] = vaddq_u32 (s[12], vld1q_u32 (lanes));
+		for (int i = 0; i < 16; i++) x[i] = s[i];
+		for (int i = rounds; i > 0; i -= 2)
+		{
+			QuarterRoundNEON (x[0], x[4], x[8], x[12]);
+			QuarterRoundNEON (x[1], x[5], x[9], x[13]);
+			QuarterRoundNEON (x[2], x[6], x[10], x[14]);
+			QuarterRoundNEON (x[3], x[7], x[11], x[15]);
+			QuarterRoundNEON (x[0], x[5], x[10], x[15]);
+			QuarterRoundNEON (x[1], x[6], x[11], x[12]);
+			QuarterRoundNEON (x[2], x[7], x[8], x[13]);
+			QuarterRoundNEON (x[3], x[4], x[9], x[14]);
+		}
+		for (int i = 0; i < 16; i += 4)
+		{
+			// transpose 4 words of 4 blocks
+			uint32x4x2_t ab = vtrnq_u32 (vaddq_u32 (x[i], s[i]), vaddq_u32 (x[i + 1], s[i + 1])),
+				cd = vtrnq_u32 (vaddq_u32 (x[i + 2], s[i + 2]), vaddq_u32 (x[i + 3], s[i + 3]));
+			uint32x4_t y[4] = { vcombine_u32 (vget_low_u32 (ab.val[0]), vget_low_u32 (cd.val[0])),
+				vcombine_u32 (vget_low_u32 (ab.val[1]), vget_low_u32 (cd.val[1])),
+				vcombine_u32 (vget_high_u32 (ab.val[0]), vget_high_u32 (cd.val[0])),
+				vcombine_u32 (vget_high_u32 (ab.val[1]), vget_high_u32 (cd.val[1])) };
+			for (int j = 0; j < 4; j++)
+			{
+				uint8_t * p = buf + j*blocksize + i*4;
+				vst1q_u8 (p, veorq_u8 (vld1q_u8 (p), vreinterpretq_u8_u32 (y[j])));
+			}
+		}
+		st[12] += 4;
+	}
+}
+#endif
+
+void Chacha20Keystream (const uint32_t * states, const uint32_t * indices, const uint32_t * counters, uint8_t * const * out, size_t num)
+{
+	size_t n = 0;
+#if defined(CPU_X86_DISPATCH)
+	if (i2p::cpu::avx512)
+		for (; n + 16 <= num; n += 16)
+			LanesAVX512 (states, indices + n, counters + n, out + n);
+	if (i2p::cpu::avx2 && n < num)
+	{
+		for (; n + 8 <= num; n += 8)
+			LanesAVX2 (states, indices + n, counters + n, out + n);
+		if (n < num)
+		{
+			// fill unused lanes with copies of last block
+			uint32_t ind[8], cnt[8]; uint8_t * o[8]; uint8_t dummy[blocksize];
+			for (size_t i = 0; i < 8; i++)
+			{
+				size_t j = (n + i < num) ? n + i : num - 1;
+				ind[i] = indices[j]; cnt[i] = counters[j]; o[i] = (n + i < num) ? out[j] : dummy;
+			}
+			LanesAVX2 (states, ind, cnt, o);
+			n = num;
+		}
+	}
+#endif
+	for (; n < num; n++)
+	{
+		Chacha20State state;
+		memcpy (state.data, states + indices[n]*16, sizeof (state.data));
+		state.data[12] = counters[n];
+		chacha::block (state, chacha::rounds);
+		memcpy (out[n], state.block.data, blocksize);
+	}
+}
+
 void Chacha20Encrypt (Chacha20State& state, uint8_t * buf, size_t sz)
 {	
 	if (state.offset > 0)
@@ -114,6 +430,35 @@ void Chacha20Encrypt (Chacha20State& state, uint8_t * buf, size_t sz)
 		state.offset += s;
 		if (state.offset >= chacha::blocksize) state.offset = 0;	
 	}
+	// full blocks by widest kernel available, rest by scalar code
+	size_t numBlocks = sz/blocksize, n = 0;
+#if defined(CPU_X86_DISPATCH)
+	if (i2p::cpu::avx512 && numBlocks >= 16)
+	{
+		n = numBlocks & ~(size_t)15;
+		BlocksAVX512 (state.data, buf, n);
+	}
+	if (i2p::cpu::avx2 && numBlocks - n >= 8)
+	{
+		auto n1 = (numBlocks - n) & ~(size_t)7;
+		BlocksAVX2 (state.data, buf + n*blocksize, n1);
+		n += n1;
+	}
+	if (i2p::cpu::sse2 && numBlocks - n >= 4)
+	{
+		auto n1 = (numBlocks - n) & ~(size_t)3;
+		BlocksSSE2 (state.data, buf + n*blocksize, n1);
+		n += n1;
+	}
+#elif defined(CPU_NEON)
+	if (i2p::cpu::neon && numBlocks >= 4)
+	{
+		n = numBlocks & ~(size_t)3;
+		BlocksNEON (state.data, buf, n);
+	}
+#endif
+	buf += n*blocksize;
+	sz -= n*blocksize;
 	for (size_t i = 0; i < sz; i += chacha::blocksize) 
 	{
 	    chacha::block(state, chacha::rounds);
@@ -133,5 +478,3 @@ void Chacha20Encrypt (Chacha20State& state, uint8_t * buf, size_t sz)
 
 }
 }
-#endif
-
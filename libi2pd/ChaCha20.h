@@ -16,7 +16,6 @@
 #include <string.h>
 #include "Crypto.h"
 
-#if !OPENSSL_AEAD_CHACHA20_POLY1305
 namespace i2p
 {
 namespace crypto
@@ -64,9 +63,11 @@ namespace chacha
 	void Chacha20Init (Chacha20State& state, const uint8_t * nonce, const uint8_t * key, uint32_t counter);
 	void Chacha20SetCounter (Chacha20State& state, uint32_t counter);
 	void Chacha20Encrypt (Chacha20State& state, uint8_t * buf, size_t sz); // encrypt buf in place	
+	// keystream blocks of independent streams in SIMD lanes, states are 16 words each
+	// block n is of states[indices[n]] with counter counters[n], written to out[n]
+	void Chacha20Keystream (const uint32_t * states, const uint32_t * indices, const uint32_t * counters, uint8_t * const * out, size_t num);
 }
 } 
 }
-#endif
 
 #endif
@@ -76,6 +76,8 @@ namespace config {
 			("limits.ntcpsoft", value<uint16_t>()->default_value(0),          "Threshold to start probabalistic backoff with ntcp sessions (default: use system limit)")
 			("limits.ntcphard", value<uint16_t>()->default_value(0),          "Maximum number of ntcp sessions (default: use system limit)")
 			("limits.ntcpthreads", value<uint16_t>()->default_value(1),       "Maximum number of threads used by NTCP DH worker (default: 1)")
+			("limits.tunnelthreads", value<uint16_t>()->default_value(1),     "Number of threads handling tunnel data messages (default: 1)")
+			("limits.buildthreads", value<uint16_t>()->default_value(1),      "Number of threads decrypting tunnel build requests (default: 1)")
 		;
 
 		options_description httpserver("HTTP Server options");
@@ -239,6 +241,10 @@ namespace config {
 			("ntcp2.enabled", value<bool>()->default_value(true), "Enable NTCP2 (default: enabled)")
 			("ntcp2.published", value<bool>()->default_value(false), "Publish NTCP2 (default: disabled)")
 			("ntcp2.port", value<uint16_t>()->default_value(0), "Port to listen for incoming NTCP2 connections (default: auto)")
+			("ntcp2.threads", value<int>()->default_value(1), "Number of NTCP2 threads, sessions and listeners are sharded across them (default: 1)")
+			("ntcp2.coalesce", value<int>()->default_value(0), "Microseconds to wait for more messages before sending a frame (default: 0, send immediately)")
+			("ntcp2.keyspool", value<int>()->default_value(32), "Number of pre-generated ephemeral keys for handshakes (default: 32)")
+			("ntcp2.keyspoolthreshold", value<int>()->default_value(16), "Refill pre-generated keys when fewer left (default: 16)")
 		;
 
 		options_description nettime("Time sync options");
@@ -256,6 +262,19 @@ namespace config {
 		options_description persist("Network information persisting options");
 		persist.add_options()
 			("persist.profiles", value<bool>()->default_value(true), "Persist peer profiles (default: true)")
+			("persist.netdbstorage", value<std::string>()->default_value("files"), "NetDb storage: files (file per router) or log (single append-only file) (default: files)")
+		;
+
+		options_description cpuaffinity("CPU affinity options");
+		cpuaffinity.add_options()
+			("cpuaffinity.tunnels", value<std::string>()->default_value(""), "CPUs for tunnels threads, e.g. 0-3,8 (default: any)")
+			("cpuaffinity.netdb", value<std::string>()->default_value(""), "CPUs for NetDb thread (default: any)")
+			("cpuaffinity.transports", value<std::string>()->default_value(""), "CPUs for transports thread (default: any)")
+			("cpuaffinity.ntcp2", value<std::string>()->default_value(""), "CPUs for NTCP2 server thread (default: any)")
+			("cpuaffinity.ssu", value<std::string>()->default_value(""), "CPUs for SSU server and receiver threads (default: any)")
+			("cpuaffinity.destinations", value<std::string>()->default_value(""), "CPUs for local destinations threads (default: any)")
+			("cpuaffinity.log", value<std::string>()->default_value(""), "CPUs for log thread (default: any)")
+			("cpuaffinity.colocate", value<bool>()->default_value(false), "Run NTCP2 and SSU threads on the whole set of tunnels CPUs if not set (default: disabled)")
 		;
 
 		m_OptionsDesc
@@ -278,6 +297,7 @@ namespace config {
 			.add(ntcp2)
 			.add(nettime)
 			.add(persist)
+			.add(cpuaffinity)
 		;
 	}
 
@@ -9,10 +9,8 @@
 #include "TunnelBase.h"
 #include <openssl/ssl.h>
 #include "Crypto.h"
-#if !OPENSSL_AEAD_CHACHA20_POLY1305
 #include "ChaCha20.h"
 #include "Poly1305.h"
-#endif
 #include "Ed25519.h"
 #include "I2PEndian.h"
 #include "Log.h"
@@ -1041,6 +1039,96 @@ namespace crypto
 		}
 	}
 
+#ifdef __AES__
+// lanes must be unrolled to keep state in xmm registers
+#if defined(__clang__)
+#define AESNI_LANES _Pragma("unroll")
+#elif defined(__GNUC__) && (__GNUC__ >= 8)
+#define AESNI_LANES _Pragma("GCC unroll 8")
+#else
+#define AESNI_LANES
+#endif
+	template<int N>
+	void TunnelEncryption::EncryptAESNI (TunnelEncryption * const * encryptions, const uint8_t * const * in, uint8_t * const * out)
+	{
+		// CBC chains of N messages are interleaved to keep AES units busy
+		const __m128i * schedIV[N], * schedL[N];
+		__m128i x[N], iv[N] = {}; // set by first IV encryption, initialized for -Wmaybe-uninitialized
+		AESNI_LANES for (int l = 0; l < N; l++)
+		{
+			schedIV[l] = (const __m128i *)encryptions[l]->m_IVEncryption.GetKeySchedule ();
+			schedL[l] = (const __m128i *)encryptions[l]->m_LayerEncryption.ECB ().GetKeySchedule ();
+			x[l] = _mm_loadu_si128 ((const __m128i *)in[l]);
+		}
+		// encrypt IV twice
+		for (int k = 0; k < 2; k++)
+		{
+			AESNI_LANES for (int l = 0; l < N; l++)
+				x[l] = _mm_xor_si128 (x[l], _mm_load_si128 (schedIV[l]));
+			for (int r = 1; r < 14; r++)
+				AESNI_LANES for (int l = 0; l < N; l++)
+					x[l] = _mm_aesenc_si128 (x[l], _mm_load_si128 (schedIV[l] + r));
+			AESNI_LANES for (int l = 0; l < N; l++)
+			{
+				x[l] = _mm_aesenclast_si128 (x[l], _mm_load_si128 (schedIV[l] + 14));
+				if (!k) iv[l] = x[l]; // data is encrypted with single encrypted IV
+			}
+		}
+		AESNI_LANES for (int l = 0; l < N; l++)
+			_mm_storeu_si128 ((__m128i *)out[l], x[l]);
+		// encrypt data
+		for (size_t offset = 16; offset <= i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE; offset += 16)
+		{
+			AESNI_LANES for (int l = 0; l < N; l++)
+				x[l] = _mm_xor_si128 (_mm_xor_si128 (_mm_loadu_si128 ((const __m128i *)(in[l] + offset)), iv[l]),
+					_mm_load_si128 (schedL[l]));
+			for (int r = 1; r < 14; r++)
+				AESNI_LANES for (int l = 0; l < N; l++)
+					x[l] = _mm_aesenc_si128 (x[l], _mm_load_si128 (schedL[l] + r));
+			AESNI_LANES for (int l = 0; l < N; l++)
+			{
+				iv[l] = _mm_aesenclast_si128 (x[l], _mm_load_si128 (schedL[l] + 14));
+				_mm_storeu_si128 ((__m128i *)(out[l] + offset), iv[l]);
+			}
+		}
+	}
+#endif
+
+	void TunnelEncryption::Encrypt (int num, TunnelEncryption * const * encryptions,
+		const uint8_t * const * in, uint8_t * const * out)
+	{
+#ifdef __AES__
+		if(i2p::cpu::aesni)
+		{
+			for (; num >= 8; num -= 8, encryptions += 8, in += 8, out += 8)
+				EncryptAESNI<8> (encryptions, in, out);
+			switch (num)
+			{
+				case 7: EncryptAESNI<7> (encryptions, in, out); break;
+				case 6: EncryptAESNI<6> (encryptions, in, out); break;
+				case 5: EncryptAESNI<5> (encryptions, in, out); break;
+				case 4: EncryptAESNI<4> (encryptions, in, out); break;
+				case 3: EncryptAESNI<3> (encryptions, in, out); break;
+				case 2: EncryptAESNI<2> (encryptions, in, out); break;
+				case 1: encryptions[0]->Encrypt (in[0], out[0]); break;
+				default: ;
+			}
+		}
+		else
+#endif
+		{
+			for (int i = 0; i < num; i++)
+				encryptions[i]->Encrypt (in[i], out[i]);
+		}
+	}
+
+	void TunnelEncryption::Encrypt (int num, const uint8_t * const * in, uint8_t * const * out)
+	{
+		TunnelEncryption * encryptions[8] = { this, this, this, this, this, this, this, this };
+		for (; num > 0; num -= 8, in += 8, out += 8)
+			Encrypt (num < 8 ? num : 8, encryptions, in, out);
+	}
+
 	void TunnelDecryption::Decrypt (const uint8_t * in, uint8_t * out)
 	{
 #ifdef __AES__
@@ -1228,6 +1316,102 @@ namespace crypto
 #endif		
 	}
 
+	bool IsAEADChaCha20Poly1305BatchSupported ()
+	{
+		return i2p::cpu::avx2;
+	}
+
+	static void XorKeystream (uint8_t * buf, const uint8_t * keystream, size_t len)
+	{
+		for (; len >= 8; buf += 8, keystream += 8, len -= 8)
+			htobuf64 (buf, buf64toh (buf) ^ buf64toh (keystream));
+		for (size_t i = 0; i < len; i++)
+			buf[i] ^= keystream[i];
+	}
+
+	const size_t AEAD_BATCH_MAX_FRAME_LEN = 8192; // larger frames are faster by single stream code
+
+	void AEADChaCha20Poly1305Batch (std::vector<AEADChaCha20Poly1305Frame>& frames, bool encrypt)
+	{
+		// pick small frames for SIMD lanes, process rest one by one
+		std::vector<AEADChaCha20Poly1305Frame *> batch;
+		if (frames.size () > 1 && IsAEADChaCha20Poly1305BatchSupported ())
+			for (auto& it: frames)
+				if (it.len <= AEAD_BATCH_MAX_FRAME_LEN) batch.push_back (&it);
+		if (batch.size () < 2) batch.clear ();
+		for (auto& it: frames)
+			if (batch.empty () || it.len > AEAD_BATCH_MAX_FRAME_LEN)
+				it.result = AEADChaCha20Poly1305 (it.buf, it.len, nullptr, 0, it.key, it.nonce, it.buf, it.len + 16, encrypt);
+		if (batch.empty ()) return;
+		// keystream of all blocks of all frames at once, first block of each frame is Poly1305 key
+		size_t numBlocks = 0;
+		for (const auto it: batch)
+			numBlocks += 1 + (it->len + 63)/64;
+		std::vector<uint32_t> states (batch.size ()*16), indices (numBlocks), counters (numBlocks);
+		std::vector<uint8_t> keystream (numBlocks*64);
+		std::vector<uint8_t *> out (numBlocks);
+		std::vector<uint8_t *> polyKeys (batch.size ());
+		for (size_t i = 0, n = 0; i < batch.size (); i++)
+		{
+			chacha::Chacha20State state;
+			chacha::Chacha20Init (state, batch[i]->nonce, batch[i]->key, 0);
+			memcpy (states.data () + i*16, state.data, 64);
+			polyKeys[i] = keystream.data () + n*64;
+			for (uint32_t counter = 0; counter <= (batch[i]->len + 63)/64; counter++, n++)
+			{
+				indices[n] = i; counters[n] = counter;
+				out[n] = keystream.data () + n*64;
+			}
+		}
+		chacha::Chacha20Keystream (states.data (), indices.data (), counters.data (), out.data (), numBlocks);
+		// Poly1305 of ciphertexts, full blocks of all frames at once
+		std::vector<Poly1305> polys;
+		polys.reserve (batch.size ());
+		std::vector<Poly1305 *> polyPtrs (batch.size ());
+		std::vector<const uint8_t *> msgs (batch.size ());
+		std::vector<size_t> sizes (batch.size ());
+		for (size_t i = 0; i < batch.size (); i++)
+		{
+			auto frame = batch[i];
+			if (encrypt) XorKeystream (frame->buf, polyKeys[i] + 64, frame->len);
+			polys.emplace_back ((const uint64_t *)polyKeys[i]);
+			polyPtrs[i] = &polys.back ();
+			msgs[i] = frame->buf;
+			sizes[i] = frame->len & ~(size_t)0x0F;
+		}
+		Poly1305Blocks (polyPtrs.data (), msgs.data (), sizes.data (), batch.size ());
+		uint8_t padding[16];
+		for (size_t i = 0; i < batch.size (); i++)
+		{
+			auto frame = batch[i];
+			auto& polyHash = polys[i];
+			auto rem = frame->len & 0x0F; // %16
+			if (rem)
+			{
+				polyHash.Update (frame->buf + sizes[i], rem);
+				// padding2
+				memset (padding, 0, 16);
+				polyHash.Update (padding, 16 - rem);
+			}
+			// adLen and msgLen
+			htole64buf (padding, 0);
+			htole64buf (padding + 8, frame->len);
+			polyHash.Update (padding, 16);
+			uint64_t tag[2];
+			polyHash.Finish (tag);
+			if (encrypt)
+			{
+				memcpy (frame->buf + frame->len, tag, 16);
+				frame->result = true;
+			}
+			else
+			{
+				frame->result = !memcmp (tag, frame->buf + frame->len, 16);
+				XorKeystream (frame->buf, polyKeys[i] + 64, frame->len);
+			}
+		}
+	}
+
 // init and terminate
 
 /*	std::vector <std::unique_ptr<std::mutex> >  m_OpenSSLMutexes;
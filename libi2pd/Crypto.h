@@ -20,6 +20,10 @@
 #include "Tag.h"
 #include "CPU.h"
 
+#ifdef __AES__
+#include <wmmintrin.h>
+#endif
+
 // recognize openssl version and features
 #if ((OPENSSL_VERSION_NUMBER < 0x010100000) || defined(LIBRESSL_VERSION_NUMBER)) // 1.0.2 and below or LibreSSL
 #   define LEGACY_OPENSSL 1
@@ -260,6 +264,16 @@ namespace crypto
 			}
 
 			void Encrypt (const uint8_t * in, uint8_t * out); // 1024 bytes (16 IV + 1008 data)
+			void Encrypt (int num, const uint8_t * const * in, uint8_t * const * out); // num messages with same keys
+			static void Encrypt (int num, TunnelEncryption * const * encryptions,
+				const uint8_t * const * in, uint8_t * const * out); // num messages, own keys for each
+
+		private:
+
+#ifdef __AES__
+			template<int N>
+			static void EncryptAESNI (TunnelEncryption * const * encryptions, const uint8_t * const * in, uint8_t * const * out);
+#endif
 
 		private:
 
@@ -290,6 +304,17 @@ namespace crypto
 
 	void AEADChaCha20Poly1305Encrypt (const std::vector<std::pair<uint8_t *, size_t> >& bufs, const uint8_t * key, const uint8_t * nonce, uint8_t * mac); // encrypt multiple buffers with zero ad
 
+	struct AEADChaCha20Poly1305Frame // zero ad, processed in place, tag follows data
+	{
+		uint8_t * buf;
+		size_t len; // without tag
+		const uint8_t * key;
+		uint8_t nonce[12];
+		bool result; // false if tag mismatch
+	};
+	bool IsAEADChaCha20Poly1305BatchSupported (); // true if frames are interleaved in SIMD lanes rather than one by one
+	void AEADChaCha20Poly1305Batch (std::vector<AEADChaCha20Poly1305Frame>& frames, bool encrypt); // independent frames with own keys and nonces
+
 // init and terminate
 	void InitCrypto (bool precomputation);
 	void TerminateCrypto ();
@@ -7,11 +7,21 @@
 #include <thread>
 #include <vector>
 #include <memory>
+#include <functional>
 
 namespace i2p
 {
 namespace worker
 {
+	template<typename Caller>
+	struct ResultPoster // specialize for callers without io_service
+	{
+		static void Post (std::shared_ptr<Caller> caller, const std::function<void(void)>& result)
+		{
+			caller->GetService().post(result);
+		}
+	};
+
 	template<typename Caller>
 	struct ThreadPool
 	{
@@ -21,7 +31,8 @@ namespace worker
 		typedef std::mutex mtx_t;
 		typedef std::unique_lock<mtx_t> lock_t;
 		typedef std::condition_variable cond_t;
-		ThreadPool(int workers)
+		ThreadPool(int workers, size_t maxJobs = 0): // 0 - unlimited backlog
+			maxJobs(maxJobs)
 		{
 			stop = false;
 			if(workers > 0)
@@ -41,21 +52,28 @@ namespace worker
 									this->jobs.pop_front();
 								}
 								ResultFunc result = job.second();
-								job.first->GetService().post(result);
+								ResultPoster<Caller>::Post(job.first, result);
 							}
 					});
 				}
 			}
 		};
 
-		void Offer(const Job & job)
+		bool Offer(const Job & job) // false if stopped or backlog is full
 		{
 			{
 				lock_t lock(queue_mutex);
-				if (stop) return;
+				if (stop || (maxJobs && jobs.size() >= maxJobs)) return false;
 				jobs.emplace_back(job);
 			}
 			condition.notify_one();
+			return true;
+		}
+
+		size_t GetBacklog()
+		{
+			lock_t lock(queue_mutex);
+			return jobs.size();
 		}
 
 		~ThreadPool()
@@ -73,6 +91,7 @@ namespace worker
 		mtx_t queue_mutex;
 		cond_t condition;
 		bool stop;
+		const size_t maxJobs;
 	};
 }
 }
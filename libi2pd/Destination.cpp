@@ -110,6 +110,7 @@ namespace client
 
 	void LeaseSetDestination::Run ()
 	{
+		i2p::util::SetThreadAffinity ("destinations");
 		while (m_IsRunning)
 		{
 			try
@@ -11,6 +11,11 @@
 
 #ifdef _WIN32
 #include <shlobj.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include "Base.h"
@@ -136,6 +141,22 @@ namespace fs {
     return boost::filesystem::remove(path);
   }
 
+	bool Sync (const std::string& path)
+	{
+#ifdef _WIN32
+		int fd = _open (path.c_str (), _O_RDWR | _O_BINARY);
+		if (fd < 0) return false;
+		bool ret = !_commit (fd);
+		_close (fd);
+#else
+		int fd = open (path.c_str (), O_RDONLY);
+		if (fd < 0) return false;
+		bool ret = !fsync (fd);
+		close (fd);
+#endif
+		return ret;
+	}
+
 	bool CreateDirectory (const std::string& path)
 	{
 		if (boost::filesystem::exists(path) &&
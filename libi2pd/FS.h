@@ -115,6 +115,8 @@ namespace fs {
 
   uint32_t GetLastUpdateTime (const std::string & path); // seconds since epoch
 
+	bool Sync (const std::string& path); // flushes written data of file to disk, false if failed
+
   bool CreateDirectory (const std::string& path);
 
   template<typename T>
@@ -1,5 +1,7 @@
 #include <string.h>
 #include <atomic>
+#include <mutex>
+#include <vector>
 #include "Base.h"
 #include "Log.h"
 #include "Crypto.h"
@@ -17,21 +19,210 @@ using namespace i2p::transport;
 
 namespace i2p
 {
+	const size_t I2NP_CONTROL_BLOCK_RESERVE = 64; // shared_ptr's control block allocated in the same block as message
+
+	template<int sz>
+	class I2NPMessagesPool
+	{
+		// released blocks go to per-thread cache first, overflow is shared between threads
+		typedef I2NPMessageBuffer<sz> Buffer;
+		static const size_t BLOCK_SIZE = sizeof (Buffer) + I2NP_CONTROL_BLOCK_RESERVE;
+
+		struct LocalCache
+		{
+			I2NPMessagesPool * pool;
+			bool& isDestroyed;
+			std::vector<void *> blocks;
+
+			LocalCache (I2NPMessagesPool * p, bool& destroyed): pool (p), isDestroyed (destroyed) {};
+			~LocalCache ()
+			{
+				isDestroyed = true; // blocks released after thread's exit go to shared pool directly
+				pool->ReleaseShared (blocks);
+			}
+		};
+
+		public:
+
+			// passed to std::allocate_shared, rebound to shared_ptr's control block containing the message
+			template<typename T>
+			struct Allocator
+			{
+				typedef T value_type;
+				I2NPMessagesPool * pool;
+
+				Allocator (I2NPMessagesPool * p): pool (p) {}
+				template<typename U>
+				Allocator (const Allocator<U>& other): pool (other.pool) {}
+
+				T * allocate (size_t n) { return static_cast<T *>(pool->Allocate (n*sizeof (T))); }
+				void deallocate (T * p, size_t n) { pool->Deallocate (p, n*sizeof (T)); }
+
+				template<typename U>
+				bool operator== (const Allocator<U>& other) const { return pool == other.pool; }
+				template<typename U>
+				bool operator!= (const Allocator<U>& other) const { return pool != other.pool; }
+			};
+
+			I2NPMessagesPool (size_t maxNumLocal, size_t maxNumShared):
+				m_MaxNumLocal (maxNumLocal), m_MaxNumShared (maxNumShared),
+				m_NumHits (0), m_NumMisses (0), m_NumInUse (0), m_HighWaterMark (0) {};
+
+			std::shared_ptr<I2NPMessage> Acquire ()
+			{
+				return std::allocate_shared<Buffer> (Allocator<Buffer> (this));
+			}
+
+			void * Allocate (size_t size)
+			{
+				void * block = nullptr;
+				if (size <= BLOCK_SIZE)
+				{
+					auto cache = GetLocalCache ();
+					if (cache && !cache->empty ())
+					{
+						block = cache->back ();
+						cache->pop_back ();
+					}
+					else
+					{
+						std::unique_lock<std::mutex> l(m_SharedMutex);
+						if (!m_Shared.empty ())
+						{
+							block = m_Shared.back ();
+							m_Shared.pop_back ();
+							if (cache) // refill local cache by half to avoid locking on next acquire
+								while (!m_Shared.empty () && cache->size () < m_MaxNumLocal/2)
+								{
+									cache->push_back (m_Shared.back ());
+									m_Shared.pop_back ();
+								}
+						}
+					}
+				}
+				if (block)
+					m_NumHits++;
+				else
+				{
+					m_NumMisses++;
+					block = ::operator new (size > BLOCK_SIZE ? size : BLOCK_SIZE);
+				}
+				size_t inUse = ++m_NumInUse, highWaterMark = m_HighWaterMark;
+				while (inUse > highWaterMark && !m_HighWaterMark.compare_exchange_weak (highWaterMark, inUse));
+				return block;
+			}
+
+			void Deallocate (void * block, size_t size)
+			{
+				m_NumInUse--;
+				if (size > BLOCK_SIZE) // control block didn't fit
+				{
+					::operator delete (block);
+					return;
+				}
+				auto cache = GetLocalCache ();
+				if (cache && cache->size () < m_MaxNumLocal)
+					cache->push_back (block);
+				else
+				{
+					std::unique_lock<std::mutex> l(m_SharedMutex);
+					if (m_Shared.size () < m_MaxNumShared)
+						m_Shared.push_back (block);
+					else
+					{
+						l.unlock ();
+						::operator delete (block);
+					}
+				}
+			}
+
+			void ReleaseShared (std::vector<void *>& blocks)
+			{
+				std::unique_lock<std::mutex> l(m_SharedMutex);
+				for (auto it: blocks)
+				{
+					if (m_Shared.size () < m_MaxNumShared)
+						m_Shared.push_back (it);
+					else
+						::operator delete (it);
+				}
+				blocks.clear ();
+			}
+
+			I2NPMessagesPoolStats GetStats ()
+			{
+				I2NPMessagesPoolStats stats;
+				stats.bufferSize = sz;
+				stats.numHits = m_NumHits; stats.numMisses = m_NumMisses;
+				stats.numInUse = m_NumInUse; stats.highWaterMark = m_HighWaterMark;
+				std::unique_lock<std::mutex> l(m_SharedMutex);
+				stats.numFree = m_Shared.size (); // thread caches are not counted
+				return stats;
+			}
+
+		private:
+
+			std::vector<void *> * GetLocalCache ()
+			{
+				static thread_local bool isDestroyed = false;
+				if (isDestroyed) return nullptr;
+				static thread_local LocalCache cache (this, isDestroyed);
+				return &cache.blocks;
+			}
+
+		private:
+
+			size_t m_MaxNumLocal, m_MaxNumShared;
+			std::mutex m_SharedMutex;
+			std::vector<void *> m_Shared;
+			std::atomic<uint64_t> m_NumHits, m_NumMisses;
+			std::atomic<size_t> m_NumInUse, m_HighWaterMark;
+	};
+
+	const int I2NP_TUNNEL_MESSAGE_BUFFER_SIZE = i2p::tunnel::TUNNEL_DATA_MSG_SIZE + I2NP_HEADER_SIZE + 34; // reserved for alignment and NTCP 16 + 6 + 12
+	// pools are never deleted, since messages might be released by static objects at exit
+	template<int sz>
+	static I2NPMessagesPool<sz>& GetI2NPMessagesPool (size_t maxNumLocal, size_t maxNumShared)
+	{
+		static auto pool = new I2NPMessagesPool<sz>(maxNumLocal, maxNumShared);
+		return *pool;
+	}
+
+	static I2NPMessagesPool<I2NP_MAX_MESSAGE_SIZE>& GetI2NPMessagesPool ()
+	{
+		return GetI2NPMessagesPool<I2NP_MAX_MESSAGE_SIZE> (8, 128);
+	}
+
+	static I2NPMessagesPool<I2NP_MAX_SHORT_MESSAGE_SIZE>& GetI2NPShortMessagesPool ()
+	{
+		return GetI2NPMessagesPool<I2NP_MAX_SHORT_MESSAGE_SIZE> (32, 1024);
+	}
+
+	static I2NPMessagesPool<I2NP_TUNNEL_MESSAGE_BUFFER_SIZE>& GetI2NPTunnelMessagesPool ()
+	{
+		return GetI2NPMessagesPool<I2NP_TUNNEL_MESSAGE_BUFFER_SIZE> (64, 4096);
+	}
+
 	std::shared_ptr<I2NPMessage> NewI2NPMessage ()
 	{
-		return std::make_shared<I2NPMessageBuffer<I2NP_MAX_MESSAGE_SIZE> >();
+		return GetI2NPMessagesPool ().Acquire ();
 	}
 
 	std::shared_ptr<I2NPMessage> NewI2NPShortMessage ()
 	{
-		return std::make_shared<I2NPMessageBuffer<I2NP_MAX_SHORT_MESSAGE_SIZE> >();
+		return GetI2NPShortMessagesPool ().Acquire ();
 	}
 
 	std::shared_ptr<I2NPMessage> NewI2NPTunnelMessage ()
 	{
-		auto msg = new I2NPMessageBuffer<i2p::tunnel::TUNNEL_DATA_MSG_SIZE + I2NP_HEADER_SIZE + 34>(); // reserved for alignment and NTCP 16 + 6 + 12
+		auto msg = GetI2NPTunnelMessagesPool ().Acquire ();
 		msg->Align (12);
-		return std::shared_ptr<I2NPMessage>(msg);
+		return msg;
+	}
+
+	std::vector<I2NPMessagesPoolStats> GetI2NPMessagesPoolsStats ()
+	{
+		return { GetI2NPMessagesPool ().GetStats (), GetI2NPShortMessagesPool ().GetStats (), GetI2NPTunnelMessagesPool ().GetStats () };
 	}
 
 	std::shared_ptr<I2NPMessage> NewI2NPMessage (size_t len)
@@ -318,53 +509,111 @@ namespace i2p
 		}
 	}
 
-	bool HandleBuildRequestRecords (int num, uint8_t * records, uint8_t * clearText)
+	int FindBuildRequestRecord (int num, const uint8_t * records)
 	{
 		for (int i = 0; i < num; i++)
 		{
-			uint8_t * record = records + i*TUNNEL_BUILD_RECORD_SIZE;
+			const uint8_t * record = records + i*TUNNEL_BUILD_RECORD_SIZE;
 			if (!memcmp (record + BUILD_REQUEST_RECORD_TO_PEER_OFFSET, (const uint8_t *)i2p::context.GetRouterInfo ().GetIdentHash (), 16))
 			{
 				LogPrint (eLogDebug, "I2NP: Build request record ", i, " is ours");
-				BN_CTX * ctx = BN_CTX_new ();
-				i2p::context.DecryptTunnelBuildRecord (record + BUILD_REQUEST_RECORD_ENCRYPTED_OFFSET, clearText, ctx);
-				BN_CTX_free (ctx);
-				// replace record to reply
-				if (i2p::context.AcceptsTunnels () &&
-					i2p::tunnel::tunnels.GetTransitTunnels ().size () <= g_MaxNumTransitTunnels &&
-					!i2p::transport::transports.IsBandwidthExceeded () &&
-					!i2p::transport::transports.IsTransitBandwidthExceeded ())
-				{
-					auto transitTunnel = i2p::tunnel::CreateTransitTunnel (
-							bufbe32toh (clearText + BUILD_REQUEST_RECORD_RECEIVE_TUNNEL_OFFSET),
-							clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-						    bufbe32toh (clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
-							clearText + BUILD_REQUEST_RECORD_LAYER_KEY_OFFSET,
-						    clearText + BUILD_REQUEST_RECORD_IV_KEY_OFFSET,
-							clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x80,
-						    clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET ] & 0x40);
-					i2p::tunnel::tunnels.AddTransitTunnel (transitTunnel);
-					record[BUILD_RESPONSE_RECORD_RET_OFFSET] = 0;
-				}
-				else
-					record[BUILD_RESPONSE_RECORD_RET_OFFSET] = 30; // always reject with bandwidth reason (30)
-
-				//TODO: fill filler
-				SHA256 (record + BUILD_RESPONSE_RECORD_PADDING_OFFSET, BUILD_RESPONSE_RECORD_PADDING_SIZE + 1, // + 1 byte of ret
-					record + BUILD_RESPONSE_RECORD_HASH_OFFSET);
-				// encrypt reply
-				i2p::crypto::CBCEncryption encryption;
-				for (int j = 0; j < num; j++)
-				{
-					encryption.SetKey (clearText + BUILD_REQUEST_RECORD_REPLY_KEY_OFFSET);
-					encryption.SetIV (clearText + BUILD_REQUEST_RECORD_REPLY_IV_OFFSET);
-					uint8_t * reply = records + j*TUNNEL_BUILD_RECORD_SIZE;
-					encryption.Encrypt(reply, TUNNEL_BUILD_RECORD_SIZE, reply);
-				}
-				return true;
+				return i;
 			}
 		}
-		return false;
+		return -1;
+	}
+
+	void HandleBuildRequestRecord (int num, uint8_t * records, int index, const uint8_t * clearText)
+	{
+		uint8_t * record = records + index*TUNNEL_BUILD_RECORD_SIZE;
+		// replace record to reply
+		if (i2p::context.AcceptsTunnels () &&
+			i2p::tunnel::tunnels.CountTransitTunnels () <= g_MaxNumTransitTunnels &&
+			!i2p::transport::transports.IsBandwidthExceeded () &&
+			!i2p::transport::transports.IsTransitBandwidthExceeded ())
+		{
+			auto transitTunnel = i2p::tunnel::CreateTransitTunnel (
+					bufbe32toh (clearText + BUILD_REQUEST_RECORD_RECEIVE_TUNNEL_OFFSET),
+					clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
+				    bufbe32toh (clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
+					clearText + BUILD_REQUEST_RECORD_LAYER_KEY_OFFSET,
+				    clearText + BUILD_REQUEST_RECORD_IV_KEY_OFFSET,
+					clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x80,
+				    clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET ] & 0x40);
+			i2p::tunnel::tunnels.AddTransitTunnel (transitTunnel);
+			record[BUILD_RESPONSE_RECORD_RET_OFFSET] = 0;
+		}
+		else
+			record[BUILD_RESPONSE_RECORD_RET_OFFSET] = 30; // always reject with bandwidth reason (30)
+
+		//TODO: fill filler
+		SHA256 (record + BUILD_RESPONSE_RECORD_PADDING_OFFSET, BUILD_RESPONSE_RECORD_PADDING_SIZE + 1, // + 1 byte of ret
+			record + BUILD_RESPONSE_RECORD_HASH_OFFSET);
+		// encrypt reply
+		i2p::crypto::CBCEncryption encryption;
+		for (int j = 0; j < num; j++)
+		{
+			encryption.SetKey (clearText + BUILD_REQUEST_RECORD_REPLY_KEY_OFFSET);
+			encryption.SetIV (clearText + BUILD_REQUEST_RECORD_REPLY_IV_OFFSET);
+			uint8_t * reply = records + j*TUNNEL_BUILD_RECORD_SIZE;
+			encryption.Encrypt(reply, TUNNEL_BUILD_RECORD_SIZE, reply);
+		}
+	}
+
+	static void DecryptBuildRequestRecord (const uint8_t * record, uint8_t * clearText)
+	{
+		BN_CTX * ctx = BN_CTX_new ();
+		i2p::context.DecryptTunnelBuildRecord (record + BUILD_REQUEST_RECORD_ENCRYPTED_OFFSET, clearText, ctx);
+		BN_CTX_free (ctx);
+	}
+
+	static void ForwardTunnelBuildMsg (I2NPMessageType typeID, const uint8_t * buf, size_t len, const uint8_t * clearText)
+	{
+		if (clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x40) // we are endpoint of outbound tunnel
+		{
+			// so we send it to reply tunnel
+			transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
+				CreateTunnelGatewayMsg (bufbe32toh (clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
+					typeID == eI2NPVariableTunnelBuild ? eI2NPVariableTunnelBuildReply : eI2NPTunnelBuildReply, buf, len,
+				    bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
+		}
+		else
+			transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
+				CreateI2NPMessage (typeID, buf, len,
+					bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
+	}
+
+	void DecryptTunnelBuildRequest (std::shared_ptr<TunnelBuildRequest> request)
+	{
+		DecryptBuildRequestRecord (request->buf.data () + request->recordsOffset + request->index*TUNNEL_BUILD_RECORD_SIZE,
+			request->clearText);
+	}
+
+	void HandleTunnelBuildRequest (std::shared_ptr<TunnelBuildRequest> request)
+	{
+		HandleBuildRequestRecord (request->num, request->buf.data () + request->recordsOffset, request->index, request->clearText);
+		ForwardTunnelBuildMsg (request->typeID, request->buf.data (), request->buf.size (), request->clearText);
+	}
+
+	static void PostTunnelBuildRequest (I2NPMessageType typeID, const uint8_t * buf, size_t len, size_t recordsOffset, int num)
+	{
+		if (recordsOffset + num*TUNNEL_BUILD_RECORD_SIZE > len)
+		{
+			LogPrint (eLogError, "I2NP: Tunnel build message of ", num, " records is too short ", len);
+			return;
+		}
+		int index = FindBuildRequestRecord (num, buf + recordsOffset);
+		if (index < 0) return;
+		// ElGamal decryption is too expensive for tunnels thread
+		auto request = std::make_shared<TunnelBuildRequest>();
+		request->typeID = typeID;
+		request->buf.assign (buf, buf + len);
+		request->recordsOffset = recordsOffset;
+		request->num = num;
+		request->index = index;
+		if (!i2p::tunnel::tunnels.PostTunnelBuildRequest (request))
+			// even reject requires our record decrypted for reply keys and next hop
+			LogPrint (eLogWarning, "I2NP: Tunnel build request dropped, too many pending requests");
 	}
 
 	void HandleVariableTunnelBuildMsg (uint32_t replyMsgID, uint8_t * buf, size_t len)
@@ -395,24 +644,7 @@ namespace i2p
 			}
 		}
 		else
-		{
-			uint8_t clearText[BUILD_REQUEST_RECORD_CLEAR_TEXT_SIZE];
-			if (HandleBuildRequestRecords (num, buf + 1, clearText))
-			{
-				if (clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x40) // we are endpoint of outboud tunnel
-				{
-					// so we send it to reply tunnel
-					transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-						CreateTunnelGatewayMsg (bufbe32toh (clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
-							eI2NPVariableTunnelBuildReply, buf, len,
-						    bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
-				}
-				else
-					transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-						CreateI2NPMessage (eI2NPVariableTunnelBuild, buf, len,
-							bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
-			}
-		}
+			PostTunnelBuildRequest (eI2NPVariableTunnelBuild, buf, len, 1, num);
 	}
 
 	void HandleTunnelBuildMsg (uint8_t * buf, size_t len)
@@ -422,22 +654,7 @@ namespace i2p
 			LogPrint (eLogError, "TunnelBuild message is too short ", len);
 			return;
 		}
-		uint8_t clearText[BUILD_REQUEST_RECORD_CLEAR_TEXT_SIZE];
-		if (HandleBuildRequestRecords (NUM_TUNNEL_BUILD_RECORDS, buf, clearText))
-		{
-			if (clearText[BUILD_REQUEST_RECORD_FLAG_OFFSET] & 0x40) // we are endpoint of outbound tunnel
-			{
-				// so we send it to reply tunnel
-				transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-					CreateTunnelGatewayMsg (bufbe32toh (clearText + BUILD_REQUEST_RECORD_NEXT_TUNNEL_OFFSET),
-						eI2NPTunnelBuildReply, buf, len,
-					    bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
-			}
-			else
-				transports.SendMessage (clearText + BUILD_REQUEST_RECORD_NEXT_IDENT_OFFSET,
-					CreateI2NPMessage (eI2NPTunnelBuild, buf, len,
-						bufbe32toh (clearText + BUILD_REQUEST_RECORD_SEND_MSG_ID_OFFSET)));
-		}
+		PostTunnelBuildRequest (eI2NPTunnelBuild, buf, len, 0, NUM_TUNNEL_BUILD_RECORDS);
 	}
 
 	void HandleVariableTunnelBuildReplyMsg (uint32_t replyMsgID, uint8_t * buf, size_t len)
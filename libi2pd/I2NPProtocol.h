@@ -4,6 +4,7 @@
 #include <inttypes.h>
 #include <string.h>
 #include <set>
+#include <vector>
 #include <memory>
 #include "Crypto.h"
 #include "I2PEndian.h"
@@ -234,6 +235,14 @@ namespace tunnel
 	std::shared_ptr<I2NPMessage> NewI2NPTunnelMessage ();
 	std::shared_ptr<I2NPMessage> NewI2NPMessage (size_t len);
 
+	struct I2NPMessagesPoolStats
+	{
+		size_t bufferSize;
+		uint64_t numHits, numMisses; // message with its control block acquired from pool or allocated
+		size_t numInUse, highWaterMark, numFree;
+	};
+	std::vector<I2NPMessagesPoolStats> GetI2NPMessagesPoolsStats (); // full, short, tunnel
+
 	std::shared_ptr<I2NPMessage> CreateI2NPMessage (I2NPMessageType msgType, const uint8_t * buf, size_t len, uint32_t replyMsgID = 0);
 	std::shared_ptr<I2NPMessage> CreateI2NPMessage (const uint8_t * buf, size_t len, std::shared_ptr<i2p::tunnel::InboundTunnel> from = nullptr);
 	std::shared_ptr<I2NPMessage> CopyI2NPMessage (std::shared_ptr<I2NPMessage> msg);
@@ -251,7 +260,19 @@ namespace tunnel
 	std::shared_ptr<I2NPMessage> CreateDatabaseStoreMsg (std::shared_ptr<const i2p::data::LocalLeaseSet> leaseSet, uint32_t replyToken = 0, std::shared_ptr<const i2p::tunnel::InboundTunnel> replyTunnel = nullptr);
 	bool IsRouterInfoMsg (std::shared_ptr<I2NPMessage> msg);
 
-	bool HandleBuildRequestRecords (int num, uint8_t * records, uint8_t * clearText);
+	struct TunnelBuildRequest // our record of build message, decrypted by crypto worker
+	{
+		I2NPMessageType typeID; // eI2NPVariableTunnelBuild or eI2NPTunnelBuild
+		std::vector<uint8_t> buf; // copy of payload
+		size_t recordsOffset;
+		int num, index; // number of records, our record
+		uint8_t clearText[BUILD_REQUEST_RECORD_CLEAR_TEXT_SIZE];
+	};
+	void DecryptTunnelBuildRequest (std::shared_ptr<TunnelBuildRequest> request); // in crypto worker
+	void HandleTunnelBuildRequest (std::shared_ptr<TunnelBuildRequest> request); // in tunnels thread, after decryption
+
+	int FindBuildRequestRecord (int num, const uint8_t * records); // -1 if not found
+	void HandleBuildRequestRecord (int num, uint8_t * records, int index, const uint8_t * clearText);
 	void HandleVariableTunnelBuildMsg (uint32_t replyMsgID, uint8_t * buf, size_t len);
 	void HandleVariableTunnelBuildReplyMsg (uint32_t replyMsgID, uint8_t * buf, size_t len);
 	void HandleTunnelBuildMsg (uint8_t * buf, size_t len);
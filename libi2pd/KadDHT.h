@@ -0,0 +1,114 @@
+#ifndef KADDHT_H__
+#define KADDHT_H__
+
+#include <inttypes.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <memory>
+#include <iterator>
+
+#include "Identity.h"
+
+namespace i2p
+{
+namespace data
+{
+	// binary trie of ident hashes kept as a sorted map, subtree of any prefix is a contiguous range
+	// closest routers by XOR metric are found by descending to the key's side first, O(log n) per router found
+	template<typename T> // T must provide GetIdentHash ()
+	class DHTTable
+	{
+		typedef std::map<IdentHash, std::shared_ptr<T> > Routers;
+		typedef typename Routers::const_iterator Iterator;
+
+		public:
+
+			size_t GetSize () const { return m_Routers.size (); };
+			void Clear () { m_Routers.clear (); };
+
+			bool Insert (std::shared_ptr<T> r) { return m_Routers.emplace (r->GetIdentHash (), r).second; }; // false if already exists
+			bool Remove (const IdentHash& ident) { return m_Routers.erase (ident) > 0; };
+
+			template<typename Filter>
+			size_t Cleanup (Filter filter) // remove routers for which filter (r) returns true
+			{
+				size_t num = 0;
+				for (auto it = m_Routers.begin (); it != m_Routers.end ();)
+					if (filter (it->second))
+					{
+						it = m_Routers.erase (it);
+						num++;
+					}
+					else
+						++it;
+				return num;
+			}
+
+			template<typename Visitor>
+			void ForEach (Visitor v) const
+			{
+				for (const auto& it: m_Routers) v (it.second);
+			}
+
+			template<typename Filter>
+			std::shared_ptr<T> FindClosest (const IdentHash& key, Filter filter) const
+			{
+				std::vector<std::shared_ptr<T> > res;
+				FindClosest (key, 1, filter, res);
+				return res.empty () ? nullptr : res[0];
+			}
+
+			template<typename Filter>
+			void FindClosest (const IdentHash& key, size_t num, Filter filter, std::vector<std::shared_ptr<T> >& res) const
+			{
+				// appends up to num routers for which filter (r) returns true, in order of increasing XOR distance to key
+				size_t n = res.size () + num;
+				if (num) Find (m_Routers.begin (), m_Routers.end (), 0, key, n, filter, res);
+			}
+
+		private:
+
+			template<typename Filter>
+			void Find (Iterator begin, Iterator end, int bit, const IdentHash& key, size_t num, Filter filter,
+				std::vector<std::shared_ptr<T> >& res) const
+			{
+				// all routers in [begin, end) share first bit bits
+				while (begin != end && res.size () < num)
+				{
+					if (std::next (begin) == end)
+					{
+						if (filter (begin->second)) res.push_back (begin->second);
+						return;
+					}
+					// split range by value of bit: prefix|1|00..0 is the first router of the right subtree
+					IdentHash split = begin->first;
+					uint8_t * buf = split;
+					int byte = bit >> 3;
+					uint8_t mask = 0x80 >> (bit & 0x07);
+					buf[byte] = (buf[byte] & ~(mask - 1)) | mask;
+					memset (buf + byte + 1, 0, 32 - byte - 1);
+					auto middle = m_Routers.lower_bound (split);
+					bit++;
+					if (middle == begin || middle == end) continue; // same bit for all, go deeper
+					if (key[byte] & mask)
+					{
+						Find (middle, end, bit, key, num, filter, res);
+						end = middle;
+					}
+					else
+					{
+						Find (begin, middle, bit, key, num, filter, res);
+						begin = middle;
+					}
+				}
+			}
+
+		private:
+
+			Routers m_Routers;
+	};
+}
+}
+
+#endif
@@ -18,9 +18,11 @@
 #include "I2PEndian.h"
 #include "Crypto.h"
 #include "Siphash.h"
+#include "util.h"
 #include "RouterContext.h"
 #include "Transports.h"
 #include "NetDb.hpp"
+#include "Config.h"
 #include "NTCP2.h"
 
 namespace i2p
@@ -90,7 +92,7 @@ namespace transport
 
 	void NTCP2Establisher::KDF1Alice ()
 	{
-		KeyDerivationFunction1 (m_RemoteStaticKey, m_EphemeralKeys, m_RemoteStaticKey, GetPub ());
+		KeyDerivationFunction1 (m_RemoteStaticKey, *m_EphemeralKeys, m_RemoteStaticKey, GetPub ());
 	}
 	
 	void NTCP2Establisher::KDF1Bob ()
@@ -109,7 +111,7 @@ namespace transport
 
 		// x25519 between remote pub and ephemaral priv
 		uint8_t inputKeyMaterial[32];
-		m_EphemeralKeys.Agree (GetRemotePub (), inputKeyMaterial);
+		m_EphemeralKeys->Agree (GetRemotePub (), inputKeyMaterial);
 		
 		MixKey (inputKeyMaterial);
 	}
@@ -134,13 +136,13 @@ namespace transport
 	void NTCP2Establisher::KDF3Bob ()
 	{
 		uint8_t inputKeyMaterial[32];
-		m_EphemeralKeys.Agree (m_RemoteStaticKey, inputKeyMaterial); 
+		m_EphemeralKeys->Agree (m_RemoteStaticKey, inputKeyMaterial); 
 		MixKey (inputKeyMaterial);
 	}
 
 	void NTCP2Establisher::CreateEphemeralKey ()
 	{
-		m_EphemeralKeys.GenerateKeys ();
+		m_EphemeralKeys = i2p::transport::transports.GetNextX25519KeysPair ();
 	}
 
 	void NTCP2Establisher::CreateSessionRequestMessage ()
@@ -352,17 +354,21 @@ namespace transport
 		return true;
 	}
 
-	NTCP2Session::NTCP2Session (NTCP2Server& server, std::shared_ptr<const i2p::data::RouterInfo> in_RemoteRouter):
+	NTCP2Session::NTCP2Session (NTCP2Server& server, std::shared_ptr<const i2p::data::RouterInfo> in_RemoteRouter,
+		boost::asio::io_service * service):
 		TransportSession (in_RemoteRouter, NTCP2_ESTABLISH_TIMEOUT), 
-		m_Server (server), m_Socket (m_Server.GetService ()), 
+		m_Server (server), m_Service (service ? *service :
+			(in_RemoteRouter ? server.GetService (in_RemoteRouter->GetIdentHash ()) : server.GetService ())),
+		m_Socket (m_Service), 
 		m_IsEstablished (false), m_IsTerminated (false),
 		m_Establisher (new NTCP2Establisher),
 		m_SendSipKey (nullptr), m_ReceiveSipKey (nullptr),
 #if OPENSSL_SIPHASH
 		m_SendMDCtx(nullptr), m_ReceiveMDCtx (nullptr),
 #endif
-		m_NextReceivedLen (0), m_NextReceivedBuffer (nullptr), m_NextSendBuffer (nullptr),
-		m_ReceiveSequenceNumber (0), m_SendSequenceNumber (0), m_IsSending (false)
+		m_NextReceivedLen (0), m_ReceiveBufferStart (0), m_ReceiveBufferEnd (0), m_NextSendBuffer (nullptr),
+		m_ReceiveSequenceNumber (0), m_SendSequenceNumber (0), m_IsSending (false), m_IsCoalescing (false),
+		m_SendQueueSize (0), m_CoalesceTimer (m_Service)
 	{
 		if (in_RemoteRouter) // Alice
 		{
@@ -380,7 +386,6 @@ namespace transport
 
 	NTCP2Session::~NTCP2Session ()
 	{
-		delete[] m_NextReceivedBuffer;
 		delete[] m_NextSendBuffer;
 #if OPENSSL_SIPHASH
 		if (m_SendSipKey) EVP_PKEY_free (m_SendSipKey);
@@ -400,6 +405,8 @@ namespace transport
 			transports.PeerDisconnected (shared_from_this ());
 			m_Server.RemoveNTCP2Session (shared_from_this ());
 			m_SendQueue.clear ();
+			m_SendQueueSize = 0;
+			m_CoalesceTimer.cancel ();
 			LogPrint (eLogDebug, "NTCP2: session terminated");
 		}
 	}
@@ -411,7 +418,7 @@ namespace transport
 
 	void NTCP2Session::Done ()
 	{
-		m_Server.GetService ().post (std::bind (&NTCP2Session::Terminate, shared_from_this ()));
+		m_Service.post (std::bind (&NTCP2Session::Terminate, shared_from_this ()));
 	}
 
 	void NTCP2Session::Established ()
@@ -601,7 +608,7 @@ namespace transport
 		memcpy (m_ReceiveIV.buf, m_Sipkeysba + 16, 8);
 		memcpy (m_SendIV.buf, m_Sipkeysab + 16, 8);
 		Established ();
-		ReceiveLength ();
+		Receive ();
 
 		// TODO: remove
 		// m_SendQueue.push_back (CreateDeliveryStatusMsg (1));
@@ -702,7 +709,7 @@ namespace transport
 					SetRemoteIdentity (existing ? existing->GetRouterIdentity () : ri.GetRouterIdentity ());
 					m_Server.AddNTCP2Session (shared_from_this ());
 					Established ();
-					ReceiveLength ();
+					Receive ();
 				}
 				else
 					Terminate ();
@@ -747,92 +754,102 @@ namespace transport
 				std::placeholders::_1, std::placeholders::_2));
 	}
 
-	void NTCP2Session::ReceiveLength ()
+	void NTCP2Session::Receive ()
 	{
 		if (IsTerminated ()) return;
-		boost::asio::async_read (m_Socket, boost::asio::buffer(&m_NextReceivedLen, 2), boost::asio::transfer_all (),
-			std::bind(&NTCP2Session::HandleReceivedLength, shared_from_this (), std::placeholders::_1, std::placeholders::_2));
+		// move incomplete frame to the beginning and make sure it fits
+		if (m_ReceiveBufferStart)
+		{
+			m_ReceiveBufferEnd -= m_ReceiveBufferStart;
+			if (m_ReceiveBufferEnd)
+				memmove (m_ReceiveBuffer.data (), m_ReceiveBuffer.data () + m_ReceiveBufferStart, m_ReceiveBufferEnd);
+			m_ReceiveBufferStart = 0;
+		}
+		if (m_ReceiveBuffer.empty ()) m_ReceiveBuffer.resize (NTCP2_RECEIVE_BUFFER_SIZE);
+		if (m_NextReceivedLen > m_ReceiveBuffer.size ())
+			m_ReceiveBuffer.resize (m_NextReceivedLen);
+		m_Socket.async_read_some (boost::asio::buffer(m_ReceiveBuffer.data () + m_ReceiveBufferEnd, m_ReceiveBuffer.size () - m_ReceiveBufferEnd),
+			std::bind(&NTCP2Session::HandleReceived, shared_from_this (), std::placeholders::_1, std::placeholders::_2));
 	}
 
-	void NTCP2Session::HandleReceivedLength (const boost::system::error_code& ecode, std::size_t bytes_transferred)
+	void NTCP2Session::HandleReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred)
 	{
 		if (ecode)
 		{
 			if (ecode != boost::asio::error::operation_aborted)
-				LogPrint (eLogWarning, "NTCP2: receive length read error: ", ecode.message ());
+				LogPrint (eLogWarning, "NTCP2: receive read error: ", ecode.message ());
 			Terminate ();
+			return;
 		}
-		else
+		m_LastActivityTimestamp = i2p::util::GetSecondsSinceEpoch ();
+		m_NumReceivedBytes += bytes_transferred;
+		i2p::transport::transports.UpdateReceivedBytes (bytes_transferred);
+		m_ReceiveBufferEnd += bytes_transferred;
+		// collect all complete frames, decrypted later together with frames of other sessions
+		while (true)
 		{
+			size_t available = m_ReceiveBufferEnd - m_ReceiveBufferStart;
+			if (!m_NextReceivedLen)
+			{
+				if (available < 2) break;
 #if OPENSSL_SIPHASH
-			EVP_DigestSignInit (m_ReceiveMDCtx, nullptr, nullptr, nullptr, nullptr);
-			EVP_DigestSignUpdate (m_ReceiveMDCtx, m_ReceiveIV.buf, 8); 
-			size_t l = 8;    
-			EVP_DigestSignFinal (m_ReceiveMDCtx, m_ReceiveIV.buf, &l);   
+				EVP_DigestSignInit (m_ReceiveMDCtx, nullptr, nullptr, nullptr, nullptr);
+				EVP_DigestSignUpdate (m_ReceiveMDCtx, m_ReceiveIV.buf, 8);
+				size_t l = 8;
+				EVP_DigestSignFinal (m_ReceiveMDCtx, m_ReceiveIV.buf, &l);
 #else
-			i2p::crypto::Siphash<8> (m_ReceiveIV.buf, m_ReceiveIV.buf, 8, m_ReceiveSipKey);
+				i2p::crypto::Siphash<8> (m_ReceiveIV.buf, m_ReceiveIV.buf, 8, m_ReceiveSipKey);
 #endif
-			// m_NextReceivedLen comes from the network in BigEndian
-			m_NextReceivedLen = be16toh (m_NextReceivedLen) ^ le16toh (m_ReceiveIV.key);
-			LogPrint (eLogDebug, "NTCP2: received length ", m_NextReceivedLen);
-			if (m_NextReceivedLen >= 16)
-			{	
-				if (m_NextReceivedBuffer) delete[] m_NextReceivedBuffer;
-				m_NextReceivedBuffer = new uint8_t[m_NextReceivedLen];
-				boost::system::error_code ec;
-				size_t moreBytes = m_Socket.available(ec);
-				if (!ec && moreBytes >= m_NextReceivedLen)
+				// length comes from the network in BigEndian
+				m_NextReceivedLen = bufbe16toh (m_ReceiveBuffer.data () + m_ReceiveBufferStart) ^ le16toh (m_ReceiveIV.key);
+				LogPrint (eLogDebug, "NTCP2: received length ", m_NextReceivedLen);
+				if (m_NextReceivedLen < 16)
 				{
-					// read and process messsage immediately if avaliable
-					moreBytes = boost::asio::read (m_Socket, boost::asio::buffer(m_NextReceivedBuffer, m_NextReceivedLen), boost::asio::transfer_all (), ec);
-					HandleReceived (ec, moreBytes);
+					LogPrint (eLogError, "NTCP2: received length ", m_NextReceivedLen, " is too short");
+					Terminate ();
+					return;
 				}
-				else
-					Receive ();
+				m_ReceiveBufferStart += 2; available -= 2;
 			}
-			else
-			{
-				LogPrint (eLogError, "NTCP2: received length ", m_NextReceivedLen, " is too short");
-				Terminate ();
-			}	
+			if (available < m_NextReceivedLen) break;
+			i2p::crypto::AEADChaCha20Poly1305Frame frame;
+			frame.buf = m_ReceiveBuffer.data () + m_ReceiveBufferStart;
+			frame.len = m_NextReceivedLen - 16;
+			frame.key = m_ReceiveKey;
+			CreateNonce (m_ReceiveSequenceNumber, frame.nonce); m_ReceiveSequenceNumber++;
+			frame.result = false;
+			m_ReceivedFrames.push_back (frame);
+			m_ReceiveBufferStart += m_NextReceivedLen;
+			m_NextReceivedLen = 0;
 		}
+		if (m_ReceivedFrames.empty ())
+			Receive ();
+		else
+			m_Server.DecryptReceivedFrames (shared_from_this ()); // calls HandleReceivedFramesDecrypted
 	}
 
-	void NTCP2Session::Receive ()
+	void NTCP2Session::HandleReceivedFramesDecrypted ()
 	{
 		if (IsTerminated ()) return;
-		boost::asio::async_read (m_Socket, boost::asio::buffer(m_NextReceivedBuffer, m_NextReceivedLen), boost::asio::transfer_all (),
-			std::bind(&NTCP2Session::HandleReceived, shared_from_this (), std::placeholders::_1, std::placeholders::_2));
-	}
-
-	void NTCP2Session::HandleReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred)
-	{
-		if (ecode)
-		{
-			if (ecode != boost::asio::error::operation_aborted)
-				LogPrint (eLogWarning, "NTCP2: receive read error: ", ecode.message ());
-			Terminate ();
-		}
-		else
+		for (const auto& it: m_ReceivedFrames)
 		{
-			m_LastActivityTimestamp = i2p::util::GetSecondsSinceEpoch ();
-			m_NumReceivedBytes += bytes_transferred + 2; // + length
-			i2p::transport::transports.UpdateReceivedBytes (bytes_transferred);
-			uint8_t nonce[12];
-			CreateNonce (m_ReceiveSequenceNumber, nonce); m_ReceiveSequenceNumber++;
-			if (i2p::crypto::AEADChaCha20Poly1305 (m_NextReceivedBuffer, m_NextReceivedLen-16, nullptr, 0, m_ReceiveKey, nonce, m_NextReceivedBuffer, m_NextReceivedLen, false))
-			{	
-				LogPrint (eLogDebug, "NTCP2: received message decrypted");
-				ProcessNextFrame (m_NextReceivedBuffer, m_NextReceivedLen-16);
-				delete[] m_NextReceivedBuffer; m_NextReceivedBuffer = nullptr; // we don't need received buffer anymore
-				ReceiveLength ();
-			}
-			else
+			if (!it.result)
 			{
 				LogPrint (eLogWarning, "NTCP2: Received AEAD verification failed ");
+				m_ReceivedFrames.clear ();
 				SendTerminationAndTerminate (eNTCP2DataPhaseAEADFailure);
-			}	
+				return;
+			}
+			LogPrint (eLogDebug, "NTCP2: received message decrypted");
+			ProcessNextFrame (it.buf, it.len);
+			if (IsTerminated ())
+			{
+				m_ReceivedFrames.clear ();
+				return;
+			}
 		}
+		m_ReceivedFrames.clear ();
+		Receive ();
 	}
 
 	void NTCP2Session::ProcessNextFrame (const uint8_t * frame, size_t len)
@@ -978,6 +995,7 @@ namespace transport
 		CreateNonce (m_SendSequenceNumber, nonce); m_SendSequenceNumber++;
 		i2p::crypto::AEADChaCha20Poly1305Encrypt (encryptBufs, m_SendKey, nonce, macBuf); // encrypt buffers
 		SetNextSentFrameLength (totalLen + 16, first->GetNTCP2Header () - 5); // frame length right before first block
+		m_Server.UpdateSentFrameStats (msgs.size (), totalLen + 16 + 2);
 			
 		// send buffers
 		m_IsSending = true;	
@@ -1003,6 +1021,7 @@ namespace transport
 		CreateNonce (m_SendSequenceNumber, nonce); m_SendSequenceNumber++;
 		i2p::crypto::AEADChaCha20Poly1305Encrypt ({std::make_pair (m_NextSendBuffer + 2, payloadLen)}, m_SendKey, nonce, m_NextSendBuffer + payloadLen + 2);	
 		SetNextSentFrameLength (payloadLen + 16, m_NextSendBuffer);
+		m_Server.UpdateSentFrameStats (0, payloadLen + 16 + 2);
 		// send
 		m_IsSending = true;	
 		boost::asio::async_write (m_Socket, boost::asio::buffer (m_NextSendBuffer, payloadLen + 16 + 2), boost::asio::transfer_all (),
@@ -1043,11 +1062,13 @@ namespace transport
 					msgs.push_back (msg);
 					s += (len + 3);
 					m_SendQueue.pop_front ();
+					m_SendQueueSize -= len + 3;
 				}
 				else if (len + 3 > NTCP2_UNENCRYPTED_FRAME_MAX_SIZE)
 				{
 					LogPrint (eLogError, "NTCP2: I2NP message of size ", len, " can't be sent. Dropped");
 					m_SendQueue.pop_front ();
+					m_SendQueueSize -= len + 3;
 				}
 				else
 					break;
@@ -1106,21 +1127,47 @@ namespace transport
 	void NTCP2Session::SendTerminationAndTerminate (NTCP2TerminationReason reason)
 	{
 		SendTermination (reason);
-		m_Server.GetService ().post (std::bind (&NTCP2Session::Terminate, shared_from_this ())); // let termination message go
+		m_Service.post (std::bind (&NTCP2Session::Terminate, shared_from_this ())); // let termination message go
 	}
 
 	void NTCP2Session::SendI2NPMessages (const std::vector<std::shared_ptr<I2NPMessage> >& msgs)
 	{
-		m_Server.GetService ().post (std::bind (&NTCP2Session::PostI2NPMessages, shared_from_this (), msgs));
+		if (msgs.empty ()) return;
+		if (m_OutgoingQueue.Put (msgs)) // post once until the queue is drained
+			m_Service.post (std::bind (&NTCP2Session::PostI2NPMessages, shared_from_this ()));
 	}
 
-	void NTCP2Session::PostI2NPMessages (std::vector<std::shared_ptr<I2NPMessage> > msgs)
+	void NTCP2Session::PostI2NPMessages ()
 	{
+		std::vector<std::shared_ptr<I2NPMessage> > msgs;
+		m_OutgoingQueue.GetAll (msgs);
 		if (m_IsTerminated) return;
 		for (auto it: msgs)
+		{
 			m_SendQueue.push_back (it);
-		if (!m_IsSending) 
-			SendQueue ();	
+			m_SendQueueSize += it->GetNTCP2Length () + 3;
+		}
+		if (!m_IsSending)
+		{
+			auto interval = m_Server.GetCoalesceInterval ();
+			if (!interval || m_SendQueueSize >= NTCP2_TARGET_FRAME_SIZE)
+			{
+				if (m_IsCoalescing)
+				{
+					m_IsCoalescing = false;
+					m_CoalesceTimer.cancel ();
+				}
+				SendQueue ();
+			}
+			else if (!m_IsCoalescing)
+			{
+				// wait for more messages to fill the frame
+				m_IsCoalescing = true;
+				m_CoalesceTimer.expires_from_now (boost::posix_time::microseconds (interval));
+				m_CoalesceTimer.async_wait (std::bind (&NTCP2Session::HandleCoalesceTimer,
+					shared_from_this (), std::placeholders::_1));
+			}
+		}
 		else if (m_SendQueue.size () > NTCP2_MAX_OUTGOING_QUEUE_SIZE)
 		{
 			LogPrint (eLogWarning, "NTCP2: outgoing messages queue size exceeds ", NTCP2_MAX_OUTGOING_QUEUE_SIZE);
@@ -1128,16 +1175,34 @@ namespace transport
 		}	
 	}
 
+	void NTCP2Session::HandleCoalesceTimer (const boost::system::error_code& ecode)
+	{
+		if (ecode != boost::asio::error::operation_aborted && m_IsCoalescing)
+		{
+			m_IsCoalescing = false;
+			if (!m_IsSending && !m_IsTerminated)
+				SendQueue ();
+		}
+	}
+
 	void NTCP2Session::SendLocalRouterInfo ()
 	{
 		if (!IsOutgoing ()) // we send it in SessionConfirmed
-			m_Server.GetService ().post (std::bind (&NTCP2Session::SendRouterInfo, shared_from_this ()));
+			m_Service.post (std::bind (&NTCP2Session::SendRouterInfo, shared_from_this ()));
 	}
 
 	NTCP2Server::NTCP2Server ():
-		m_IsRunning (false), m_Thread (nullptr), m_Work (m_Service),
-		m_TerminationTimer (m_Service)
+		m_IsRunning (false), m_IsDecryptBatchSupported (false), m_CoalesceInterval (0),
+		m_NumSentFrames (0), m_NumSentMessages (0), m_NumSentFrameBytes (0)
 	{
+		i2p::config::GetOption ("ntcp2.coalesce", m_CoalesceInterval);
+		if (m_CoalesceInterval < 0) m_CoalesceInterval = 0;
+		int numThreads = 1;
+		i2p::config::GetOption ("ntcp2.threads", numThreads);
+		if (numThreads < 1) numThreads = 1;
+		if (numThreads > NTCP2_MAX_NUM_THREADS) numThreads = NTCP2_MAX_NUM_THREADS;
+		for (int i = 0; i < numThreads; i++)
+			m_Workers.emplace_back (new Worker ());
 	}
 
 	NTCP2Server::~NTCP2Server ()
@@ -1150,7 +1215,14 @@ namespace transport
 		if (!m_IsRunning)
 		{
 			m_IsRunning = true;
-			m_Thread = new std::thread (std::bind (&NTCP2Server::Run, this));
+			m_IsDecryptBatchSupported = i2p::crypto::IsAEADChaCha20Poly1305BatchSupported ();
+			for (auto& worker: m_Workers)
+				worker->thread = new std::thread (std::bind (&NTCP2Server::Run, this, worker.get ()));
+#ifdef SO_REUSEPORT
+			size_t numListeners = m_Workers.size (); // kernel distributes incoming connections
+#else
+			size_t numListeners = 1;
+#endif
 			auto& addresses = context.GetRouterInfo ().GetAddresses ();
 			for (const auto& address: addresses)
 			{
@@ -1159,41 +1231,48 @@ namespace transport
 				{
 					if (address->host.is_v4())
 					{
-						try
-						{
-							m_NTCP2Acceptor.reset (new boost::asio::ip::tcp::acceptor (m_Service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), address->port)));
-						} 
-						catch ( std::exception & ex ) 
+						for (size_t i = 0; i < numListeners; i++)
 						{
-							LogPrint(eLogError, "NTCP2: Failed to bind to ip4 port ",address->port, ex.what());
-							continue;
+							auto worker = m_Workers[i].get ();
+							try
+							{
+								worker->acceptor = CreateAcceptor (worker->service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), address->port));
+							}
+							catch ( std::exception & ex )
+							{
+								LogPrint(eLogError, "NTCP2: Failed to bind to ip4 port ",address->port, ex.what());
+								worker->acceptor = nullptr;
+								break;
+							}
+
+							if (!i) LogPrint (eLogInfo, "NTCP2: Start listening TCP port ", address->port);
+							auto conn = std::make_shared<NTCP2Session>(*this, nullptr, &worker->service);
+							worker->acceptor->async_accept(conn->GetSocket (), std::bind (&NTCP2Server::HandleAccept, this, worker, conn, std::placeholders::_1));
 						}
-
-						LogPrint (eLogInfo, "NTCP2: Start listening TCP port ", address->port);
-						auto conn = std::make_shared<NTCP2Session>(*this);
-						m_NTCP2Acceptor->async_accept(conn->GetSocket (), std::bind (&NTCP2Server::HandleAccept, this, conn, std::placeholders::_1));
 					}
 					else if (address->host.is_v6() && context.SupportsV6 ())
 					{
-						m_NTCP2V6Acceptor.reset (new boost::asio::ip::tcp::acceptor (m_Service));
-						try
+						for (size_t i = 0; i < numListeners; i++)
 						{
-							m_NTCP2V6Acceptor->open (boost::asio::ip::tcp::v6());
-							m_NTCP2V6Acceptor->set_option (boost::asio::ip::v6_only (true));
-							m_NTCP2V6Acceptor->bind (boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v6(), address->port));
-							m_NTCP2V6Acceptor->listen ();
-
-							LogPrint (eLogInfo, "NTCP2: Start listening V6 TCP port ", address->port);
-							auto conn = std::make_shared<NTCP2Session> (*this);
-							m_NTCP2V6Acceptor->async_accept(conn->GetSocket (), std::bind (&NTCP2Server::HandleAcceptV6, this, conn, std::placeholders::_1));
-						} catch ( std::exception & ex ) {
-							LogPrint(eLogError, "NTCP2: failed to bind to ip6 port ", address->port);
-							continue;
+							auto worker = m_Workers[i].get ();
+							try
+							{
+								worker->acceptorV6 = CreateAcceptor (worker->service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v6(), address->port));
+
+								if (!i) LogPrint (eLogInfo, "NTCP2: Start listening V6 TCP port ", address->port);
+								auto conn = std::make_shared<NTCP2Session> (*this, nullptr, &worker->service);
+								worker->acceptorV6->async_accept(conn->GetSocket (), std::bind (&NTCP2Server::HandleAcceptV6, this, worker, conn, std::placeholders::_1));
+							} catch ( std::exception & ex ) {
+								LogPrint(eLogError, "NTCP2: failed to bind to ip6 port ", address->port);
+								worker->acceptorV6 = nullptr;
+								break;
+							}
 						}
 					}
 				}
 			}
-			ScheduleTermination ();
+			for (auto& worker: m_Workers)
+				ScheduleTermination (worker.get ());
 		}
 	}
 
@@ -1201,35 +1280,44 @@ namespace transport
 	{
 		{
 			// we have to copy it because Terminate changes m_NTCP2Sessions
-			auto ntcpSessions = m_NTCP2Sessions;
+			auto ntcpSessions = GetNTCP2Sessions ();
 			for (auto& it: ntcpSessions)
 				it.second->Terminate ();
-			for (auto& it: m_PendingIncomingSessions)
-				it->Terminate ();
+			for (auto& worker: m_Workers)
+				for (auto& it: worker->pendingIncomingSessions)
+					it->Terminate ();
+		}
+		{
+			std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
+			m_NTCP2Sessions.clear ();
 		}
-		m_NTCP2Sessions.clear ();
 
 		if (m_IsRunning)
 		{
 			m_IsRunning = false;
-			m_TerminationTimer.cancel ();
-			m_Service.stop ();
-			if (m_Thread)
+			for (auto& worker: m_Workers)
 			{
-				m_Thread->join ();
-				delete m_Thread;
-				m_Thread = nullptr;
+				worker->terminationTimer.cancel ();
+				worker->service.stop ();
 			}
+			for (auto& worker: m_Workers)
+				if (worker->thread)
+				{
+					worker->thread->join ();
+					delete worker->thread;
+					worker->thread = nullptr;
+				}
 		}
 	}
 
-	void NTCP2Server::Run ()
+	void NTCP2Server::Run (Worker * worker)
 	{
+		i2p::util::SetThreadAffinity ("ntcp2");
 		while (m_IsRunning)
 		{
 			try
 			{
-				m_Service.run ();
+				worker->service.run ();
 			}
 			catch (std::exception& ex)
 			{
@@ -1238,29 +1326,51 @@ namespace transport
 		}
 	}
 
+	std::unique_ptr<boost::asio::ip::tcp::acceptor> NTCP2Server::CreateAcceptor (boost::asio::io_service& service, const boost::asio::ip::tcp::endpoint& ep)
+	{
+		std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor (new boost::asio::ip::tcp::acceptor (service));
+		acceptor->open (ep.protocol ());
+		if (ep.protocol () == boost::asio::ip::tcp::v6())
+			acceptor->set_option (boost::asio::ip::v6_only (true));
+		else
+			acceptor->set_option (boost::asio::ip::tcp::acceptor::reuse_address (true));
+#ifdef SO_REUSEPORT
+		if (m_Workers.size () > 1)
+			acceptor->set_option (boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> (true));
+#endif
+		acceptor->bind (ep);
+		acceptor->listen ();
+		return acceptor;
+	}
+
 	bool NTCP2Server::AddNTCP2Session (std::shared_ptr<NTCP2Session> session)
 	{
 		if (!session || !session->GetRemoteIdentity ()) return false;
 		auto& ident = session->GetRemoteIdentity ()->GetIdentHash ();
-		auto it = m_NTCP2Sessions.find (ident);
-		if (it != m_NTCP2Sessions.end ())
 		{
-			LogPrint (eLogWarning, "NTCP2: session to ", ident.ToBase64 (), " already exists");
-			session->Terminate();
-			return false;
+			std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
+			if (m_NTCP2Sessions.insert (std::make_pair (ident, session)).second)
+				return true;
 		}
-		m_NTCP2Sessions.insert (std::make_pair (ident, session));
-		return true;
+		LogPrint (eLogWarning, "NTCP2: session to ", ident.ToBase64 (), " already exists");
+		session->Terminate();
+		return false;
 	}
 
 	void NTCP2Server::RemoveNTCP2Session (std::shared_ptr<NTCP2Session> session)
 	{
 		if (session && session->GetRemoteIdentity ())
-			m_NTCP2Sessions.erase (session->GetRemoteIdentity ()->GetIdentHash ());
+		{
+			std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
+			auto it = m_NTCP2Sessions.find (session->GetRemoteIdentity ()->GetIdentHash ());
+			if (it != m_NTCP2Sessions.end () && it->second == session) // don't remove existing session to same router
+				m_NTCP2Sessions.erase (it);
+		}
 	}
 
 	std::shared_ptr<NTCP2Session> NTCP2Server::FindNTCP2Session (const i2p::data::IdentHash& ident)
 	{
+		std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
 		auto it = m_NTCP2Sessions.find (ident);
 		if (it != m_NTCP2Sessions.end ())
 			return it->second;
@@ -1270,15 +1380,15 @@ namespace transport
 	void NTCP2Server::Connect(const boost::asio::ip::address & address, uint16_t port, std::shared_ptr<NTCP2Session> conn)
 	{
 		LogPrint (eLogDebug, "NTCP2: Connecting to ", address ,":",  port);
-		m_Service.post([this, address, port, conn]() 
+		conn->GetService ().post([this, address, port, conn]()
 			{
 				if (this->AddNTCP2Session (conn))
 				{
-					auto timer = std::make_shared<boost::asio::deadline_timer>(m_Service);
+					auto timer = std::make_shared<boost::asio::deadline_timer>(conn->GetService ());
 					auto timeout = NTCP2_CONNECT_TIMEOUT * 5;
 					conn->SetTerminationTimeout(timeout * 2);
 					timer->expires_from_now (boost::posix_time::seconds(timeout));
-					timer->async_wait ([conn, timeout](const boost::system::error_code& ecode) 
+					timer->async_wait ([conn, timeout](const boost::system::error_code& ecode)
 					{
 						if (ecode != boost::asio::error::operation_aborted)
 						{
@@ -1309,7 +1419,44 @@ namespace transport
 		}
 	}
 
-	void NTCP2Server::HandleAccept (std::shared_ptr<NTCP2Session> conn, const boost::system::error_code& error)
+	void NTCP2Server::DecryptReceivedFrames (std::shared_ptr<NTCP2Session> session)
+	{
+		if (m_IsDecryptBatchSupported)
+		{
+			for (auto& worker: m_Workers)
+				if (&worker->service == &session->GetService ())
+				{
+					// collect sessions with frames received during this turn of worker's loop
+					if (worker->decryptSessions.empty ())
+						worker->service.post (std::bind (&NTCP2Server::HandleDecryptReceivedFrames, this, worker.get ()));
+					worker->decryptSessions.push_back (session);
+					return;
+				}
+		}
+		i2p::crypto::AEADChaCha20Poly1305Batch (session->GetReceivedFrames (), false);
+		session->HandleReceivedFramesDecrypted ();
+	}
+
+	void NTCP2Server::HandleDecryptReceivedFrames (Worker * worker)
+	{
+		auto& frames = worker->decryptFrames;
+		for (auto& it: worker->decryptSessions)
+		{
+			auto& sessionFrames = it->GetReceivedFrames ();
+			frames.insert (frames.end (), sessionFrames.begin (), sessionFrames.end ());
+		}
+		i2p::crypto::AEADChaCha20Poly1305Batch (frames, false);
+		auto frame = frames.begin ();
+		for (auto& it: worker->decryptSessions)
+			for (auto& f: it->GetReceivedFrames ())
+				f.result = (frame++)->result;
+		frames.clear ();
+		for (auto& it: worker->decryptSessions)
+			it->HandleReceivedFramesDecrypted (); // next read completes later, so no new sessions here
+		worker->decryptSessions.clear ();
+	}
+
+	void NTCP2Server::HandleAccept (Worker * worker, std::shared_ptr<NTCP2Session> conn, const boost::system::error_code& error)
 	{
 		if (!error)
 		{
@@ -1321,7 +1468,7 @@ namespace transport
 				if (conn)
 				{
 					conn->ServerLogin ();
-					m_PendingIncomingSessions.push_back (conn);
+					worker->pendingIncomingSessions.push_back (conn);
 				}
 			}
 			else
@@ -1330,13 +1477,13 @@ namespace transport
 
 		if (error != boost::asio::error::operation_aborted)
 		{
-			conn = std::make_shared<NTCP2Session> (*this);
-			m_NTCP2Acceptor->async_accept(conn->GetSocket (), std::bind (&NTCP2Server::HandleAccept, this,
-				conn, std::placeholders::_1));
+			conn = std::make_shared<NTCP2Session> (*this, nullptr, &worker->service);
+			worker->acceptor->async_accept(conn->GetSocket (), std::bind (&NTCP2Server::HandleAccept, this,
+				worker, conn, std::placeholders::_1));
 		}
 	}
 
-	void NTCP2Server::HandleAcceptV6 (std::shared_ptr<NTCP2Session> conn, const boost::system::error_code& error)
+	void NTCP2Server::HandleAcceptV6 (Worker * worker, std::shared_ptr<NTCP2Session> conn, const boost::system::error_code& error)
 	{
 		if (!error)
 		{
@@ -1348,7 +1495,7 @@ namespace transport
 				if (conn)
 				{
 					conn->ServerLogin ();
-					m_PendingIncomingSessions.push_back (conn);
+					worker->pendingIncomingSessions.push_back (conn);
 				}
 			}
 			else
@@ -1357,49 +1504,54 @@ namespace transport
 
 		if (error != boost::asio::error::operation_aborted)
 		{
-			conn = std::make_shared<NTCP2Session> (*this);
-			m_NTCP2V6Acceptor->async_accept(conn->GetSocket (), std::bind (&NTCP2Server::HandleAcceptV6, this,
-				conn, std::placeholders::_1));
+			conn = std::make_shared<NTCP2Session> (*this, nullptr, &worker->service);
+			worker->acceptorV6->async_accept(conn->GetSocket (), std::bind (&NTCP2Server::HandleAcceptV6, this,
+				worker, conn, std::placeholders::_1));
 		}
 	}
 
-	void NTCP2Server::ScheduleTermination ()
+	void NTCP2Server::ScheduleTermination (Worker * worker)
 	{
-		m_TerminationTimer.expires_from_now (boost::posix_time::seconds(NTCP2_TERMINATION_CHECK_TIMEOUT));
-		m_TerminationTimer.async_wait (std::bind (&NTCP2Server::HandleTerminationTimer,
-			this, std::placeholders::_1));
+		worker->terminationTimer.expires_from_now (boost::posix_time::seconds(NTCP2_TERMINATION_CHECK_TIMEOUT));
+		worker->terminationTimer.async_wait (std::bind (&NTCP2Server::HandleTerminationTimer,
+			this, worker, std::placeholders::_1));
 	}
 
-	void NTCP2Server::HandleTerminationTimer (const boost::system::error_code& ecode)
+	void NTCP2Server::HandleTerminationTimer (Worker * worker, const boost::system::error_code& ecode)
 	{
 		if (ecode != boost::asio::error::operation_aborted)
 		{
 			auto ts = i2p::util::GetSecondsSinceEpoch ();
-			// established
-			for (auto& it: m_NTCP2Sessions)
-				if (it.second->IsTerminationTimeoutExpired (ts))
-				{
-					auto session = it.second;
-					LogPrint (eLogDebug, "NTCP2: No activity for ", session->GetTerminationTimeout (), " seconds");
-					session->TerminateByTimeout (); // it doesn't change m_NTCP2Session right a way
-				}
+			// established, only sessions of this worker
+			std::vector<std::shared_ptr<NTCP2Session> > expiredSessions;
+			{
+				std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
+				for (auto& it: m_NTCP2Sessions)
+					if (&it.second->GetService () == &worker->service && it.second->IsTerminationTimeoutExpired (ts))
+						expiredSessions.push_back (it.second);
+			}
+			for (auto& session: expiredSessions)
+			{
+				LogPrint (eLogDebug, "NTCP2: No activity for ", session->GetTerminationTimeout (), " seconds");
+				session->TerminateByTimeout (); // it doesn't change m_NTCP2Session right a way
+			}
 			// pending
-			for (auto it = m_PendingIncomingSessions.begin (); it != m_PendingIncomingSessions.end ();)
+			auto& pendingIncomingSessions = worker->pendingIncomingSessions;
+			for (auto it = pendingIncomingSessions.begin (); it != pendingIncomingSessions.end ();)
 			{
 				if ((*it)->IsEstablished () || (*it)->IsTerminated ())
-					it = m_PendingIncomingSessions.erase (it); // established or terminated
+					it = pendingIncomingSessions.erase (it); // established or terminated
 				else if ((*it)->IsTerminationTimeoutExpired (ts))
 				{
 					(*it)->Terminate ();
-					it = m_PendingIncomingSessions.erase (it); // expired
+					it = pendingIncomingSessions.erase (it); // expired
 				}
 				else
 					it++;
 			}
 
-			ScheduleTermination ();
+			ScheduleTermination (worker);
 		}
 	}
 }
 }
-
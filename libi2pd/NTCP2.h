@@ -16,6 +16,9 @@
 #include <thread>
 #include <list>
 #include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
 #include <array>
 #include <openssl/bn.h>
 #include <openssl/evp.h>
@@ -40,6 +43,9 @@ namespace transport
 
 	const int NTCP2_CLOCK_SKEW = 60; // in seconds	
 	const int NTCP2_MAX_OUTGOING_QUEUE_SIZE = 500; // how many messages we can queue up
+	const int NTCP2_MAX_NUM_THREADS = 16;
+	const size_t NTCP2_RECEIVE_BUFFER_SIZE = 16384; // grows up to max frame size
+	const size_t NTCP2_TARGET_FRAME_SIZE = NTCP2_UNENCRYPTED_FRAME_MAX_SIZE*(100 - NTCP2_MAX_PADDING_RATIO)/100; // fills frame with max padding, send without waiting for coalescing window
 
 	enum NTCP2BlockType
 	{
@@ -81,7 +87,7 @@ namespace transport
 		NTCP2Establisher ();
 		~NTCP2Establisher ();
 		
-		const uint8_t * GetPub () const { return m_EphemeralKeys.GetPublicKey (); };
+		const uint8_t * GetPub () const { return m_EphemeralKeys->GetPublicKey (); };
 		const uint8_t * GetRemotePub () const { return m_RemoteEphemeralPublicKey; }; // Y for Alice and X for Bob
 		uint8_t * GetRemotePub () { return m_RemoteEphemeralPublicKey; }; // to set
 
@@ -112,7 +118,7 @@ namespace transport
 		bool ProcessSessionConfirmedMessagePart1 (const uint8_t * nonce);
 		bool ProcessSessionConfirmedMessagePart2 (const uint8_t * nonce, uint8_t * m3p2Buf);
 
-		i2p::crypto::X25519Keys m_EphemeralKeys;
+		std::shared_ptr<i2p::crypto::X25519Keys> m_EphemeralKeys; // pre-generated
 		uint8_t m_RemoteEphemeralPublicKey[32]; // x25519
 		uint8_t m_RemoteStaticKey[32], m_IV[16], m_H[32] /*h*/, m_CK[33] /*ck*/, m_K[32] /*k*/;
 		i2p::data::IdentHash m_RemoteIdentHash;
@@ -128,13 +134,15 @@ namespace transport
 	{
 		public:
 
-			NTCP2Session (NTCP2Server& server, std::shared_ptr<const i2p::data::RouterInfo> in_RemoteRouter = nullptr); 
+			NTCP2Session (NTCP2Server& server, std::shared_ptr<const i2p::data::RouterInfo> in_RemoteRouter = nullptr,
+				boost::asio::io_service * service = nullptr); // by remote ident if not specified
 			~NTCP2Session ();
 			void Terminate ();
 			void TerminateByTimeout ();
 			void Done ();
 
 			boost::asio::ip::tcp::socket& GetSocket () { return m_Socket; };
+			boost::asio::io_service& GetService () { return m_Service; };
 
 			bool IsEstablished () const { return m_IsEstablished; };
 			bool IsTerminated () const { return m_IsTerminated; };
@@ -145,6 +153,9 @@ namespace transport
 			void SendLocalRouterInfo (); // after handshake
 			void SendI2NPMessages (const std::vector<std::shared_ptr<I2NPMessage> >& msgs);
 
+			std::vector<i2p::crypto::AEADChaCha20Poly1305Frame>& GetReceivedFrames () { return m_ReceivedFrames; };
+			void HandleReceivedFramesDecrypted ();
+
 		private:
 
 			void Established ();
@@ -168,8 +179,6 @@ namespace transport
 			void HandleSessionConfirmedReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred);
 
 			// data
-			void ReceiveLength ();
-			void HandleReceivedLength (const boost::system::error_code& ecode, std::size_t bytes_transferred);
 			void Receive ();
 			void HandleReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred);
 			void ProcessNextFrame (const uint8_t * frame, size_t len);
@@ -184,11 +193,13 @@ namespace transport
 			void SendRouterInfo ();
 			void SendTermination (NTCP2TerminationReason reason);
 			void SendTerminationAndTerminate (NTCP2TerminationReason reason);
-			void PostI2NPMessages (std::vector<std::shared_ptr<I2NPMessage> > msgs);
+			void PostI2NPMessages ();
+			void HandleCoalesceTimer (const boost::system::error_code& ecode);
 
 		private:
 
 			NTCP2Server& m_Server;
+			boost::asio::io_service& m_Service;
 			boost::asio::ip::tcp::socket m_Socket;
 			bool m_IsEstablished, m_IsTerminated;
 
@@ -202,8 +213,11 @@ namespace transport
 #else
 			const uint8_t * m_SendSipKey, * m_ReceiveSipKey;
 #endif
-			uint16_t m_NextReceivedLen; 
-			uint8_t * m_NextReceivedBuffer, * m_NextSendBuffer;
+			uint16_t m_NextReceivedLen; // 0 if length of next frame is not decoded yet
+			std::vector<uint8_t> m_ReceiveBuffer; // many frames per read, decrypted in place
+			size_t m_ReceiveBufferStart, m_ReceiveBufferEnd; // received but not processed yet
+			std::vector<i2p::crypto::AEADChaCha20Poly1305Frame> m_ReceivedFrames; // in m_ReceiveBuffer, waiting for decryption
+			uint8_t * m_NextSendBuffer;
 			union
 			{
 				uint8_t buf[8];
@@ -213,12 +227,28 @@ namespace transport
 
 			i2p::I2NPMessagesHandler m_Handler;
 
-			bool m_IsSending;
+			bool m_IsSending, m_IsCoalescing;
 			std::list<std::shared_ptr<I2NPMessage> > m_SendQueue;
+			size_t m_SendQueueSize; // in bytes including block headers
+			boost::asio::deadline_timer m_CoalesceTimer;
 	};
 
 	class NTCP2Server
 	{
+		struct Worker // io_service with own thread, sessions are distributed across workers
+		{
+			Worker (): thread (nullptr), work (service), terminationTimer (service) {};
+
+			std::thread * thread;
+			boost::asio::io_service service;
+			boost::asio::io_service::work work;
+			boost::asio::deadline_timer terminationTimer;
+			std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor, acceptorV6; // sharded by SO_REUSEPORT
+			std::list<std::shared_ptr<NTCP2Session> > pendingIncomingSessions;
+			std::vector<std::shared_ptr<NTCP2Session> > decryptSessions; // received frames are decrypted in one batch
+			std::vector<i2p::crypto::AEADChaCha20Poly1305Frame> decryptFrames;
+		};
+
 		public:
 
 			NTCP2Server ();
@@ -231,37 +261,51 @@ namespace transport
 			void RemoveNTCP2Session (std::shared_ptr<NTCP2Session> session);
 			std::shared_ptr<NTCP2Session> FindNTCP2Session (const i2p::data::IdentHash& ident);
 
-			boost::asio::io_service& GetService () { return m_Service; };
-		
+			boost::asio::io_service& GetService () { return m_Workers[0]->service; };
+			boost::asio::io_service& GetService (const i2p::data::IdentHash& ident) { return m_Workers[ident.GetLL ()[0] % m_Workers.size ()]->service; };
+			int GetNumThreads () const { return m_Workers.size (); };
+			int GetCoalesceInterval () const { return m_CoalesceInterval; };
+			void UpdateSentFrameStats (size_t numMsgs, size_t frameLen)
+			{
+				m_NumSentFrames++; m_NumSentMessages += numMsgs; m_NumSentFrameBytes += frameLen;
+			};
+
 			void Connect(const boost::asio::ip::address & address, uint16_t port, std::shared_ptr<NTCP2Session> conn);
+			void DecryptReceivedFrames (std::shared_ptr<NTCP2Session> session);
 
 		private:
 
-			void Run ();
-			void HandleAccept (std::shared_ptr<NTCP2Session> conn, const boost::system::error_code& error);
-			void HandleAcceptV6 (std::shared_ptr<NTCP2Session> conn, const boost::system::error_code& error);
+			void Run (Worker * worker);
+			std::unique_ptr<boost::asio::ip::tcp::acceptor> CreateAcceptor (boost::asio::io_service& service, const boost::asio::ip::tcp::endpoint& ep);
+			void HandleAccept (Worker * worker, std::shared_ptr<NTCP2Session> conn, const boost::system::error_code& error);
+			void HandleAcceptV6 (Worker * worker, std::shared_ptr<NTCP2Session> conn, const boost::system::error_code& error);
 
 			void HandleConnect (const boost::system::error_code& ecode, std::shared_ptr<NTCP2Session> conn, std::shared_ptr<boost::asio::deadline_timer> timer);		
+			void HandleDecryptReceivedFrames (Worker * worker);
 
 			// timer
-			void ScheduleTermination ();
-			void HandleTerminationTimer (const boost::system::error_code& ecode);
+			void ScheduleTermination (Worker * worker);
+			void HandleTerminationTimer (Worker * worker, const boost::system::error_code& ecode);
 
 		private:
 
-			bool m_IsRunning;
-			std::thread * m_Thread;
-			boost::asio::io_service m_Service;
-			boost::asio::io_service::work m_Work;
-			boost::asio::deadline_timer m_TerminationTimer;
-			std::unique_ptr<boost::asio::ip::tcp::acceptor> m_NTCP2Acceptor, m_NTCP2V6Acceptor;
-			std::map<i2p::data::IdentHash, std::shared_ptr<NTCP2Session> > m_NTCP2Sessions; 
-			std::list<std::shared_ptr<NTCP2Session> > m_PendingIncomingSessions;
+			bool m_IsRunning, m_IsDecryptBatchSupported;
+			int m_CoalesceInterval; // in microseconds
+			std::vector<std::unique_ptr<Worker> > m_Workers;
+			mutable std::mutex m_NTCP2SessionsMutex;
+			std::map<i2p::data::IdentHash, std::shared_ptr<NTCP2Session> > m_NTCP2Sessions; // across all workers
+			std::atomic<uint64_t> m_NumSentFrames, m_NumSentMessages, m_NumSentFrameBytes;
 
 		public:
 
 			// for HTTP/I2PControl
-			const decltype(m_NTCP2Sessions)& GetNTCP2Sessions () const { return m_NTCP2Sessions; };
+			decltype(m_NTCP2Sessions) GetNTCP2Sessions () const
+			{
+				std::unique_lock<std::mutex> l(m_NTCP2SessionsMutex);
+				return m_NTCP2Sessions;
+			};
+			double GetFramesPerMessage () const { return m_NumSentMessages ? (double)m_NumSentFrames/m_NumSentMessages : 0; };
+			double GetBytesPerFrame () const { return m_NumSentFrames ? (double)m_NumSentFrameBytes/m_NumSentFrames : 0; };
 	};
 }
 }
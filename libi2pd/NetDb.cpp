@@ -1,6 +1,7 @@
 #include <string.h>
 #include <fstream>
 #include <vector>
+#include <atomic>
 #include <boost/asio.hpp>
 #include <stdexcept>
 
@@ -17,6 +18,7 @@
 #include "Garlic.h"
 #include "NetDb.hpp"
 #include "Config.h"
+#include "util.h"
 
 using namespace i2p::transport;
 
@@ -26,7 +28,7 @@ namespace data
 {
 	NetDb netdb;
 
-	NetDb::NetDb (): m_IsRunning (false), m_Thread (nullptr), m_Reseeder (nullptr), m_Storage("netDb", "r", "routerInfo-", "dat"), m_PersistProfiles (true), m_HiddenMode(false)
+	NetDb::NetDb (): m_IsRunning (false), m_Thread (nullptr), m_Reseeder (nullptr), m_PersistProfiles (true), m_HiddenMode(false)
 	{
 	}
 
@@ -38,8 +40,8 @@ namespace data
 
 	void NetDb::Start ()
 	{
-		m_Storage.SetPlace(i2p::fs::GetDataDir());
-		m_Storage.Init(i2p::data::GetBase64SubstitutionTable(), 64);
+		std::string storage; i2p::config::GetOption("persist.netdbstorage", storage);
+		m_Storage = OpenNetDbStorage (storage, i2p::fs::GetDataDir());
 		InitProfilesStorage ();
 		m_Families.LoadCertificates ();
 		Load ();
@@ -62,8 +64,8 @@ namespace data
 				for (auto& it: m_RouterInfos)
 					it.second->SaveProfile ();
 			DeleteObsoleteProfiles ();
-			m_RouterInfos.clear ();
-			m_Floodfills.clear ();
+			ClearRouterInfos ();
+			m_Floodfills.Clear ();
 			if (m_Thread)
 			{
 				m_IsRunning = false;
@@ -72,6 +74,7 @@ namespace data
 				delete m_Thread;
 				m_Thread = 0;
 			}
+			if (m_Storage) m_Storage->Close ();
 			m_LeaseSets.clear();
 			m_Requests.Stop ();
 		}
@@ -79,6 +82,7 @@ namespace data
 
 	void NetDb::Run ()
 	{
+		i2p::util::SetThreadAffinity ("netdb");
 		uint32_t lastSave = 0, lastPublish = 0, lastExploratory = 0, lastManageRequest = 0, lastDestinationCleanup = 0;
 		while (m_IsRunning)
 		{
@@ -207,7 +211,14 @@ namespace data
 		{
 			if (r->IsNewer (buf, len))
 			{
+				auto caps = r->GetCaps ();
 				r->Update (buf, len);
+				if (r->GetCaps () != caps)
+				{
+					std::unique_lock<std::mutex> l(m_RouterInfosMutex);
+					RemoveRandomRouter (ident);
+					InsertRandomRouter (r);
+				}
 				LogPrint (eLogInfo, "NetDb: RouterInfo updated: ", ident.ToBase64());
 				// TODO: check if floodfill has been changed
 			}
@@ -226,6 +237,7 @@ namespace data
 				{
 					std::unique_lock<std::mutex> l(m_RouterInfosMutex);
 					inserted = m_RouterInfos.insert ({r->GetIdentHash (), r}).second;
+					if (inserted) InsertRandomRouter (r);
 				}
 				if (inserted)
 				{
@@ -233,7 +245,7 @@ namespace data
 					if (r->IsFloodfill () && r->IsReachable ()) // floodfill must be reachable
 					{
 						std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-						m_Floodfills.push_back (r);
+						m_Floodfills.Insert (r);
 					}
 				}
 				else
@@ -396,26 +408,6 @@ namespace data
 		i2p::transport::transports.SendMessages(ih, requests);
 	}
 
-	bool NetDb::LoadRouterInfo (const std::string & path)
-	{
-		auto r = std::make_shared<RouterInfo>(path);
-		if (r->GetRouterIdentity () && !r->IsUnreachable () &&
-				(!r->UsesIntroducer () || m_LastLoad < r->GetTimestamp () + NETDB_INTRODUCEE_EXPIRATION_TIMEOUT*1000LL)) // 1 hour
-		{
-			r->DeleteBuffer ();
-			r->ClearProperties (); // properties are not used for regular routers
-			m_RouterInfos[r->GetIdentHash ()] = r;
-			if (r->IsFloodfill () && r->IsReachable ()) // floodfill must be reachable
-				m_Floodfills.push_back (r);
-		}
-		else
-		{
-			LogPrint(eLogWarning, "NetDb: RI from ", path, " is invalid. Delete");
-			i2p::fs::Remove(path);
-		}
-		return true;
-	}
-
 	void NetDb::VisitLeaseSets(LeaseSetVisitor v)
 	{
 		std::unique_lock<std::mutex> lock(m_LeaseSetsMutex);
@@ -425,10 +417,10 @@ namespace data
 
 	void NetDb::VisitStoredRouterInfos(RouterInfoVisitor v)
 	{
-		m_Storage.Iterate([v] (const std::string & filename) {
-        auto ri = std::make_shared<i2p::data::RouterInfo>(filename);
-				v(ri);
-		});
+		std::vector<std::shared_ptr<RouterInfo> > routers;
+		m_Storage->Load (routers);
+		for (const auto& ri: routers)
+			if (ri) v(ri);
 	}
 
 	void NetDb::VisitRouterInfos(RouterInfoVisitor v)
@@ -441,38 +433,13 @@ namespace data
 	size_t NetDb::VisitRandomRouterInfos(RouterInfoFilter filter, RouterInfoVisitor v, size_t n)
 	{
 		std::vector<std::shared_ptr<const RouterInfo> > found;
-		const size_t max_iters_per_cyle = 3;
-		size_t iters = max_iters_per_cyle;
-		while(n > 0)
 		{
 			std::unique_lock<std::mutex> lock(m_RouterInfosMutex);
-			uint32_t idx = rand () % m_RouterInfos.size ();
-			uint32_t i = 0;
-			for (const auto & it : m_RouterInfos) {
-				if(i >= idx) // are we at the random start point?
-				{
-					// yes, check if we want this one
-					if(filter(it.second))
-					{
-						// we have a match
-						--n;
-						found.push_back(it.second);
-						// reset max iterations per cycle
-						iters = max_iters_per_cyle;
-						break;
-					}
-				}
-				else // not there yet
-					++i;
-			}
-			// we have enough
-			if(n == 0) break;
-			--iters;
-			// have we tried enough this cycle ?
-			if(!iters) {
-				// yes let's try the next cycle
-				--n;
-				iters = max_iters_per_cyle;
+			for (size_t i = 0; i < n; i++)
+			{
+				auto r = m_RandomRouters.GetRandom (filter);
+				if (!r) break; // nothing matches
+				found.push_back (r);
 			}
 		}
 		// visit the ones we found
@@ -484,19 +451,63 @@ namespace data
 		return visited;
 	}
 
+	void NetDb::ClearRouterInfos ()
+	{
+		std::unique_lock<std::mutex> l(m_RouterInfosMutex);
+		m_RouterInfos.clear ();
+		m_RandomRouters.Clear ();
+		m_HighBandwidthRouters.Clear ();
+		m_IntroducerRouters.Clear ();
+		m_PeerTestRouters.Clear ();
+	}
+
+	void NetDb::InsertRandomRouter (std::shared_ptr<RouterInfo> r)
+	{
+		m_RandomRouters.Insert (r);
+		if (r->IsHidden ()) return;
+		if (r->IsHighBandwidth ()) m_HighBandwidthRouters.Insert (r);
+		if (r->IsIntroducer ()) m_IntroducerRouters.Insert (r);
+		if (r->IsPeerTesting ()) m_PeerTestRouters.Insert (r);
+	}
+
+	void NetDb::RemoveRandomRouter (const IdentHash& ident)
+	{
+		m_RandomRouters.Remove (ident);
+		m_HighBandwidthRouters.Remove (ident);
+		m_IntroducerRouters.Remove (ident);
+		m_PeerTestRouters.Remove (ident);
+	}
+
 	void NetDb::Load ()
 	{
 		// make sure we cleanup netDb from previous attempts
-		m_RouterInfos.clear ();
-		m_Floodfills.clear ();
+		ClearRouterInfos ();
+		m_Floodfills.Clear ();
 
+		auto start = i2p::util::GetMillisecondsSinceEpoch ();
 		m_LastLoad = i2p::util::GetSecondsSinceEpoch();
-		std::vector<std::string> files;
-		m_Storage.Traverse(files);
-		for (const auto& path : files)
-			LoadRouterInfo(path);
-
-		LogPrint (eLogInfo, "NetDb: ", m_RouterInfos.size(), " routers loaded (", m_Floodfills.size (), " floodfils)");
+		std::vector<std::shared_ptr<RouterInfo> > routers;
+		m_Storage->Load (routers); // on multiple threads
+		int numUnverifiedFamilies = 0;
+		for (const auto& r: routers)
+		{
+			if (!r) continue;
+			if (r->UsesIntroducer () && m_LastLoad >= r->GetTimestamp () + NETDB_INTRODUCEE_EXPIRATION_TIMEOUT*1000LL) // 1 hour
+			{
+				LogPrint(eLogWarning, "NetDb: RI ", r->GetIdentHashBase64 (), " is expired. Delete");
+				m_Storage->Remove (r->GetIdentHash ());
+				continue;
+			}
+			r->DeleteBuffer ();
+			m_RouterInfos[r->GetIdentHash ()] = r;
+			InsertRandomRouter (r);
+			if (r->IsFloodfill () && r->IsReachable ()) // floodfill must be reachable
+				m_Floodfills.Insert (r);
+			if (r->IsFamilyUnverified ()) numUnverifiedFamilies++;
+		}
+		m_Storage->Flush ();
+		LogPrint (eLogInfo, "NetDb: ", m_RouterInfos.size(), " routers loaded (", m_Floodfills.GetSize (), " floodfils) in ",
+			i2p::util::GetMillisecondsSinceEpoch () - start, " ms, ", numUnverifiedFamilies, " family signatures to verify on first use");
 	}
 
 	void NetDb::SaveUpdated ()
@@ -513,11 +524,12 @@ namespace data
 
 		for (auto& it: m_RouterInfos)
 		{
-			std::string ident = it.second->GetIdentHashBase64();
-			std::string path  = m_Storage.Path(ident);
 			if (it.second->IsUpdated ())
 			{
-				it.second->SaveToFile (path);
+				if (it.second->GetBuffer ())
+					m_Storage->Save (it.first, it.second->GetBuffer (), it.second->GetBufferLen ());
+				else
+					LogPrint (eLogError, "NetDb: Can't save ", it.second->GetIdentHashBase64 (), ", buffer is empty");
 				it.second->SetUpdated (false);
 				it.second->SetUnreachable (false);
 				it.second->DeleteBuffer ();
@@ -536,8 +548,8 @@ namespace data
 
 			if (it.second->IsUnreachable ())
 			{
-				// delete RI file
-				m_Storage.Remove(ident);
+				// delete stored RI
+				m_Storage->Remove (it.first);
 				deletedCount++;
 				if (total - deletedCount < NETDB_MIN_ROUTERS) checkForExpiration = false;
 			}
@@ -550,28 +562,36 @@ namespace data
 			LogPrint (eLogInfo, "NetDb: deleting ", deletedCount, " unreachable routers");
 			// clean up RouterInfos table
 			{
+				std::set<IdentHash> erased;
 				std::unique_lock<std::mutex> l(m_RouterInfosMutex);
 				for (auto it = m_RouterInfos.begin (); it != m_RouterInfos.end ();)
 				{
 					if (it->second->IsUnreachable ())
 					{
 						if (m_PersistProfiles) it->second->SaveProfile ();
+						erased.insert (it->first);
 						it = m_RouterInfos.erase (it);
 						continue;
 					}
 					++it;
 				}
+				// unreachable flag might change meanwhile, random sets must match m_RouterInfos
+				auto isErased = [&erased](const std::shared_ptr<RouterInfo>& r)->bool { return erased.count (r->GetIdentHash ()) > 0; };
+				m_RandomRouters.Cleanup (isErased);
+				m_HighBandwidthRouters.Cleanup (isErased);
+				m_IntroducerRouters.Cleanup (isErased);
+				m_PeerTestRouters.Cleanup (isErased);
 			}
 			// clean up expired floodfiils
 			{
 				std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-				for (auto it = m_Floodfills.begin (); it != m_Floodfills.end ();)
-					if ((*it)->IsUnreachable ())
-						it = m_Floodfills.erase (it);
-					else
-						++it;
+				m_Floodfills.Cleanup ([](const std::shared_ptr<RouterInfo>& r)->bool
+					{
+						return r->IsUnreachable ();
+					});
 			}
 		}
+		m_Storage->Flush ();
 	}
 
 	void NetDb::RequestDestination (const IdentHash& destination, RequestedDestination::RequestComplete requestComplete)
@@ -870,7 +890,7 @@ namespace data
 				if (router)
 				{
 					LogPrint (eLogDebug, "NetDb: requested RouterInfo ", key, " found");
-					router->LoadBuffer ();
+					router->LoadBuffer (*m_Storage);
 					if (router->GetBuffer ())
 						replyMsg = CreateDatabaseStoreMsg (router);
 				}
@@ -1029,8 +1049,8 @@ namespace data
 
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter () const
 	{
-		return GetRandomRouter (
-			[](std::shared_ptr<const RouterInfo> router)->bool
+		return GetRandomRouter (m_RandomRouters,
+			[](const std::shared_ptr<RouterInfo>& router)->bool
 			{
 				return !router->IsHidden ();
 			});
@@ -1038,8 +1058,8 @@ namespace data
 
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter (std::shared_ptr<const RouterInfo> compatibleWith) const
 	{
-		return GetRandomRouter (
-			[compatibleWith](std::shared_ptr<const RouterInfo> router)->bool
+		return GetRandomRouter (m_RandomRouters,
+			[compatibleWith](const std::shared_ptr<RouterInfo>& router)->bool
 			{
 				return !router->IsHidden () && router != compatibleWith &&
 					router->IsCompatible (*compatibleWith);
@@ -1048,8 +1068,8 @@ namespace data
 
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomPeerTestRouter (bool v4only) const
 	{
-		return GetRandomRouter (
-			[v4only](std::shared_ptr<const RouterInfo> router)->bool
+		return GetRandomRouter (m_PeerTestRouters,
+			[v4only](const std::shared_ptr<RouterInfo>& router)->bool
 			{
 				return !router->IsHidden () && router->IsPeerTesting () && router->IsSSU (v4only);
 			});
@@ -1057,8 +1077,8 @@ namespace data
 
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomIntroducer () const
 	{
-		return GetRandomRouter (
-			[](std::shared_ptr<const RouterInfo> router)->bool
+		return GetRandomRouter (m_IntroducerRouters,
+			[](const std::shared_ptr<RouterInfo>& router)->bool
 			{
 				return !router->IsHidden () && router->IsIntroducer ();
 			});
@@ -1066,8 +1086,8 @@ namespace data
 
 	std::shared_ptr<const RouterInfo> NetDb::GetHighBandwidthRandomRouter (std::shared_ptr<const RouterInfo> compatibleWith) const
 	{
-		return GetRandomRouter (
-			[compatibleWith](std::shared_ptr<const RouterInfo> router)->bool
+		return GetRandomRouter (m_HighBandwidthRouters,
+			[compatibleWith](const std::shared_ptr<RouterInfo>& router)->bool
 			{
 				return !router->IsHidden () && router != compatibleWith &&
 					router->IsCompatible (*compatibleWith) &&
@@ -1076,29 +1096,13 @@ namespace data
 	}
 
 	template<typename Filter>
-	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter (Filter filter) const
+	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter (const RandomRouterSet& routers, Filter filter) const
 	{
-		if (m_RouterInfos.empty())
-			return 0;
-		uint32_t ind = rand () % m_RouterInfos.size ();
-		for (int j = 0; j < 2; j++)
-		{
-			uint32_t i = 0;
-			std::unique_lock<std::mutex> l(m_RouterInfosMutex);
-			for (const auto& it: m_RouterInfos)
+		std::unique_lock<std::mutex> l(m_RouterInfosMutex);
+		return routers.GetRandom ([&filter](const std::shared_ptr<RouterInfo>& r)->bool
 			{
-				if (i >= ind)
-				{
-					if (!it.second->IsUnreachable () && filter (it.second))
-						return it.second;
-				}
-				else
-					i++;
-			}
-			// we couldn't find anything, try second pass
-			ind = 0;
-		}
-		return nullptr; // seems we have too few routers
+				return !r->IsUnreachable () && filter (r);
+			});
 	}
 
 	void NetDb::PostI2NPMsg (std::shared_ptr<const I2NPMessage> msg)
@@ -1110,83 +1114,46 @@ namespace data
 		const std::set<IdentHash>& excluded, bool closeThanUsOnly) const
 	{
 		std::shared_ptr<const RouterInfo> r;
-		XORMetric minMetric;
 		IdentHash destKey = CreateRoutingKey (destination);
-		if (closeThanUsOnly)
-			minMetric = destKey ^ i2p::context.GetIdentHash ();
-		else
-			minMetric.SetMax ();
-		std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-		for (const auto& it: m_Floodfills)
 		{
-			if (!it->IsUnreachable ())
-			{
-				XORMetric m = destKey ^ it->GetIdentHash ();
-				if (m < minMetric && !excluded.count (it->GetIdentHash ()))
+			std::unique_lock<std::mutex> l(m_FloodfillsMutex);
+			r = m_Floodfills.FindClosest (destKey, [&excluded](const std::shared_ptr<RouterInfo>& ff)->bool
 				{
-					minMetric = m;
-					r = it;
-				}
-			}
+					return !ff->IsUnreachable () && !excluded.count (ff->GetIdentHash ());
+				});
 		}
+		if (r && closeThanUsOnly && !((destKey ^ r->GetIdentHash ()) < (destKey ^ i2p::context.GetIdentHash ())))
+			r = nullptr; // closest is not closer than us
 		return r;
 	}
 
 	std::vector<IdentHash> NetDb::GetClosestFloodfills (const IdentHash& destination, size_t num,
 		std::set<IdentHash>& excluded, bool closeThanUsOnly) const
 	{
-		struct Sorted
-		{
-			std::shared_ptr<const RouterInfo> r;
-			XORMetric metric;
-			bool operator< (const Sorted& other) const { return metric < other.metric; };
-		};
-
-		std::set<Sorted> sorted;
+		std::vector<std::shared_ptr<RouterInfo> > closest;
 		IdentHash destKey = CreateRoutingKey (destination);
-		XORMetric ourMetric;
-		if (closeThanUsOnly) ourMetric = destKey ^ i2p::context.GetIdentHash ();
 		{
 			std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-			for (const auto& it: m_Floodfills)
-			{
-				if (!it->IsUnreachable ())
+			m_Floodfills.FindClosest (destKey, num, [&excluded](const std::shared_ptr<RouterInfo>& ff)->bool
 				{
-					XORMetric m = destKey ^ it->GetIdentHash ();
-					if (closeThanUsOnly && ourMetric < m) continue;
-					if (sorted.size () < num)
-						sorted.insert ({it, m});
-					else if (m < sorted.rbegin ()->metric)
-					{
-						sorted.insert ({it, m});
-						sorted.erase (std::prev (sorted.end ()));
-					}
-				}
-			}
+					return !ff->IsUnreachable () && !excluded.count (ff->GetIdentHash ());
+				}, closest);
 		}
 
 		std::vector<IdentHash> res;
-		size_t i = 0;
-		for (const auto& it: sorted)
+		XORMetric ourMetric;
+		if (closeThanUsOnly) ourMetric = destKey ^ i2p::context.GetIdentHash ();
+		for (const auto& it: closest) // sorted by distance
 		{
-			if (i < num)
-			{
-				const auto& ident = it.r->GetIdentHash ();
-				if (!excluded.count (ident))
-				{
-					res.push_back (ident);
-					i++;
-				}
-			}
-			else
-				break;
+			if (closeThanUsOnly && ourMetric < (destKey ^ it->GetIdentHash ())) break;
+			res.push_back (it->GetIdentHash ());
 		}
 		return res;
 	}
 
   std::shared_ptr<const RouterInfo> NetDb::GetRandomRouterInFamily(const std::string & fam) const {
-    return GetRandomRouter(
-      [fam](std::shared_ptr<const RouterInfo> router)->bool
+    return GetRandomRouter(m_RandomRouters,
+      [&fam](const std::shared_ptr<RouterInfo>& router)->bool
       {
         return router->IsFamily(fam);
       });
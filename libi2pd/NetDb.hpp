@@ -2,9 +2,12 @@
 #define NETDB_H__
 // this file is called NetDb.hpp to resolve conflict with libc's netdb.h on case insensitive fs
 #include <inttypes.h>
+#include <stdlib.h>
 #include <set>
 #include <map>
 #include <list>
+#include <vector>
+#include <algorithm>
 #include <string>
 #include <thread>
 #include <mutex>
@@ -21,6 +24,8 @@
 #include "Reseed.h"
 #include "NetDbRequests.h"
 #include "Family.h"
+#include "KadDHT.h"
+#include "NetDbStorage.h"
 
 namespace i2p
 {
@@ -32,6 +37,7 @@ namespace data
 	const int NETDB_MIN_EXPIRATION_TIMEOUT = 90*60; // 1.5 hours
 	const int NETDB_MAX_EXPIRATION_TIMEOUT = 27*60*60; // 27 hours
 	const int NETDB_PUBLISH_INTERVAL = 60*40;
+	const int NETDB_MAX_RANDOM_ROUTER_ATTEMPTS = 16; // random picks before scan
 
 	/** function for visiting a leaseset stored in a floodfill */
 	typedef std::function<void(const IdentHash, std::shared_ptr<LeaseSet>)> LeaseSetVisitor;
@@ -42,6 +48,58 @@ namespace data
 	/** function for visiting a router info and determining if we want to use it */
 	typedef std::function<bool(std::shared_ptr<const i2p::data::RouterInfo>)> RouterInfoFilter;
 
+	// routers with same caps for O(1) random selection, must be accessed under m_RouterInfosMutex
+	class RandomRouterSet
+	{
+		public:
+
+			size_t GetSize () const { return m_Routers.size (); };
+			void Clear () { m_Routers.clear (); };
+			void Insert (std::shared_ptr<RouterInfo> r) { m_Routers.push_back (r); }; // must not be in set already
+
+			bool Remove (const IdentHash& ident) // O(n), caps change only
+			{
+				for (auto& it: m_Routers)
+					if (it->GetIdentHash () == ident)
+					{
+						it = m_Routers.back ();
+						m_Routers.pop_back ();
+						return true;
+					}
+				return false;
+			}
+
+			template<typename Filter>
+			void Cleanup (Filter filter) // remove routers for which filter (r) returns true
+			{
+				m_Routers.erase (std::remove_if (m_Routers.begin (), m_Routers.end (), filter), m_Routers.end ());
+			}
+
+			template<typename Filter>
+			std::shared_ptr<RouterInfo> GetRandom (Filter filter) const
+			{
+				size_t size = m_Routers.size ();
+				if (!size) return nullptr;
+				// most of routers pass filter, otherwise scan from random position
+				for (int i = 0; i < NETDB_MAX_RANDOM_ROUTER_ATTEMPTS; i++)
+				{
+					const auto& r = m_Routers[rand () % size];
+					if (filter (r)) return r;
+				}
+				size_t ind = rand () % size;
+				for (size_t i = 0; i < size; i++)
+				{
+					const auto& r = m_Routers[(ind + i) % size];
+					if (filter (r)) return r;
+				}
+				return nullptr;
+			}
+
+		private:
+
+			std::vector<std::shared_ptr<RouterInfo> > m_Routers;
+	};
+
 	class NetDb
 	{
 		public:
@@ -90,7 +148,7 @@ namespace data
 
 			// for web interface
 			int GetNumRouters () const { return m_RouterInfos.size (); };
-			int GetNumFloodfills () const { return m_Floodfills.size (); };
+			int GetNumFloodfills () const { return m_Floodfills.GetSize (); };
 			int GetNumLeaseSets () const { return m_LeaseSets.size (); };
 
 			/** visit all lease sets we currently store */
@@ -102,12 +160,11 @@ namespace data
 			/** visit N random router that match using filter, then visit them with a visitor, return number of RouterInfos that were visited */
 			size_t VisitRandomRouterInfos(RouterInfoFilter f, RouterInfoVisitor v, size_t n);
 
-			void ClearRouterInfos () { m_RouterInfos.clear (); };
+			void ClearRouterInfos ();
 
 		private:
 
 			void Load ();
-			bool LoadRouterInfo (const std::string & path);
 			void SaveUpdated ();
 			void Run (); // exploratory thread
 			void Explore (int numDestinations);
@@ -120,8 +177,10 @@ namespace data
 
 			std::shared_ptr<const RouterInfo> AddRouterInfo (const uint8_t * buf, int len, bool& updated);
 			std::shared_ptr<const RouterInfo> AddRouterInfo (const IdentHash& ident, const uint8_t * buf, int len, bool& updated);
+			void InsertRandomRouter (std::shared_ptr<RouterInfo> r); // to random router sets by caps
+			void RemoveRandomRouter (const IdentHash& ident); // from all random router sets
     		template<typename Filter>
-        	std::shared_ptr<const RouterInfo> GetRandomRouter (Filter filter) const;
+        	std::shared_ptr<const RouterInfo> GetRandomRouter (const RandomRouterSet& routers, Filter filter) const;
 
 		private:
 
@@ -129,8 +188,9 @@ namespace data
 			std::map<IdentHash, std::shared_ptr<LeaseSet> > m_LeaseSets;
 			mutable std::mutex m_RouterInfosMutex;
 			std::map<IdentHash, std::shared_ptr<RouterInfo> > m_RouterInfos;
+			RandomRouterSet m_RandomRouters, m_HighBandwidthRouters, m_IntroducerRouters, m_PeerTestRouters; // under m_RouterInfosMutex
 			mutable std::mutex m_FloodfillsMutex;
-			std::list<std::shared_ptr<RouterInfo> > m_Floodfills;
+			DHTTable<RouterInfo> m_Floodfills;
 
 			bool m_IsRunning;
 			uint64_t m_LastLoad;
@@ -140,7 +200,7 @@ namespace data
 			GzipInflator m_Inflator;
 			Reseeder * m_Reseeder;
 			Families m_Families;
-			i2p::fs::HashedStorage m_Storage;
+			std::unique_ptr<NetDbStorage> m_Storage;
 
 			friend class NetDbRequests;
 			NetDbRequests m_Requests;
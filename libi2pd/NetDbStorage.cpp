@@ -0,0 +1,488 @@
+#include <string.h>
+#include <thread>
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include "I2PEndian.h"
+#include "Base.h"
+#include "Log.h"
+#include "Timestamp.h"
+#include "NetDbStorage.h"
+
+namespace i2p
+{
+namespace data
+{
+	void NetDbStorage::CreateRouterInfos (size_t num, std::function<std::shared_ptr<RouterInfo>(size_t)> create,
+		std::vector<std::shared_ptr<RouterInfo> >& routers)
+	{
+		// RIs are independent, stored RIs were verified before saving
+		size_t numThreads = std::thread::hardware_concurrency ();
+		if (numThreads > NETDB_MAX_NUM_LOAD_THREADS) numThreads = NETDB_MAX_NUM_LOAD_THREADS;
+		if (numThreads*NETDB_MIN_NUM_RECORDS_PER_LOAD_THREAD > num)
+			numThreads = num/NETDB_MIN_NUM_RECORDS_PER_LOAD_THREAD;
+		if (numThreads < 1) numThreads = 1;
+		routers.resize (num);
+		std::atomic<size_t> next (0);
+		auto load = [num, &create, &routers, &next]()
+			{
+				for (size_t i = next++; i < num; i = next++)
+				{
+					auto r = create (i);
+					if (r && !r->IsUnreachable ()) routers[i] = r;
+				}
+			};
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < numThreads; i++)
+			threads.emplace_back (load);
+		load ();
+		for (auto& it: threads) it.join ();
+		LogPrint (eLogDebug, "NetDb: ", num, " stored RIs parsed by ", numThreads, " threads");
+	}
+
+	NetDbFilesStorage::NetDbFilesStorage (const std::string& place):
+		m_Storage ("netDb", "r", "routerInfo-", "dat")
+	{
+		m_Storage.SetPlace (place);
+	}
+
+	bool NetDbFilesStorage::IsEmpty () const
+	{
+		if (!boost::filesystem::exists (m_Storage.GetRoot ())) return true;
+		for (boost::filesystem::recursive_directory_iterator it (m_Storage.GetRoot ()), end; it != end; it++)
+			if (boost::filesystem::is_regular_file (it->status ())) return false;
+		return true;
+	}
+
+	bool NetDbFilesStorage::Init ()
+	{
+		return m_Storage.Init (GetBase64SubstitutionTable (), 64);
+	}
+
+	void NetDbFilesStorage::Load (std::vector<std::shared_ptr<RouterInfo> >& routers)
+	{
+		std::vector<std::string> files;
+		m_Storage.Traverse (files);
+		CreateRouterInfos (files.size (), [&files](size_t i)
+			{
+				return std::make_shared<RouterInfo>(files[i]);
+			}, routers);
+		for (size_t i = 0; i < files.size (); i++)
+			if (!routers[i])
+			{
+				LogPrint (eLogWarning, "NetDb: RI from ", files[i], " is invalid. Delete");
+				i2p::fs::Remove (files[i]);
+			}
+	}
+
+	bool NetDbFilesStorage::Save (const IdentHash& ident, const uint8_t * buf, size_t len)
+	{
+		auto path = m_Storage.Path (ident.ToBase64 ());
+		std::ofstream f (path, std::ofstream::binary | std::ofstream::out);
+		if (!f.is_open ())
+		{
+			LogPrint (eLogError, "NetDb: Can't save to ", path);
+			return false;
+		}
+		f.write ((const char *)buf, len);
+		return true;
+	}
+
+	void NetDbFilesStorage::Remove (const IdentHash& ident)
+	{
+		m_Storage.Remove (ident.ToBase64 ());
+	}
+
+	size_t NetDbFilesStorage::Read (const IdentHash& ident, uint8_t * buf, size_t len)
+	{
+		std::ifstream f (m_Storage.Path (ident.ToBase64 ()), std::ifstream::binary);
+		if (!f.is_open ()) return 0;
+		f.seekg (0, std::ios::end);
+		size_t l = f.tellg ();
+		if (l > len) return 0;
+		f.seekg (0, std::ios::beg);
+		f.read ((char *)buf, l);
+		return f ? l : 0;
+	}
+
+	void NetDbFilesStorage::Clear ()
+	{
+		std::vector<std::string> files;
+		m_Storage.Traverse (files);
+		for (const auto& it: files)
+			i2p::fs::Remove (it);
+	}
+
+	NetDbLogStorage::NetDbLogStorage (const std::string& place):
+		m_Path (place + i2p::fs::dirSep + NETDB_LOG_FILENAME),
+		m_IndexPath (place + i2p::fs::dirSep + NETDB_LOG_INDEX_FILENAME),
+		m_Size (0), m_LiveSize (0), m_IndexedSize (0), m_NextCompactionTime (0)
+	{
+	}
+
+	NetDbLogStorage::~NetDbLogStorage ()
+	{
+		Close ();
+	}
+
+	bool NetDbLogStorage::IsEmpty () const
+	{
+		return !boost::filesystem::exists (m_Path) ||
+			boost::filesystem::file_size (m_Path) <= sizeof (NETDB_LOG_MAGIC);
+	}
+
+	bool NetDbLogStorage::Init ()
+	{
+		m_Index.clear ();
+		m_LiveSize = 0;
+		m_Size = 0;
+		if (boost::filesystem::exists (m_Path))
+		{
+			std::ifstream f (m_Path, std::ifstream::binary);
+			char magic[sizeof (NETDB_LOG_MAGIC)];
+			if (f.read (magic, sizeof (magic)) && !memcmp (magic, NETDB_LOG_MAGIC, sizeof (magic)))
+			{
+				m_Size = boost::filesystem::file_size (m_Path);
+				auto offset = LoadIndex ();
+				if (!offset) offset = sizeof (NETDB_LOG_MAGIC);
+				auto end = Scan (f, offset);
+				if (end < m_Size)
+				{
+					LogPrint (eLogWarning, "NetDb: ", m_Path, " is truncated from ", m_Size, " to ", end, " bytes");
+					f.close ();
+					boost::filesystem::resize_file (m_Path, end);
+					m_Size = end;
+				}
+			}
+			else
+				LogPrint (eLogError, "NetDb: ", m_Path, " is malformed. Recreate");
+		}
+		if (!m_Size)
+		{
+			std::ofstream f (m_Path, std::ofstream::binary | std::ofstream::trunc);
+			f.write (NETDB_LOG_MAGIC, sizeof (NETDB_LOG_MAGIC));
+			if (!f)
+			{
+				LogPrint (eLogError, "NetDb: Can't create ", m_Path);
+				return false;
+			}
+			m_Size = sizeof (NETDB_LOG_MAGIC);
+			m_IndexedSize = 0;
+		}
+		m_File.open (m_Path, std::fstream::binary | std::fstream::in | std::fstream::out);
+		if (!m_File.is_open ())
+		{
+			LogPrint (eLogError, "NetDb: Can't open ", m_Path);
+			return false;
+		}
+		LogPrint (eLogInfo, "NetDb: ", m_Index.size (), " RIs in ", m_Path, ", ", m_Size, " bytes, ", GetGarbageSize (), " garbage");
+		return true;
+	}
+
+	void NetDbLogStorage::Close ()
+	{
+		if (m_File.is_open ())
+		{
+			m_File.flush ();
+			if (m_IndexedSize != m_Size) SaveIndex ();
+			m_File.close ();
+		}
+	}
+
+	uint64_t NetDbLogStorage::LoadIndex ()
+	{
+		// magic, size of log covered, number of entries, entries of ident, offset (8), length (2)
+		std::ifstream f (m_IndexPath, std::ifstream::binary);
+		if (!f.is_open ()) return 0;
+		char magic[sizeof (NETDB_LOG_MAGIC)];
+		uint8_t buf[42];
+		if (!f.read (magic, sizeof (magic)) || memcmp (magic, NETDB_LOG_MAGIC, sizeof (magic)) ||
+			!f.read ((char *)buf, 12))
+			return 0;
+		uint64_t size = bufbe64toh (buf);
+		uint32_t num = bufbe32toh (buf + 8);
+		if (size > m_Size) return 0; // log was replaced
+		for (uint32_t i = 0; i < num; i++)
+		{
+			if (!f.read ((char *)buf, 42))
+			{
+				m_Index.clear ();
+				m_LiveSize = 0;
+				return 0;
+			}
+			Location l{ bufbe64toh (buf + 32), bufbe16toh (buf + 40) };
+			m_Index[IdentHash (buf)] = l;
+			m_LiveSize += NETDB_LOG_RECORD_HEADER_SIZE + l.len;
+		}
+		m_IndexedSize = size;
+		return size;
+	}
+
+	void NetDbLogStorage::SaveIndex ()
+	{
+		// records covered by index must be on disk before it
+		m_File.flush ();
+		if (!i2p::fs::Sync (m_Path))
+		{
+			LogPrint (eLogError, "NetDb: Can't sync ", m_Path);
+			return;
+		}
+		auto tmp = m_IndexPath + ".tmp";
+		{
+			std::ofstream f (tmp, std::ofstream::binary | std::ofstream::trunc);
+			uint8_t buf[42];
+			f.write (NETDB_LOG_MAGIC, sizeof (NETDB_LOG_MAGIC));
+			htobe64buf (buf, m_Size);
+			htobe32buf (buf + 8, m_Index.size ());
+			f.write ((char *)buf, 12);
+			for (const auto& it: m_Index)
+			{
+				memcpy (buf, it.first, 32);
+				htobe64buf (buf + 32, it.second.offset);
+				htobe16buf (buf + 40, it.second.len);
+				f.write ((char *)buf, 42);
+			}
+			if (!f)
+			{
+				LogPrint (eLogError, "NetDb: Can't save ", tmp);
+				return;
+			}
+		}
+		i2p::fs::Sync (tmp);
+		boost::system::error_code ec;
+		boost::filesystem::rename (tmp, m_IndexPath, ec);
+		if (!ec) m_IndexedSize = m_Size;
+	}
+
+	uint64_t NetDbLogStorage::Scan (std::istream& s, uint64_t offset)
+	{
+		s.seekg (offset);
+		uint8_t header[NETDB_LOG_RECORD_HEADER_SIZE];
+		while (s.read ((char *)header, NETDB_LOG_RECORD_HEADER_SIZE))
+		{
+			uint16_t len = bufbe16toh (header + 32);
+			if (len && !s.seekg (len, std::ios::cur)) break;
+			if (offset + NETDB_LOG_RECORD_HEADER_SIZE + len > m_Size) break; // incomplete
+			IdentHash ident (header);
+			auto it = m_Index.find (ident);
+			if (it != m_Index.end ())
+			{
+				m_LiveSize -= NETDB_LOG_RECORD_HEADER_SIZE + it->second.len;
+				m_Index.erase (it);
+			}
+			if (len)
+			{
+				m_Index[ident] = { offset, len };
+				m_LiveSize += NETDB_LOG_RECORD_HEADER_SIZE + len;
+			}
+			offset += NETDB_LOG_RECORD_HEADER_SIZE + len;
+		}
+		return offset;
+	}
+
+	void NetDbLogStorage::Load (std::vector<std::shared_ptr<RouterInfo> >& routers)
+	{
+		// read whole log at once
+		std::vector<uint8_t> data (m_Size);
+		m_File.seekg (0);
+		if (!m_File.read ((char *)data.data (), m_Size))
+		{
+			LogPrint (eLogError, "NetDb: Can't read ", m_Path);
+			m_File.clear ();
+			return;
+		}
+		std::vector<std::pair<IdentHash, Location> > records (m_Index.begin (), m_Index.end ());
+		CreateRouterInfos (records.size (), [&data, &records](size_t i)->std::shared_ptr<RouterInfo>
+			{
+				const auto& l = records[i].second;
+				if (l.offset + NETDB_LOG_RECORD_HEADER_SIZE + l.len > data.size ()) return nullptr;
+				auto r = std::make_shared<RouterInfo>(data.data () + l.offset + NETDB_LOG_RECORD_HEADER_SIZE, l.len, true);
+				if (r->GetIdentHash () != records[i].first) return nullptr;
+				return r;
+			}, routers);
+		for (size_t i = 0; i < records.size (); i++)
+			if (!routers[i])
+			{
+				LogPrint (eLogWarning, "NetDb: RI ", records[i].first.ToBase64 (), " in ", m_Path, " is invalid. Delete");
+				Remove (records[i].first);
+			}
+	}
+
+	bool NetDbLogStorage::Append (const IdentHash& ident, const uint8_t * buf, uint16_t len)
+	{
+		uint8_t header[NETDB_LOG_RECORD_HEADER_SIZE];
+		memcpy (header, ident, 32);
+		htobe16buf (header + 32, len);
+		m_File.seekp (m_Size);
+		m_File.write ((char *)header, NETDB_LOG_RECORD_HEADER_SIZE);
+		if (len) m_File.write ((const char *)buf, len);
+		if (!m_File)
+		{
+			LogPrint (eLogError, "NetDb: Can't write to ", m_Path);
+			m_File.clear ();
+			// cut partial record, otherwise its rest would be scanned after next shorter record
+			m_File.flush ();
+			boost::system::error_code ec;
+			boost::filesystem::resize_file (m_Path, m_Size, ec);
+			return false;
+		}
+		m_Size += NETDB_LOG_RECORD_HEADER_SIZE + len;
+		return true;
+	}
+
+	bool NetDbLogStorage::Save (const IdentHash& ident, const uint8_t * buf, size_t len)
+	{
+		if (!buf || !len || len > MAX_RI_BUFFER_SIZE) return false;
+		auto offset = m_Size;
+		if (!Append (ident, buf, len)) return false;
+		auto it = m_Index.find (ident);
+		if (it != m_Index.end ())
+			m_LiveSize -= NETDB_LOG_RECORD_HEADER_SIZE + it->second.len;
+		m_Index[ident] = { offset, (uint16_t)len };
+		m_LiveSize += NETDB_LOG_RECORD_HEADER_SIZE + len;
+		return true;
+	}
+
+	void NetDbLogStorage::Remove (const IdentHash& ident)
+	{
+		auto it = m_Index.find (ident);
+		if (it == m_Index.end () || !Append (ident, nullptr, 0)) return;
+		m_LiveSize -= NETDB_LOG_RECORD_HEADER_SIZE + it->second.len;
+		m_Index.erase (it);
+	}
+
+	size_t NetDbLogStorage::Read (const IdentHash& ident, uint8_t * buf, size_t len)
+	{
+		auto it = m_Index.find (ident);
+		if (it == m_Index.end () || it->second.len > len) return 0;
+		m_File.seekg (it->second.offset + NETDB_LOG_RECORD_HEADER_SIZE);
+		if (!m_File.read ((char *)buf, it->second.len))
+		{
+			m_File.clear ();
+			return 0;
+		}
+		return it->second.len;
+	}
+
+	void NetDbLogStorage::Flush ()
+	{
+		m_File.flush ();
+		auto garbageSize = GetGarbageSize ();
+		if (garbageSize > NETDB_LOG_MIN_COMPACTION_SIZE && garbageSize > m_LiveSize)
+		{
+			auto ts = i2p::util::GetSecondsSinceEpoch ();
+			if (ts >= m_NextCompactionTime)
+				m_NextCompactionTime = Compact () ? 0 : ts + NETDB_LOG_COMPACTION_RETRY_INTERVAL;
+		}
+		if (m_IndexedSize != m_Size) SaveIndex ();
+	}
+
+	bool NetDbLogStorage::Compact ()
+	{
+		auto size = m_Size;
+		auto tmp = m_Path + ".tmp";
+		std::unordered_map<IdentHash, Location, IdentHashHash> index;
+		{
+			std::ofstream f (tmp, std::ofstream::binary | std::ofstream::trunc);
+			f.write (NETDB_LOG_MAGIC, sizeof (NETDB_LOG_MAGIC));
+			uint64_t offset = sizeof (NETDB_LOG_MAGIC);
+			uint8_t buf[NETDB_LOG_RECORD_HEADER_SIZE + MAX_RI_BUFFER_SIZE];
+			for (const auto& it: m_Index)
+			{
+				size_t len = NETDB_LOG_RECORD_HEADER_SIZE + it.second.len;
+				m_File.seekg (it.second.offset);
+				if (!m_File.read ((char *)buf, len))
+				{
+					m_File.clear ();
+					LogPrint (eLogError, "NetDb: Can't read ", m_Path, " for compaction");
+					f.close ();
+					i2p::fs::Remove (tmp);
+					return false;
+				}
+				f.write ((char *)buf, len);
+				index[it.first] = { offset, it.second.len };
+				offset += len;
+			}
+			if (!f)
+			{
+				LogPrint (eLogError, "NetDb: Can't write ", tmp);
+				f.close ();
+				i2p::fs::Remove (tmp);
+				return false;
+			}
+		}
+		if (!i2p::fs::Sync (tmp))
+		{
+			LogPrint (eLogError, "NetDb: Can't sync ", tmp);
+			i2p::fs::Remove (tmp);
+			return false;
+		}
+		m_File.close ();
+		i2p::fs::Remove (m_IndexPath); // full scan rather than stale index if we crash before next SaveIndex
+		m_IndexedSize = 0;
+		boost::system::error_code ec;
+		boost::filesystem::rename (tmp, m_Path, ec);
+		if (!ec)
+		{
+			m_Index.swap (index);
+			m_Size = sizeof (NETDB_LOG_MAGIC) + m_LiveSize;
+			LogPrint (eLogInfo, "NetDb: ", m_Path, " compacted from ", size, " to ", m_Size, " bytes");
+		}
+		else
+		{
+			LogPrint (eLogError, "NetDb: Can't replace ", m_Path, ": ", ec.message ());
+			i2p::fs::Remove (tmp);
+		}
+		m_File.open (m_Path, std::fstream::binary | std::fstream::in | std::fstream::out);
+		return !ec;
+	}
+
+	void NetDbLogStorage::Clear ()
+	{
+		Close ();
+		m_Index.clear ();
+		m_Size = 0; m_LiveSize = 0; m_IndexedSize = 0; m_NextCompactionTime = 0;
+		i2p::fs::Remove (m_Path);
+		i2p::fs::Remove (m_IndexPath);
+	}
+
+	std::unique_ptr<NetDbStorage> CreateNetDbStorage (const std::string& type, const std::string& place)
+	{
+		if (type == NETDB_STORAGE_LOG)
+			return std::unique_ptr<NetDbStorage>(new NetDbLogStorage (place));
+		if (type != NETDB_STORAGE_FILES)
+			LogPrint (eLogError, "NetDb: Unknown storage ", type, ", using ", NETDB_STORAGE_FILES);
+		return std::unique_ptr<NetDbStorage>(new NetDbFilesStorage (place));
+	}
+
+	size_t MigrateNetDbStorage (NetDbStorage& from, NetDbStorage& to)
+	{
+		std::vector<std::shared_ptr<RouterInfo> > routers;
+		from.Load (routers);
+		size_t num = 0;
+		for (const auto& r: routers)
+			if (r && r->GetBuffer () && to.Save (r->GetIdentHash (), r->GetBuffer (), r->GetBufferLen ()))
+				num++;
+		to.Flush ();
+		if (num) from.Clear ();
+		return num;
+	}
+
+	std::unique_ptr<NetDbStorage> OpenNetDbStorage (const std::string& type, const std::string& place)
+	{
+		auto storage = CreateNetDbStorage (type, place);
+		bool isEmpty = storage->IsEmpty ();
+		if (!storage->Init ()) return storage;
+		if (isEmpty)
+		{
+			auto other = CreateNetDbStorage (type == NETDB_STORAGE_LOG ? NETDB_STORAGE_FILES : NETDB_STORAGE_LOG, place);
+			if (!other->IsEmpty () && other->Init ())
+			{
+				LogPrint (eLogInfo, "NetDb: Migrating RIs to ", type, " storage");
+				auto num = MigrateNetDbStorage (*other, *storage);
+				LogPrint (eLogInfo, "NetDb: ", num, " RIs migrated to ", type, " storage");
+			}
+		}
+		return storage;
+	}
+}
+}
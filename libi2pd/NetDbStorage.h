@@ -0,0 +1,132 @@
+#ifndef NETDB_STORAGE_H__
+#define NETDB_STORAGE_H__
+
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <functional>
+#include <unordered_map>
+#include "Identity.h"
+#include "RouterInfo.h"
+#include "FS.h"
+
+namespace i2p
+{
+namespace data
+{
+	const char NETDB_STORAGE_FILES[] = "files";
+	const char NETDB_STORAGE_LOG[] = "log";
+	const char NETDB_LOG_FILENAME[] = "netDb.log";
+	const char NETDB_LOG_INDEX_FILENAME[] = "netDb.idx";
+	const char NETDB_LOG_MAGIC[8] = { 'i', '2', 'p', 'd', 'n', 'd', 'b', '1' };
+	const size_t NETDB_LOG_RECORD_HEADER_SIZE = 34; // ident + length
+	const uint64_t NETDB_LOG_MIN_COMPACTION_SIZE = 1024*1024; // garbage bytes
+	const int NETDB_LOG_COMPACTION_RETRY_INTERVAL = 3600; // in seconds, after failed compaction
+	const int NETDB_MAX_NUM_LOAD_THREADS = 8;
+	const int NETDB_MIN_NUM_RECORDS_PER_LOAD_THREAD = 256;
+
+	// persistent RouterInfos by ident, must be accessed from NetDb thread only
+	class NetDbStorage
+	{
+		public:
+
+			virtual ~NetDbStorage () {};
+
+			virtual bool IsEmpty () const = 0; // can be called before Init
+			virtual bool Init () = 0;
+			virtual void Close () {};
+			virtual void Load (std::vector<std::shared_ptr<RouterInfo> >& routers) = 0; // invalid RIs are removed
+			virtual bool Save (const IdentHash& ident, const uint8_t * buf, size_t len) = 0;
+			virtual void Remove (const IdentHash& ident) = 0;
+			virtual size_t Read (const IdentHash& ident, uint8_t * buf, size_t len) = 0; // 0 if not found
+			virtual void Flush () {}; // after a batch of Save and Remove
+			virtual void Clear () = 0; // remove everything
+
+		protected:
+
+			// parses RIs on multiple threads, create (i) returns i-th RI, nullptr if unreachable
+			static void CreateRouterInfos (size_t num, std::function<std::shared_ptr<RouterInfo>(size_t)> create,
+				std::vector<std::shared_ptr<RouterInfo> >& routers);
+	};
+
+	// file per RouterInfo, netDb/rX/routerInfo-X.dat
+	class NetDbFilesStorage: public NetDbStorage
+	{
+		public:
+
+			NetDbFilesStorage (const std::string& place);
+
+			bool IsEmpty () const;
+			bool Init ();
+			void Load (std::vector<std::shared_ptr<RouterInfo> >& routers);
+			bool Save (const IdentHash& ident, const uint8_t * buf, size_t len);
+			void Remove (const IdentHash& ident);
+			size_t Read (const IdentHash& ident, uint8_t * buf, size_t len);
+			void Clear ();
+
+		private:
+
+			i2p::fs::HashedStorage m_Storage;
+	};
+
+	// single append-only file of records: ident (32), length (2), RI (length), length 0 means removed
+	// index of live records is saved on Flush after log is synced, records appended after it are scanned on Init
+	// rewritten with live records only on Flush when garbage exceeds live records
+	class NetDbLogStorage: public NetDbStorage
+	{
+		struct Location
+		{
+			uint64_t offset; // of record
+			uint16_t len; // of RI
+		};
+
+		struct IdentHashHash
+		{
+			size_t operator() (const IdentHash& ident) const { return ident.GetLL ()[0]; };
+		};
+
+		public:
+
+			NetDbLogStorage (const std::string& place);
+			~NetDbLogStorage ();
+
+			bool IsEmpty () const;
+			bool Init ();
+			void Close ();
+			void Load (std::vector<std::shared_ptr<RouterInfo> >& routers);
+			bool Save (const IdentHash& ident, const uint8_t * buf, size_t len);
+			void Remove (const IdentHash& ident);
+			size_t Read (const IdentHash& ident, uint8_t * buf, size_t len);
+			void Flush ();
+			void Clear ();
+
+			uint64_t GetSize () const { return m_Size; };
+			uint64_t GetGarbageSize () const { return m_Size - sizeof (NETDB_LOG_MAGIC) - m_LiveSize; };
+
+		private:
+
+			uint64_t LoadIndex (); // returns size of file covered by index, 0 if no index
+			void SaveIndex ();
+			uint64_t Scan (std::istream& s, uint64_t offset); // returns end of last complete record
+			bool Append (const IdentHash& ident, const uint8_t * buf, uint16_t len); // false if not written
+			bool Compact ();
+
+		private:
+
+			std::string m_Path, m_IndexPath;
+			std::fstream m_File;
+			uint64_t m_Size, m_LiveSize, m_IndexedSize;
+			uint64_t m_NextCompactionTime; // in seconds, 0 if compaction has not failed
+			std::unordered_map<IdentHash, Location, IdentHashHash> m_Index;
+	};
+
+	std::unique_ptr<NetDbStorage> CreateNetDbStorage (const std::string& type, const std::string& place);
+	size_t MigrateNetDbStorage (NetDbStorage& from, NetDbStorage& to); // returns number of copied RIs, from is cleared
+	// creates storage of type, migrates from storage of other type if empty
+	std::unique_ptr<NetDbStorage> OpenNetDbStorage (const std::string& type, const std::string& place);
+}
+}
+
+#endif
@@ -1,4 +1,6 @@
 #include "Poly1305.h"
+#include "CPU.h"
+#include "I2PEndian.h"
 /**
    This code is licensed under the MCGSI Public License
    Copyright 2018 Jeff Becker
@@ -7,11 +9,463 @@
 
  */
 
-#if !OPENSSL_AEAD_CHACHA20_POLY1305 
+#if defined(CPU_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(CPU_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace i2p
 {
 namespace crypto
 {
+namespace poly1305
+{
+	const uint32_t LIMB_MASK = 0x3ffffff;
+	const uint32_t HIBIT = 1 << 24; // 2^128 for full blocks
+
+	static inline uint32_t Load32 (const uint8_t * p)
+	{
+		return le32toh (buf32toh (p));
+	}
+
+	static inline void Multiply (Limbs h, const Limbs r)
+	{
+		uint32_t s1 = r[1]*5, s2 = r[2]*5, s3 = r[3]*5, s4 = r[4]*5;
+		uint64_t d0 = (uint64_t)h[0]*r[0] + (uint64_t)h[1]*s4 + (uint64_t)h[2]*s3 + (uint64_t)h[3]*s2 + (uint64_t)h[4]*s1;
+		uint64_t d1 = (uint64_t)h[0]*r[1] + (uint64_t)h[1]*r[0] + (uint64_t)h[2]*s4 + (uint64_t)h[3]*s3 + (uint64_t)h[4]*s2;
+		uint64_t d2 = (uint64_t)h[0]*r[2] + (uint64_t)h[1]*r[1] + (uint64_t)h[2]*r[0] + (uint64_t)h[3]*s4 + (uint64_t)h[4]*s3;
+		uint64_t d3 = (uint64_t)h[0]*r[3] + (uint64_t)h[1]*r[2] + (uint64_t)h[2]*r[1] + (uint64_t)h[3]*r[0] + (uint64_t)h[4]*s4;
+		uint64_t d4 = (uint64_t)h[0]*r[4] + (uint64_t)h[1]*r[3] + (uint64_t)h[2]*r[2] + (uint64_t)h[3]*r[1] + (uint64_t)h[4]*r[0];
+		uint64_t c;
+		c = d0 >> 26; h[0] = d0 & LIMB_MASK; d1 += c;
+		c = d1 >> 26; h[1] = d1 & LIMB_MASK; d2 += c;
+		c = d2 >> 26; h[2] = d2 & LIMB_MASK; d3 += c;
+		c = d3 >> 26; h[3] = d3 & LIMB_MASK; d4 += c;
+		c = d4 >> 26; h[4] = d4 & LIMB_MASK;
+		d0 = h[0] + c*5;
+		h[0] = d0 & LIMB_MASK; h[1] += d0 >> 26;
+	}
+
+	static void BlocksScalar (Limbs h, const Limbs r, const uint8_t * m, size_t sz, uint32_t hibit)
+	{
+		while (sz >= POLY1305_BLOCK_BYTES)
+		{
+			h[0] += Load32 (m) & LIMB_MASK;
+			h[1] += (Load32 (m + 3) >> 2) & LIMB_MASK;
+			h[2] += (Load32 (m + 6) >> 4) & LIMB_MASK;
+			h[3] += (Load32 (m + 9) >> 6) & LIMB_MASK;
+			h[4] += (Load32 (m + 12) >> 8) | hibit;
+			Multiply (h, r);
+			m += POLY1305_BLOCK_BYTES;
+			sz -= POLY1305_BLOCK_BYTES;
+		}
+	}
+
+	// add lanes of SIMD accumulators to h
+	static void Accumulate (Limbs h, const uint64_t * d0, const uint64_t * d1, const uint64_t * d2,
+		const uint64_t * d3, const uint64_t * d4, int numLanes)
+	{
+		uint64_t d[5] = { 0, 0, 0, 0, 0 };
+		for (int i = 0; i < numLanes; i++)
+		{
+			d[0] += d0[i]; d[1] += d1[i]; d[2] += d2[i]; d[3] += d3[i]; d[4] += d4[i];
+		}
+		uint64_t c;
+		c = d[0] >> 26; h[0] = d[0] & LIMB_MASK; d[1] += c;
+		c = d[1] >> 26; h[1] = d[1] & LIMB_MASK; d[2] += c;
+		c = d[2] >> 26; h[2] = d[2] & LIMB_MASK; d[3] += c;
+		c = d[3] >> 26; h[3] = d[3] & LIMB_MASK; d[4] += c;
+		c = d[4] >> 26; h[4] = d[4] & LIMB_MASK;
+		d[0] = h[0] + c*5;
+		h[0] = d[0] & LIMB_MASK; h[1] += d[0] >> 26;
+	}
+
+	// SIMD kernels keep independent accumulator per lane, each multiplied by r^lanes per chunk
+	// lanes of last chunk are multiplied by r^lanes...r, and sum of lanes gives h
+#if defined(CPU_X86_DISPATCH)
+#define POLY1305_SSE2 __attribute__ ((target ("sse2")))
+#define POLY1305_AVX2 __attribute__ ((target ("avx2")))
+
+	POLY1305_SSE2 static inline void Multiply128 (__m128i * h, const __m128i * r, const __m128i * s)
+	{
+		const __m128i mask = _mm_set1_epi64x (LIMB_MASK);
+		__m128i d0 = _mm_add_epi64 (_mm_add_epi64 (_mm_add_epi64 (_mm_add_epi64 (_mm_mul_epu32 (h[0], r[0]),
+			_mm_mul_epu32 (h[1], s[4])), _mm_mul_epu32 (h[2], s[3])), _mm_mul_epu32 (h[3], s[2])), _mm_mul_epu32 (h[4], s[1]));
+		__m128i d1 = _mm_add_epi64 (_mm_add_epi64 (_mm_add_epi64 (_mm_add_epi64 (_mm_mul_epu32 (h[0], r[1]),
+			_mm_mul_epu32 (h[1], r[0])), _mm_mul_epu32 (h[2], s[4])), _mm_mul_epu32 (h[3], s[3])), _mm_mul_epu32 (h[4], s[2]));
+		__m128i d2 = _mm_add_epi64 (_mm_add_epi64 (_mm_add_epi64 (_mm_add_epi64 (_mm_mul_epu32 (h[0], r[2]),
+			_mm_mul_epu32 (h[1], r[1])), _mm_mul_epu32 (h[2], r[0])), _mm_mul_epu32 (h[3], s[4])), _mm_mul_epu32 (h[4], s[3]));
+		__m128i d3 = _mm_add_epi64 (_mm_add_epi64 (_mm_add_epi64 (_mm_add_epi64 (_mm_mul_epu32 (h[0], r[3]),
+			_mm_mul_epu32 (h[1], r[2])), _mm_mul_epu32 (h[2], r[1])), _mm_mul_epu32 (h[3], r[0])), _mm_mul_epu32 (h[4], s[4]));
+		__m128i d4 = _mm_add_epi64 (_mm_add_epi64 (_mm_add_epi64 (_mm_add_epi64 (_mm_mul_epu32 (h[0], r[4]),
+			_mm_mul_epu32 (h[1], r[3])), _mm_mul_epu32 (h[2], r[2])), _mm_mul_epu32 (h[3], r[1])), _mm_mul_epu32 (h[4], r[0]));
+		__m128i c;
+		c = _mm_srli_epi64 (d0, 26); h[0] = _mm_and_si128 (d0, mask); d1 = _mm_add_epi64 (d1, c);
+		c = _mm_srli_epi64 (d1, 26); h[1] = _mm_and_si128 (d1, mask); d2 = _mm_add_epi64 (d2, c);
+		c = _mm_srli_epi64 (d2, 26); h[2] = _mm_and_si128 (d2, mask); d3 = _mm_add_epi64 (d3, c);
+		c = _mm_srli_epi64 (d3, 26); h[3] = _mm_and_si128 (d3, mask); d4 = _mm_add_epi64 (d4, c);
+		c = _mm_srli_epi64 (d4, 26); h[4] = _mm_and_si128 (d4, mask);
+		d0 = _mm_add_epi64 (h[0], _mm_add_epi64 (c, _mm_slli_epi64 (c, 2))); // c*5
+		h[0] = _mm_and_si128 (d0, mask); h[1] = _mm_add_epi64 (h[1], _mm_srli_epi64 (d0, 26));
+	}
+
+	POLY1305_SSE2 static void BlocksSSE2 (Limbs h, const Limbs * powers, const uint8_t * m, size_t numChunks) // 32 bytes chunks
+	{
+		const __m128i mask = _mm_set1_epi64x (LIMB_MASK), hibit = _mm_set1_epi64x (HIBIT);
+		__m128i r[5], s[5], rl[5], sl[5], hv[5];
+		for (int i = 0; i < 5; i++)
+		{
+			r[i] = _mm_set1_epi64x (powers[2][i]); s[i] = _mm_set1_epi64x (powers[2][i]*5); // r^2
+			rl[i] = _mm_set_epi64x (powers[3][i], powers[2][i]); sl[i] = _mm_set_epi64x (powers[3][i]*5, powers[2][i]*5);
+			hv[i] = _mm_set_epi64x (0, h[i]);
+		}
+		for (size_t n = 0; n < numChunks; n++, m += 32)
+		{
+			__m128i b0 = _mm_loadu_si128 ((const __m128i *)m), b1 = _mm_loadu_si128 ((const __m128i *)(m + 16));
+			__m128i lo = _mm_unpacklo_epi64 (b0, b1), hi = _mm_unpackhi_epi64 (b0, b1);
+			hv[0] = _mm_add_epi64 (hv[0], _mm_and_si128 (lo, mask));
+			hv[1] = _mm_add_epi64 (hv[1], _mm_and_si128 (_mm_srli_epi64 (lo, 26), mask));
+			hv[2] = _mm_add_epi64 (hv[2], _mm_and_si128 (_mm_or_si128 (_mm_srli_epi64 (lo, 52), _mm_slli_epi64 (hi, 12)), mask));
+			hv[3] = _mm_add_epi64 (hv[3], _mm_and_si128 (_mm_srli_epi64 (hi, 14), mask));
+			hv[4] = _mm_add_epi64 (hv[4], _mm_or_si128 (_mm_srli_epi64 (hi, 40), hibit));
+			if (n + 1 < numChunks)
+				Multiply128 (hv, r, s);
+			else
+				Multiply128 (hv, rl, sl);
+		}
+		uint64_t d[5][2];
+		for (int i = 0; i < 5; i++) _mm_storeu_si128 ((__m128i *)d[i], hv[i]);
+		Accumulate (h, d[0], d[1], d[2], d[3], d[4], 2);
+	}
+
+	POLY1305_AVX2 static inline void Multiply256 (__m256i * h, const __m256i * r, const __m256i * s)
+	{
+		const __m256i mask = _mm256_set1_epi64x (LIMB_MASK);
+		__m256i d0 = _mm256_add_epi64 (_mm256_add_epi64 (_mm256_add_epi64 (_mm256_add_epi64 (_mm256_mul_epu32 (h[0], r[0]),
+			_mm256_mul_epu32 (h[1], s[4])), _mm256_mul_epu32 (h[2], s[3])), _mm256_mul_epu32 (h[3], s[2])), _mm256_mul_epu32 (h[4], s[1]));
+		__m256i d1 = _mm256_add_epi64 (_mm256_add_epi64 (_mm256_add_epi64 (_mm256_add_epi64 (_mm256_mul_epu32 (h[0], r[1]),
+			_mm256_mul_epu32 (h[1], r[0])), _mm256_mul_epu32 (h[2], s[4])), _mm256_mul_epu32 (h[3], s[3])), _mm256_mul_epu32 (h[4], s[2]));
+		__m256i d2 = _mm256_add_epi64 (_mm256_add_epi64 (_mm256_add_epi64 (_mm256_add_epi64 (_mm256_mul_epu32 (h[0], r[2]),
+			_mm256_mul_epu32 (h[1], r[1])), _mm256_mul_epu32 (h[2], r[0])), _mm256_mul_epu32 (h[3], s[4])), _mm256_mul_epu32 (h[4], s[3]));
+		__m256i d3 = _mm256_add_epi64 (_mm256_add_epi64 (_mm256_add_epi64 (_mm256_add_epi64 (_mm256_mul_epu32 (h[0], r[3]),
+			_mm256_mul_epu32 (h[1], r[2])), _mm256_mul_epu32 (h[2], r[1])), _mm256_mul_epu32 (h[3], r[0])), _mm256_mul_epu32 (h[4], s[4]));
+		__m256i d4 = _mm256_add_epi64 (_mm256_add_epi64 (_mm256_add_epi64 (_mm256_add_epi64 (_mm256_mul_epu32 (h[0], r[4]),
+			_mm256_mul_epu32 (h[1], r[3])), _mm256_mul_epu32 (h[2], r[2])), _mm256_mul_epu32 (h[3], r[1])), _mm256_mul_epu32 (h[4], r[0]));
+		__m256i c;
+		c = _mm256_srli_epi64 (d0, 26); h[0] = _mm256_and_si256 (d0, mask); d1 = _mm256_add_epi64 (d1, c);
+		c = _mm256_srli_epi64 (d1, 26); h[1] = _mm256_and_si256 (d1, mask); d2 = _mm256_add_epi64 (d2, c);
+		c = _mm256_srli_epi64 (d2, 26); h[2] = _mm256_and_si256 (d2, mask); d3 = _mm256_add_epi64 (d3, c);
+		c = _mm256_srli_epi64 (d3, 26); h[3] = _mm256_and_si256 (d3, mask); d4 = _mm256_add_epi64 (d4, c);
+		c = _mm256_srli_epi64 (d4, 26); h[4] = _mm256_and_si256 (d4, mask);
+		d0 = _mm256_add_epi64 (h[0], _mm256_add_epi64 (c, _mm256_slli_epi64 (c, 2))); // c*5
+		h[0] = _mm256_and_si256 (d0, mask); h[1] = _mm256_add_epi64 (h[1], _mm256_srli_epi64 (d0, 26));
+	}
+
+	POLY1305_AVX2 static void BlocksAVX2 (Limbs h, const Limbs * powers, const uint8_t * m, size_t numChunks) // 64 bytes chunks
+	{
+		const __m256i mask = _mm256_set1_epi64x (LIMB_MASK), hibit = _mm256_set1_epi64x (HIBIT);
+		__m256i r[5], s[5], rl[5], sl[5], hv[5];
+		for (int i = 0; i < 5; i++)
+		{
+			r[i] = _mm256_set1_epi64x (powers[0][i]); s[i] = _mm256_set1_epi64x (powers[0][i]*5); // r^4
+			// lanes hold blocks 0, 2, 1, 3 of chunk
+			rl[i] = _mm256_set_epi64x (powers[3][i], powers[1][i], powers[2][i], powers[0][i]);
+			sl[i] = _mm256_set_epi64x (powers[3][i]*5, powers[1][i]*5, powers[2][i]*5, powers[0][i]*5);
+			hv[i] = _mm256_set_epi64x (0, 0, 0, h[i]);
+		}
+		for (size_t n = 0; n < numChunks; n++, m += 64)
+		{
+			__m256i b01 = _mm256_loadu_si256 ((const __m256i *)m), b23 = _mm256_loadu_si256 ((const __m256i *)(m + 32));
+			__m256i lo = _mm256_unpacklo_epi64 (b01, b23), hi = _mm256_unpackhi_epi64 (b01, b23);
+			hv[0] = _mm256_add_epi64 (hv[0], _mm256_and_si256 (lo, mask));
+			hv[1] = _mm256_add_epi64 (hv[1], _mm256_and_si256 (_mm256_srli_epi64 (lo, 26), mask));
+			hv[2] = _mm256_add_epi64 (hv[2], _mm256_and_si256 (_mm256_or_si256 (_mm256_srli_epi64 (lo, 52), _mm256_slli_epi64 (hi, 12)), mask));
+			hv[3] = _mm256_add_epi64 (hv[3], _mm256_and_si256 (_mm256_srli_epi64 (hi, 14), mask));
+			hv[4] = _mm256_add_epi64 (hv[4], _mm256_or_si256 (_mm256_srli_epi64 (hi, 40), hibit));
+			if (n + 1 < numChunks)
+				Multiply256 (hv, r, s);
+			else
+				Multiply256 (hv, rl, sl);
+		}
+		uint64_t d[5][4];
+		for (int i = 0; i < 5; i++) _mm256_storeu_si256 ((__m256i *)d[i], hv[i]);
+		Accumulate (h, d[0], d[1], d[2], d[3], d[4], 4);
+	}
+
+	// independent messages in lanes, each lane with own r, idle lanes are refilled by next message
+	POLY1305_AVX2 static void LanesAVX2 (Poly1305 * const * polys, const uint8_t * const * msgs, const size_t * sizes, size_t num)
+	{
+		static const uint8_t zero[POLY1305_BLOCK_BYTES] = { 0 };
+		static const int slots[4] = { 0, 2, 1, 3 }; // vector lanes hold slots 0, 2, 1, 3
+		const __m256i mask = _mm256_set1_epi64x (LIMB_MASK), hibit = _mm256_set1_epi64x (HIBIT);
+		Poly1305 * lanes[4] = { nullptr, nullptr, nullptr, nullptr };
+		const uint8_t * p[4] = { zero, zero, zero, zero };
+		size_t left[4] = { 0, 0, 0, 0 }, next = 0; // blocks left
+		for (;;)
+		{
+			size_t steps = 0;
+			for (int l = 0; l < 4; l++)
+			{
+				while (!lanes[l] && next < num)
+				{
+					if (sizes[next] >= POLY1305_BLOCK_BYTES)
+					{
+						lanes[l] = polys[next]; p[l] = msgs[next]; left[l] = sizes[next]/POLY1305_BLOCK_BYTES;
+					}
+					next++;
+				}
+				if (lanes[l] && (!steps || left[l] < steps)) steps = left[l];
+			}
+			if (!steps) break;
+			// run until shortest message ends
+			__m256i hv[5], rv[5], sv[5];
+			for (int i = 0; i < 5; i++)
+			{
+				uint32_t h[4], r[4];
+				for (int l = 0; l < 4; l++)
+				{
+					h[slots[l]] = lanes[l] ? lanes[l]->m_H[i] : 0;
+					r[slots[l]] = lanes[l] ? lanes[l]->m_R[i] : 0; // idle lane stays zero
+				}
+				hv[i] = _mm256_set_epi64x (h[3], h[2], h[1], h[0]);
+				rv[i] = _mm256_set_epi64x (r[3], r[2], r[1], r[0]);
+				sv[i] = _mm256_set_epi64x (r[3]*5, r[2]*5, r[1]*5, r[0]*5);
+			}
+			for (size_t n = 0; n < steps; n++)
+			{
+				__m256i b01 = _mm256_inserti128_si256 (_mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *)p[0])),
+					_mm_loadu_si128 ((const __m128i *)p[1]), 1);
+				__m256i b23 = _mm256_inserti128_si256 (_mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *)p[2])),
+					_mm_loadu_si128 ((const __m128i *)p[3]), 1);
+				__m256i lo = _mm256_unpacklo_epi64 (b01, b23), hi = _mm256_unpackhi_epi64 (b01, b23);
+				hv[0] = _mm256_add_epi64 (hv[0], _mm256_and_si256 (lo, mask));
+				hv[1] = _mm256_add_epi64 (hv[1], _mm256_and_si256 (_mm256_srli_epi64 (lo, 26), mask));
+				hv[2] = _mm256_add_epi64 (hv[2], _mm256_and_si256 (_mm256_or_si256 (_mm256_srli_epi64 (lo, 52), _mm256_slli_epi64 (hi, 12)), mask));
+				hv[3] = _mm256_add_epi64 (hv[3], _mm256_and_si256 (_mm256_srli_epi64 (hi, 14), mask));
+				hv[4] = _mm256_add_epi64 (hv[4], _mm256_or_si256 (_mm256_srli_epi64 (hi, 40), hibit));
+				Multiply256 (hv, rv, sv);
+				for (int l = 0; l < 4; l++)
+					if (lanes[l]) p[l] += POLY1305_BLOCK_BYTES;
+			}
+			uint64_t d[5][4];
+			for (int i = 0; i < 5; i++) _mm256_storeu_si256 ((__m256i *)d[i], hv[i]);
+			for (int l = 0; l < 4; l++)
+				if (lanes[l])
+				{
+					for (int i = 0; i < 5; i++) lanes[l]->m_H[i] = d[i][slots[l]];
+					left[l] -= steps;
+					if (!left[l])
+					{
+						lanes[l] = nullptr; p[l] = zero;
+					}
+				}
+		}
+	}
+#elif defined(CPU_NEON)
+	static inline void MultiplyNEON (uint32x2_t * h, const uint32x2_t * r, const uint32x2_t * s)
+	{
+		const uint64x2_t mask = vdupq_n_u64 (LIMB_MASK);
+		uint64x2_t d0 = vmull_u32 (h[0], r[0]);
+		d0 = vmlal_u32 (d0, h[1], s[4]); d0 = vmlal_u32 (d0, h[2], s[3]); d0 = vmlal_u32 (d0, h[3], s[2]); d0 = vmlal_u32 (d0, h[4], s[1]);
+		uint64x2_t d1 = vmull_u32 (h[0], r[1]);
+		d1 = vmlal_u32 (d1, h[1], r[0]); d1 = vmlal_u32 (d1, h[2], s[4]); d1 = vmlal_u32 (d1, h[3], s[3]); d1 = vmlal_u32 (d1, h[4], s[2]);
+		uint64x2_t d2 = vmull_u32 (h[0], r[2]);
+		d2 = vmlal_u32 (d2, h[1], r[1]); d2 = vmlal_u32 (d2, h[2], r[0]); d2 = vmlal_u32 (d2, h[3], s[4]); d2 = vmlal_u32 (d2, h[4], s[3]);
+		uint64x2_t d3 = vmull_u32 (h[0], r[3]);
+		d3 = vmlal_u32 (d3, h[1], r[2]); d3 = vmlal_u32 (d3, h[2], r[1]); d3 = vmlal_u32 (d3, h[3], r[0]); d3 = vmlal_u32 (d3, h[4], s[4]);
+		uint64x2_t d4 = vmull_u32 (h[0], r[4]);
+		d4 = vmlal_u32 (d4, h[1], r[3]); d4 = vmlal_u32 (d4, h[2], r[2]); d4 = vmlal_u32 (d4, h[3], r[1]); d4 = vmlal_u32 (d4, h[4], r[0]);
+		uint64x2_t c;
+		c = vshrq_n_u64 (d0, 26); d0 = vandq_u64 (d0, mask); d1 = vaddq_u64 (d1, c);
+		c = vshrq_n_u64 (d1, 26); d1 = vandq_u64 (d1, mask); d2 = vaddq_u64 (d2, c);
+		c = vshrq_n_u64 (d2, 26); d2 = vandq_u64 (d2, mask); d3 = vaddq_u64 (d3, c);
+		c = vshrq_n_u64 (d3, 26); d3 = vandq_u64 (d3, mask); d4 = vaddq_u64 (d4, c);
+		c = vshrq_n_u64 (d4, 26); d4 = vandq_u64 (d4, mask);
+		d0 = vaddq_u64 (d0, vaddq_u64 (c, vshlq_n_u64 (c, 2))); // c*5
+		d1 = vaddq_u64 (d1, vshrq_n_u64 (d0, 26)); d0 = vandq_u64 (d0, mask);
+		h[0] = vmovn_u64 (d0); h[1] = vmovn_u64 (d1); h[2] = vmovn_u64 (d2); h[3] = vmovn_u64 (d3); h[4] = vmovn_u64 (d4);
+	}
+
+	static void BlocksNEON (Limbs h, const Limbs * powers, const uint8_t * m, size_t numChunks) // 32 bytes chunks
+	{
+		const uint64x2_t mask = vdupq_n_u64 (LIMB_MASK), hibit = vdupq_n_u64 (HIBIT);
+		uint32x2_t r[5], s[5], rl[5], sl[5], hv[5];
+		for (int i = 0; i < 5; i++)
+		{
+			r[i] = vdup_n_u32 (powers[2][i]); s[i] = vdup_n_u32 (powers[2][i]*5); // r^2
+			const uint32_t l[2] = { powers[2][i], powers[3][i] }, l5[2] = { powers[2][i]*5, powers[3][i]*5 }, h0[2] = { h[i], 0 };
+			rl[i] = vld1_u32 (l); sl[i] = vld1_u32 (l5); hv[i] = vld1_u32 (h0);
+		}
+		for (size_t n = 0; n < numChunks; n++, m += 32)
+		{
+			uint64x2_t b0 = vreinterpretq_u64_u8 (vld1q_u8 (m)), b1 = vreinterpretq_u64_u8 (vld1q_u8 (m + 16));
+			uint64x2_t lo = vcombine_u64 (vget_low_u64 (b0), vget_low_u64 (b1)), hi = vcombine_u64 (vget_high_u64 (b0), vget_high_u64 (b1));
+			hv[0] = vadd_u32 (hv[0], vmovn_u64 (vandq_u64 (lo, mask)));
+			hv[1] = vadd_u32 (hv[1], vmovn_u64 (vandq_u64 (vshrq_n_u64 (lo, 26), mask)));
+			hv[2] = vadd_u32 (hv[2], vmovn_u64 (vandq_u64 (vorrq_u64 (vshrq_n_u64 (lo, 52), vshlq_n_u64 (hi, 12)), mask)));
+			hv[3] = vadd_u32 (hv[3], vmovn_u64 (vandq_u64 (vshrq_n_u64 (hi, 14), mask)));
+			hv[4] = vadd_u32 (hv[4], vmovn_u64 (vorrq_u64 (vshrq_n_u64 (hi, 40), hibit)));
+			if (n + 1 < numChunks)
+				MultiplyNEON (hv, r, s);
+			else
+				MultiplyNEON (hv, rl, sl);
+		}
+		uint64_t d[5][2];
+		for (int i = 0; i < 5; i++)
+		{
+			d[i][0] = vget_lane_u32 (hv[i], 0); d[i][1] = vget_lane_u32 (hv[i], 1);
+		}
+		Accumulate (h, d[0], d[1], d[2], d[3], d[4], 2);
+	}
+#endif
+}
+
+	Poly1305::Poly1305(const uint64_t * key)
+	{
+		const uint8_t * k = (const uint8_t *)key;
+		// clamp r
+		m_R[0] = poly1305::Load32 (k) & 0x3ffffff;
+		m_R[1] = (poly1305::Load32 (k + 3) >> 2) & 0x3ffff03;
+		m_R[2] = (poly1305::Load32 (k + 6) >> 4) & 0x3ffc0ff;
+		m_R[3] = (poly1305::Load32 (k + 9) >> 6) & 0x3f03fff;
+		m_R[4] = (poly1305::Load32 (k + 12) >> 8) & 0x00fffff;
+		for (int i = 0; i < 4; i++)
+			m_Pad[i] = poly1305::Load32 (k + 16 + i*4);
+		memset (m_H, 0, sizeof (m_H));
+		m_Leftover = 0;
+		m_HasPowers = false;
+		m_Final = 0;
+	}
+
+	void Poly1305::Update(const uint8_t * buf, size_t sz)
+	{
+		// process leftover
+		if(m_Leftover)
+		{
+			size_t want = POLY1305_BLOCK_BYTES - m_Leftover;
+			if(want > sz) want = sz;
+			memcpy(m_Buffer + m_Leftover, buf, want);
+			sz -= want;
+			buf += want;
+			m_Leftover += want;
+			if(m_Leftover < POLY1305_BLOCK_BYTES) return;
+			Blocks(m_Buffer, POLY1305_BLOCK_BYTES);
+			m_Leftover = 0;
+		}
+		// process blocks
+		if(sz >= POLY1305_BLOCK_BYTES)
+		{
+			size_t want = (sz & ~(POLY1305_BLOCK_BYTES - 1));
+			Blocks(buf, want);
+			buf += want;
+			sz -= want;
+		}
+		// leftover
+		if(sz)
+		{
+			memcpy(m_Buffer+m_Leftover, buf, sz);
+			m_Leftover += sz;
+		}
+	}
+
+	void Poly1305::Blocks(const uint8_t * buf, size_t sz)
+	{
+		const uint32_t hibit = m_Final ? 0 : poly1305::HIBIT;
+#if defined(CPU_X86_DISPATCH)
+		if (i2p::cpu::avx2 && sz >= 128 && hibit)
+		{
+			CalculatePowers ();
+			size_t n = sz & ~(size_t)63;
+			poly1305::BlocksAVX2 (m_H, m_Powers, buf, n/64);
+			buf += n; sz -= n;
+		}
+		if (i2p::cpu::sse2 && sz >= 64 && hibit)
+		{
+			CalculatePowers ();
+			size_t n = sz & ~(size_t)31;
+			poly1305::BlocksSSE2 (m_H, m_Powers, buf, n/32);
+			buf += n; sz -= n;
+		}
+#elif defined(CPU_NEON)
+		if (i2p::cpu::neon && sz >= 64 && hibit)
+		{
+			CalculatePowers ();
+			size_t n = sz & ~(size_t)31;
+			poly1305::BlocksNEON (m_H, m_Powers, buf, n/32);
+			buf += n; sz -= n;
+		}
+#endif
+		poly1305::BlocksScalar (m_H, m_R, buf, sz, hibit);
+	}
+
+	void Poly1305::CalculatePowers()
+	{
+		if (m_HasPowers) return;
+		memcpy (m_Powers[3], m_R, sizeof (m_R));
+		for (int i = 2; i >= 0; i--)
+		{
+			memcpy (m_Powers[i], m_Powers[i + 1], sizeof (m_R));
+			poly1305::Multiply (m_Powers[i], m_R);
+		}
+		m_HasPowers = true;
+	}
+
+	void Poly1305::Finish(uint64_t * out)
+	{
+		// process leftovers
+		if(m_Leftover)
+		{
+			size_t idx = m_Leftover;
+			m_Buffer[idx++] = 1;
+			for(; idx < POLY1305_BLOCK_BYTES; idx++)
+				m_Buffer[idx] = 0;
+			m_Final = 1;
+			Blocks(m_Buffer, POLY1305_BLOCK_BYTES);
+		}
+
+		// fully carry h
+		uint32_t h0 = m_H[0], h1 = m_H[1], h2 = m_H[2], h3 = m_H[3], h4 = m_H[4], c;
+		c = h1 >> 26; h1 &= 0x3ffffff; h2 += c;
+		c = h2 >> 26; h2 &= 0x3ffffff; h3 += c;
+		c = h3 >> 26; h3 &= 0x3ffffff; h4 += c;
+		c = h4 >> 26; h4 &= 0x3ffffff; h0 += c*5;
+		c = h0 >> 26; h0 &= 0x3ffffff; h1 += c;
+		// compute h - p and select it if h >= p
+		uint32_t g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+		uint32_t g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+		uint32_t g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+		uint32_t g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+		uint32_t g4 = h4 + c - (1 << 26);
+		uint32_t mask = (g4 >> 31) - 1; // all ones if no borrow
+		h0 = (h0 & ~mask) | (g0 & mask);
+		h1 = (h1 & ~mask) | (g1 & mask);
+		h2 = (h2 & ~mask) | (g2 & mask);
+		h3 = (h3 & ~mask) | (g3 & mask);
+		h4 = (h4 & ~mask) | (g4 & mask);
+		// h mod 2^128 and add pad
+		uint32_t w[4] = { h0 | (h1 << 26), (h1 >> 6) | (h2 << 20), (h2 >> 12) | (h3 << 14), (h3 >> 18) | (h4 << 8) };
+		uint64_t f = 0;
+		uint8_t * digest = (uint8_t *)out;
+		for (int i = 0; i < 4; i++)
+		{
+			f = (uint64_t)w[i] + m_Pad[i] + (f >> 32);
+			htole32buf (digest + i*4, (uint32_t)f);
+		}
+	}
+
+	void Poly1305Blocks(Poly1305 * const * polys, const uint8_t * const * msgs, const size_t * sizes, size_t num)
+	{
+#if defined(CPU_X86_DISPATCH)
+		if (i2p::cpu::avx2)
+		{
+			poly1305::LanesAVX2 (polys, msgs, sizes, num);
+			return;
+		}
+#endif
+		for (size_t i = 0; i < num; i++)
+			polys[i]->Blocks (msgs[i], sizes[i] & ~(POLY1305_BLOCK_BYTES - 1));
+	}
 
 	void Poly1305HMAC(uint64_t * out, const uint64_t * key, const uint8_t * buf, std::size_t sz)
 	{
@@ -21,5 +475,3 @@ namespace crypto
 	}
 }
 }
-#endif
-
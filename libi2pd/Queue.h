@@ -8,6 +8,8 @@
 #include <condition_variable>
 #include <functional>
 #include <utility>
+#include <atomic>
+#include <chrono>
 
 namespace i2p
 {
@@ -49,13 +51,13 @@ namespace util
 				return el;
 			}
 
-			Element GetNextWithTimeout (int usec)
+			Element GetNextWithTimeout (int msec)
 			{
 				std::unique_lock<std::mutex> l(m_QueueMutex);
 				auto el = GetNonThreadSafe ();
 				if (!el)
 				{
-					m_NonEmpty.wait_for (l, std::chrono::milliseconds (usec));
+					m_NonEmpty.wait_for (l, std::chrono::milliseconds (msec));
 					el = GetNonThreadSafe ();
 				}
 				return el;
@@ -67,10 +69,10 @@ namespace util
 				m_NonEmpty.wait (l);
 			}
 
-			bool Wait (int sec, int usec)
+			bool Wait (int sec, int msec)
 			{
 				std::unique_lock<std::mutex> l(m_QueueMutex);
-				return m_NonEmpty.wait_for (l, std::chrono::seconds (sec) + std::chrono::milliseconds (usec)) != std::cv_status::timeout;
+				return m_NonEmpty.wait_for (l, std::chrono::seconds (sec) + std::chrono::milliseconds (msec)) != std::cv_status::timeout;
 			}
 
 			bool IsEmpty ()
@@ -99,6 +101,19 @@ namespace util
 				return GetNonThreadSafe (true);
 			}
 
+			size_t GetBatch (std::vector<Element>& elements, size_t maxNum) // appends, returns number of elements
+			{
+				std::unique_lock<std::mutex> l(m_QueueMutex);
+				size_t num = 0;
+				while (num < maxNum && !m_Queue.empty ())
+				{
+					elements.push_back (std::move (m_Queue.front ()));
+					m_Queue.pop ();
+					num++;
+				}
+				return num;
+			}
+
 		private:
 
 			Element GetNonThreadSafe (bool peek = false)
@@ -119,6 +134,65 @@ namespace util
 			std::mutex m_QueueMutex;
 			std::condition_variable m_NonEmpty;
 	};
+
+	/**
+	 * Unbounded lock-free list of batches for many producers and one consumer.
+	 * Put returns true if the list was empty, so producers schedule the consumer once per GetAll.
+	 */
+	template<typename Element>
+	class MPSCBatchQueue
+	{
+		struct Batch
+		{
+			std::vector<Element> elements;
+			Batch * next;
+		};
+
+		public:
+
+			MPSCBatchQueue (): m_Head (nullptr) {};
+			~MPSCBatchQueue ()
+			{
+				std::vector<Element> elements;
+				GetAll (elements);
+			}
+
+			bool Put (const std::vector<Element>& elements)
+			{
+				auto batch = new Batch{ elements, m_Head.load (std::memory_order_relaxed) };
+				while (!m_Head.compare_exchange_weak (batch->next, batch, std::memory_order_release, std::memory_order_relaxed));
+				return !batch->next;
+			}
+
+			void GetAll (std::vector<Element>& elements) // appends in order of Put
+			{
+				// take whole list at once and reverse it, since the latest batch is the head
+				Batch * batch = m_Head.exchange (nullptr, std::memory_order_acquire), * prev = nullptr;
+				size_t num = elements.size ();
+				while (batch)
+				{
+					num += batch->elements.size ();
+					auto next = batch->next;
+					batch->next = prev; prev = batch;
+					batch = next;
+				}
+				elements.reserve (num);
+				while (prev)
+				{
+					for (auto& it: prev->elements)
+						elements.push_back (std::move (it));
+					auto next = prev->next;
+					delete prev;
+					prev = next;
+				}
+			}
+
+			bool IsEmpty () const { return !m_Head.load (std::memory_order_relaxed); };
+
+		private:
+
+			std::atomic<Batch *> m_Head;
+	};
 }
 }
 
@@ -2,6 +2,11 @@
 #include <string.h>
 #include "I2PEndian.h"
 #include <fstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
 #include <boost/lexical_cast.hpp>
 #include <boost/make_shared.hpp>
 #if (BOOST_VERSION >= 105300)
@@ -13,6 +18,7 @@
 #include "Timestamp.h"
 #include "Log.h"
 #include "NetDb.hpp"
+#include "NetDbStorage.h"
 #include "RouterContext.h"
 #include "RouterInfo.h"
 
@@ -20,28 +26,29 @@ namespace i2p
 {
 namespace data
 {
-	RouterInfo::RouterInfo (): m_Buffer (nullptr)
+	RouterInfo::RouterInfo (): m_Buffer (nullptr), m_IsLocal (true), m_FamilyStatus (eFamilyValid)
 	{
 		m_Addresses = boost::make_shared<Addresses>(); // create empty list
 	}
 
 	RouterInfo::RouterInfo (const std::string& fullPath):
-		m_FullPath (fullPath), m_IsUpdated (false), m_IsUnreachable (false),
-		m_SupportedTransports (0), m_Caps (0)
+		m_IsLocal (false), m_IsUpdated (false), m_IsUnreachable (false),
+		m_SupportedTransports (0), m_Caps (0), m_FamilyStatus (eFamilyValid)
 	{
 		m_Addresses = boost::make_shared<Addresses>(); // create empty list
 		m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
-		ReadFromFile ();
+		ReadFromFile (fullPath);
 	}
 
-	RouterInfo::RouterInfo (const uint8_t * buf, int len):
-		m_IsUpdated (true), m_IsUnreachable (false), m_SupportedTransports (0), m_Caps (0)
+	RouterInfo::RouterInfo (const uint8_t * buf, int len, bool isStored):
+		m_IsLocal (false), m_IsUpdated (!isStored), m_IsUnreachable (false), m_SupportedTransports (0), m_Caps (0),
+		m_FamilyStatus (eFamilyValid)
 	{
 		m_Addresses = boost::make_shared<Addresses>(); // create empty list
 		m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
 		memcpy (m_Buffer, buf, len);
 		m_BufferLen = len;
-		ReadFromBuffer (true);
+		ReadFromBuffer (!isStored);
 	}
 
 	RouterInfo::~RouterInfo ()
@@ -87,16 +94,42 @@ namespace data
 		m_Timestamp = i2p::util::GetMillisecondsSinceEpoch ();
 	}
 
-	bool RouterInfo::LoadFile ()
+	bool RouterInfo::LoadFile (const std::string& fullPath)
 	{
-		std::ifstream s(m_FullPath, std::ifstream::binary);
+#ifndef _WIN32
+		// plain read, RI files are too small for mmap to pay off
+		int fd = open (fullPath.c_str (), O_RDONLY);
+		if (fd < 0)
+		{
+			LogPrint (eLogError, "RouterInfo: Can't open file ", fullPath);
+			return false;
+		}
+		struct stat st;
+		if (fstat (fd, &st) < 0 || st.st_size < 40 || st.st_size > MAX_RI_BUFFER_SIZE)
+		{
+			LogPrint(eLogError, "RouterInfo: File", fullPath, " is malformed");
+			close (fd);
+			return false;
+		}
+		m_BufferLen = st.st_size;
+		if (!m_Buffer)
+			m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
+		ssize_t l = read (fd, m_Buffer, m_BufferLen);
+		close (fd);
+		if (l != (ssize_t)m_BufferLen)
+		{
+			LogPrint (eLogError, "RouterInfo: Can't read file ", fullPath);
+			return false;
+		}
+#else
+		std::ifstream s(fullPath, std::ifstream::binary);
 		if (s.is_open ())
 		{
 			s.seekg (0,std::ios::end);
 			m_BufferLen = s.tellg ();
 			if (m_BufferLen < 40 || m_BufferLen > MAX_RI_BUFFER_SIZE)
 			{
-				LogPrint(eLogError, "RouterInfo: File", m_FullPath, " is malformed");
+				LogPrint(eLogError, "RouterInfo: File", fullPath, " is malformed");
 				return false;
 			}
 			s.seekg(0, std::ios::beg);
@@ -106,15 +139,16 @@ namespace data
 		}
 		else
 		{
-			LogPrint (eLogError, "RouterInfo: Can't open file ", m_FullPath);
+			LogPrint (eLogError, "RouterInfo: Can't open file ", fullPath);
 			return false;
 		}
+#endif
 		return true;
 	}
 
-	void RouterInfo::ReadFromFile ()
+	void RouterInfo::ReadFromFile (const std::string& fullPath)
 	{
-		if (LoadFile ())
+		if (LoadFile (fullPath))
 			ReadFromBuffer (false);
 		else
 			m_IsUnreachable = true;
@@ -169,6 +203,7 @@ namespace data
 		auto addresses = boost::make_shared<Addresses>();
 		uint8_t numAddresses;
 		s.read ((char *)&numAddresses, sizeof (numAddresses)); if (!s) return;
+		addresses->reserve (numAddresses);
 		bool introducers = false;
 		for (int i = 0; i < numAddresses; i++)
 		{
@@ -211,15 +246,9 @@ namespace data
 					if (ecode)
 					{
 						if (address->transportStyle == eTransportNTCP)
-						{
 							supportedTransports |= eNTCPV4; // TODO:
-							address->addressString = value;
-						}
 						else
-						{
 							supportedTransports |= eSSUV4; // TODO:
-							address->addressString = value;
-						}
 					}
 					else
 					{
@@ -321,7 +350,7 @@ namespace data
 			r += ReadString (value, 255, s);
 			s.seekg (1, std::ios_base::cur); r++; // ;
 			if (!s) return;
-			m_Properties[key] = value;
+			if (m_IsLocal) m_Properties[key] = value;
 
 			// extract caps
 			if (!strcmp (key, "caps"))
@@ -337,14 +366,13 @@ namespace data
 			{
 				m_Family = value;
 				boost::to_lower (m_Family);
+				m_FamilyStatus = eFamilyValid; // unless signed
 			}
 			else if (!strcmp (key, ROUTER_INFO_PROPERTY_FAMILY_SIG))
 			{
-				if (!netdb.GetFamilies ().VerifyFamily (m_Family, GetIdentHash (), value))
-				{
-					LogPrint (eLogWarning, "RouterInfo: family signature verification failed");
-					m_Family.clear ();
-				}
+				// verified on first IsFamily call, most of routers are never checked for family
+				m_FamilySignature = value;
+				m_FamilyStatus = eFamilyUnverified;
 			}
 
 			if (!s) return;
@@ -354,9 +382,20 @@ namespace data
 			SetUnreachable (true);
 	}
 
-  bool RouterInfo::IsFamily(const std::string & fam) const {
-    return m_Family == fam;
-  }
+	bool RouterInfo::IsFamily (const std::string & fam) const
+	{
+		if (m_Family != fam) return false;
+		uint8_t status = m_FamilyStatus;
+		if (status == eFamilyUnverified)
+		{
+			status = netdb.GetFamilies ().VerifyFamily (m_Family, GetIdentHash (), m_FamilySignature.c_str ()) ?
+				eFamilyValid : eFamilyInvalid;
+			if (status == eFamilyInvalid)
+				LogPrint (eLogWarning, "RouterInfo: family signature verification failed");
+			m_FamilyStatus = status;
+		}
+		return status == eFamilyValid;
+	}
 
 	void RouterInfo::ExtractCaps (const char * value)
 	{
@@ -591,12 +630,16 @@ namespace data
 		return bufbe64toh (buf + size) > m_Timestamp;
 	}
 
-	const uint8_t * RouterInfo::LoadBuffer ()
+	const uint8_t * RouterInfo::LoadBuffer (NetDbStorage& storage)
 	{
 		if (!m_Buffer)
 		{
-			if (LoadFile ())
-				LogPrint (eLogDebug, "RouterInfo: Buffer for ", GetIdentHashAbbreviation (GetIdentHash ()), " loaded from file");
+			m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
+			m_BufferLen = storage.Read (GetIdentHash (), m_Buffer, MAX_RI_BUFFER_SIZE);
+			if (m_BufferLen)
+				LogPrint (eLogDebug, "RouterInfo: Buffer for ", GetIdentHashAbbreviation (GetIdentHash ()), " loaded from storage");
+			else
+				DeleteBuffer ();
 		}
 		return m_Buffer;
 	}
@@ -620,7 +663,6 @@ namespace data
 
 	bool RouterInfo::SaveToFile (const std::string& fullPath)
 	{
-		m_FullPath = fullPath;
 		if (!m_Buffer) {
 			LogPrint (eLogError, "RouterInfo: Can't save, m_Buffer == NULL");
 			return false;
@@ -671,7 +713,7 @@ namespace data
 		for (const auto& it: *m_Addresses) // don't insert same address twice
 			if (*it == *addr) return;
 		m_SupportedTransports |= addr->host.is_v6 () ? eNTCPV6 : eNTCPV4;
-		m_Addresses->push_front(std::move(addr)); // always make NTCP first
+		m_Addresses->insert (m_Addresses->begin (), std::move(addr)); // always make NTCP first
 	}
 
 	void RouterInfo::AddSSUAddress (const char * host, int port, const uint8_t * key, int mtu)
@@ -6,6 +6,7 @@
 #include <map>
 #include <vector>
 #include <list>
+#include <atomic>
 #include <iostream>
 #include <boost/asio.hpp>
 #include <boost/shared_ptr.hpp>
@@ -39,6 +40,8 @@ namespace data
 	const char CAPS_FLAG_SSU_INTRODUCER = 'C';
 
 	const int MAX_RI_BUFFER_SIZE = 2048;
+
+	class NetDbStorage;
 	class RouterInfo: public RoutingDestination
 	{
 		public:
@@ -72,6 +75,13 @@ namespace data
 				eTransportSSU
 			};
 
+			enum FamilyStatus
+			{
+				eFamilyValid = 0, // or not signed
+				eFamilyUnverified,
+				eFamilyInvalid
+			};
+
 			typedef Tag<32> IntroKey; // should be castable to MacKey and AESKey
 			struct Introducer
 			{
@@ -102,7 +112,6 @@ namespace data
 			{
 				TransportStyle transportStyle;
 				boost::asio::ip::address host;
-				std::string addressString;
 				int port;
 				uint64_t date;
 				uint8_t cost;
@@ -130,13 +139,11 @@ namespace data
 				bool IsPublishedNTCP2 () const { return IsNTCP2 () && ntcp2->isPublished; };
 				bool IsNTCP2Only () const { return ntcp2 && ntcp2->isNTCP2Only; };
 			};
-			typedef std::list<std::shared_ptr<Address> > Addresses;
+			typedef std::vector<std::shared_ptr<Address> > Addresses; // few addresses, allocated once
 
-			RouterInfo ();
+			RouterInfo (); // local, keeps properties
 			RouterInfo (const std::string& fullPath);
-			RouterInfo (const RouterInfo& ) = default;
-			RouterInfo& operator=(const RouterInfo& ) = default;
-			RouterInfo (const uint8_t * buf, int len);
+			RouterInfo (const uint8_t * buf, int len, bool isStored = false); // stored RI is not verified
 			~RouterInfo ();
 
 			std::shared_ptr<const IdentityEx> GetRouterIdentity () const { return m_RouterIdentity; };
@@ -156,8 +163,7 @@ namespace data
 			bool RemoveIntroducer (const boost::asio::ip::udp::endpoint& e);
 			void SetProperty (const std::string& key, const std::string& value); // called from RouterContext only
 			void DeleteProperty (const std::string& key); // called from RouterContext only
-			std::string GetProperty (const std::string& key) const; // called from RouterContext only
-			void ClearProperties () { m_Properties.clear (); };
+			std::string GetProperty (const std::string& key) const; // called from RouterContext only, empty for remote RI
 			bool IsFloodfill () const { return m_Caps & Caps::eFloodfill; };
 			bool IsReachable () const { return m_Caps & Caps::eReachable; };
 			bool IsNTCP (bool v4only = true) const;
@@ -185,7 +191,7 @@ namespace data
 			bool IsUnreachable () const { return m_IsUnreachable; };
 
 			const uint8_t * GetBuffer () const { return m_Buffer; };
-			const uint8_t * LoadBuffer (); // load if necessary
+			const uint8_t * LoadBuffer (NetDbStorage& storage); // load if necessary
 			int GetBufferLen () const { return m_BufferLen; };
 			void CreateBuffer (const PrivateKeys& privateKeys);
 
@@ -201,7 +207,8 @@ namespace data
 			bool IsNewer (const uint8_t * buf, size_t len) const;
 
 		/** return true if we are in a router family and the signature is valid */
-		bool IsFamily(const std::string & fam) const;
+		bool IsFamily(const std::string & fam) const; // verifies family signature on first call
+		bool IsFamilyUnverified () const { return m_FamilyStatus == eFamilyUnverified; };
 
 			// implements RoutingDestination
 			std::shared_ptr<const IdentityEx> GetIdentity () const { return m_RouterIdentity; };
@@ -211,8 +218,8 @@ namespace data
 
 		private:
 
-			bool LoadFile ();
-			void ReadFromFile ();
+			bool LoadFile (const std::string& fullPath);
+			void ReadFromFile (const std::string& fullPath);
 			void ReadFromStream (std::istream& s);
 			void ReadFromBuffer (bool verifySignature);
 			void WriteToStream (std::ostream& s) const;
@@ -225,15 +232,16 @@ namespace data
 
 		private:
 
-			std::string m_FullPath, m_Family;
+			std::string m_Family, m_FamilySignature;
 			std::shared_ptr<const IdentityEx> m_RouterIdentity;
 			uint8_t * m_Buffer;
 			size_t m_BufferLen;
 			uint64_t m_Timestamp;
 			boost::shared_ptr<Addresses> m_Addresses; // TODO: use std::shared_ptr and std::atomic_store for gcc >= 4.9
-			std::map<std::string, std::string> m_Properties;
-			bool m_IsUpdated, m_IsUnreachable;
+			std::map<std::string, std::string> m_Properties; // local RI only, remote RIs are never written back
+			bool m_IsLocal, m_IsUpdated, m_IsUnreachable;
 			uint8_t m_SupportedTransports, m_Caps;
+			mutable std::atomic<uint8_t> m_FamilyStatus;
 			mutable std::shared_ptr<RouterProfile> m_Profile;
 	};
 }
@@ -1,6 +1,13 @@
 #include <string.h>
+#include <algorithm>
 #include <boost/bind.hpp>
+#ifdef SSU_BATCHED_IO
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#endif
 #include "Log.h"
+#include "util.h"
 #include "Timestamp.h"
 #include "RouterContext.h"
 #include "NetDb.hpp"
@@ -41,6 +48,10 @@ namespace transport
 
 	SSUServer::~SSUServer ()
 	{
+#ifdef SSU_BATCHED_IO
+		for (auto it: m_SparePackets) delete it;
+		for (auto it: m_SparePacketsV6) delete it;
+#endif
 	}
 
 	void SSUServer::OpenSocket ()
@@ -121,6 +132,7 @@ namespace transport
 
 	void SSUServer::Run ()
 	{
+		i2p::util::SetThreadAffinity ("ssu");
 		while (m_IsRunning)
 		{
 			try
@@ -151,6 +163,7 @@ namespace transport
 
 	void SSUServer::RunReceivers ()
 	{
+		i2p::util::SetThreadAffinity ("ssu");
 		while (m_IsRunning)
 		{
 			try
@@ -166,6 +179,7 @@ namespace transport
 
 	void SSUServer::RunReceiversV6 ()
 	{
+		i2p::util::SetThreadAffinity ("ssu");
 		while (m_IsRunning)
 		{
 			try
@@ -210,20 +224,149 @@ namespace transport
 			m_SocketV6.send_to (boost::asio::buffer (buf, len), to);
 	}
 
+	void SSUServer::Send (const std::vector<boost::asio::const_buffer>& bufs, const boost::asio::ip::udp::endpoint& to)
+	{
+		auto& socket = (to.protocol () == boost::asio::ip::udp::v4()) ? m_Socket : m_SocketV6;
+#ifdef SSU_BATCHED_IO
+		mmsghdr msgs[SSU_MAX_NUM_SENT_PACKETS];
+		iovec iovs[SSU_MAX_NUM_SENT_PACKETS];
+		for (size_t offset = 0; offset < bufs.size ();)
+		{
+			size_t num = std::min (bufs.size () - offset, SSU_MAX_NUM_SENT_PACKETS);
+			memset (msgs, 0, num*sizeof (mmsghdr));
+			for (size_t i = 0; i < num; i++)
+			{
+				iovs[i].iov_base = const_cast<void *>(boost::asio::buffer_cast<const void *>(bufs[offset + i]));
+				iovs[i].iov_len = boost::asio::buffer_size (bufs[offset + i]);
+				msgs[i].msg_hdr.msg_name = const_cast<sockaddr *>(to.data ());
+				msgs[i].msg_hdr.msg_namelen = to.size ();
+				msgs[i].msg_hdr.msg_iov = iovs + i;
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+			int sent = sendmmsg (socket.native_handle (), msgs, num, 0);
+			if (sent < 0)
+			{
+				if (errno == EINTR) continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					// socket is non-blocking because of async receive, wait like send_to does
+					pollfd fd = { socket.native_handle (), POLLOUT, 0 };
+					poll (&fd, 1, -1);
+					continue;
+				}
+				throw boost::system::system_error (boost::system::error_code (errno, boost::system::system_category ()), "sendmmsg");
+			}
+			offset += sent;
+		}
+#else
+		for (const auto& it: bufs)
+			socket.send_to (boost::asio::buffer (it), to);
+#endif
+	}
+
 	void SSUServer::Receive ()
 	{
+#ifdef SSU_BATCHED_IO
+		m_Socket.async_receive (boost::asio::null_buffers (),
+			std::bind (&SSUServer::HandleReadable, this, std::placeholders::_1));
+#else
 		SSUPacket * packet = new SSUPacket ();
 		m_Socket.async_receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V4), packet->from,
 			std::bind (&SSUServer::HandleReceivedFrom, this, std::placeholders::_1, std::placeholders::_2, packet));
+#endif
 	}
 
 	void SSUServer::ReceiveV6 ()
 	{
+#ifdef SSU_BATCHED_IO
+		m_SocketV6.async_receive (boost::asio::null_buffers (),
+			std::bind (&SSUServer::HandleReadableV6, this, std::placeholders::_1));
+#else
 		SSUPacket * packet = new SSUPacket ();
 		m_SocketV6.async_receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V6), packet->from,
 			std::bind (&SSUServer::HandleReceivedFromV6, this, std::placeholders::_1, std::placeholders::_2, packet));
+#endif
 	}
 
+#ifdef SSU_BATCHED_IO
+	int SSUServer::ReceivePackets (boost::asio::ip::udp::socket& socket, size_t mtu,
+		std::vector<SSUPacket *>& sparePackets, std::vector<SSUPacket *>& packets)
+	{
+		while (sparePackets.size () < SSU_MAX_NUM_RECEIVED_PACKETS)
+			sparePackets.push_back (new SSUPacket ());
+		mmsghdr msgs[SSU_MAX_NUM_RECEIVED_PACKETS];
+		iovec iovs[SSU_MAX_NUM_RECEIVED_PACKETS];
+		memset (msgs, 0, sizeof (msgs));
+		for (size_t i = 0; i < SSU_MAX_NUM_RECEIVED_PACKETS; i++)
+		{
+			auto packet = sparePackets[i];
+			iovs[i].iov_base = packet->buf;
+			iovs[i].iov_len = mtu;
+			msgs[i].msg_hdr.msg_name = packet->from.data ();
+			msgs[i].msg_hdr.msg_namelen = packet->from.capacity ();
+			msgs[i].msg_hdr.msg_iov = iovs + i;
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		int num = recvmmsg (socket.native_handle (), msgs, SSU_MAX_NUM_RECEIVED_PACKETS, MSG_DONTWAIT, nullptr);
+		if (num < 0) return errno;
+		for (int i = 0; i < num; i++)
+		{
+			auto packet = sparePackets[i];
+			packet->len = msgs[i].msg_len;
+			packet->from.resize (msgs[i].msg_hdr.msg_namelen);
+			packets.push_back (packet);
+		}
+		sparePackets.erase (sparePackets.begin (), sparePackets.begin () + num); // passed to HandleReceivedPackets
+		return 0;
+	}
+
+	void SSUServer::HandleReadable (const boost::system::error_code& ecode)
+	{
+		if (ecode == boost::asio::error::operation_aborted) return;
+		if (!ecode)
+		{
+			std::vector<SSUPacket *> packets;
+			int err = ReceivePackets (m_Socket, SSU_MTU_V4, m_SparePackets, packets);
+			if (!packets.empty ())
+				m_Service.post (std::bind (&SSUServer::HandleReceivedPackets, this, packets, &m_Sessions));
+			if (!err || err == EAGAIN || err == EWOULDBLOCK || err == EINTR)
+			{
+				Receive ();
+				return;
+			}
+			LogPrint (eLogError, "SSU: recvmmsg error: ", strerror (err));
+		}
+		else
+			LogPrint (eLogError, "SSU: receive error: ", ecode.message ());
+		m_Socket.close ();
+		OpenSocket ();
+		Receive ();
+	}
+
+	void SSUServer::HandleReadableV6 (const boost::system::error_code& ecode)
+	{
+		if (ecode == boost::asio::error::operation_aborted) return;
+		if (!ecode)
+		{
+			std::vector<SSUPacket *> packets;
+			int err = ReceivePackets (m_SocketV6, SSU_MTU_V6, m_SparePacketsV6, packets);
+			if (!packets.empty ())
+				m_ServiceV6.post (std::bind (&SSUServer::HandleReceivedPackets, this, packets, &m_SessionsV6));
+			if (!err || err == EAGAIN || err == EWOULDBLOCK || err == EINTR)
+			{
+				ReceiveV6 ();
+				return;
+			}
+			LogPrint (eLogError, "SSU: v6 recvmmsg error: ", strerror (err));
+		}
+		else
+			LogPrint (eLogError, "SSU: v6 receive error: ", ecode.message ());
+		m_SocketV6.close ();
+		OpenSocketV6 ();
+		ReceiveV6 ();
+	}
+#endif
+
 	void SSUServer::HandleReceivedFrom (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet)
 	{
 		if (!ecode)
@@ -236,7 +379,7 @@ namespace transport
 			size_t moreBytes = m_Socket.available(ec);
 			if (!ec)
 			{
-				while (moreBytes && packets.size () < 25)
+				while (moreBytes && packets.size () < SSU_MAX_NUM_RECEIVED_PACKETS)
 				{
 					packet = new SSUPacket ();
 					packet->len = m_Socket.receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V4), packet->from, 0, ec);
@@ -283,7 +426,7 @@ namespace transport
 			size_t moreBytes = m_SocketV6.available (ec);
 			if (!ec)
 			{
-				while (moreBytes && packets.size () < 25)
+				while (moreBytes && packets.size () < SSU_MAX_NUM_RECEIVED_PACKETS)
 				{
 					packet = new SSUPacket ();
 					packet->len = m_SocketV6.receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V6), packet->from, 0, ec);
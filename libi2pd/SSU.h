@@ -8,6 +8,7 @@
 #include <set>
 #include <thread>
 #include <mutex>
+#include <vector>
 #include <boost/asio.hpp>
 #include "Crypto.h"
 #include "I2PEndian.h"
@@ -16,6 +17,10 @@
 #include "I2NPProtocol.h"
 #include "SSUSession.h"
 
+#if defined(__linux__)
+#define SSU_BATCHED_IO 1 // recvmmsg/sendmmsg
+#endif
+
 namespace i2p
 {
 namespace transport
@@ -27,6 +32,8 @@ namespace transport
 	const size_t SSU_MAX_NUM_INTRODUCERS = 3;
 	const size_t SSU_SOCKET_RECEIVE_BUFFER_SIZE = 0x1FFFF; // 128K
 	const size_t SSU_SOCKET_SEND_BUFFER_SIZE = 0x1FFFF; // 128K
+	const size_t SSU_MAX_NUM_RECEIVED_PACKETS = 25; // per receive call
+	const size_t SSU_MAX_NUM_SENT_PACKETS = 64; // per sendmmsg call
 
 	struct SSUPacket
 	{
@@ -59,6 +66,7 @@ namespace transport
 			boost::asio::io_service& GetServiceV6 () { return m_ServiceV6; };
 			const boost::asio::ip::udp::endpoint& GetEndpoint () const { return m_Endpoint; };
 			void Send (const uint8_t * buf, size_t len, const boost::asio::ip::udp::endpoint& to);
+			void Send (const std::vector<boost::asio::const_buffer>& bufs, const boost::asio::ip::udp::endpoint& to); // single syscall if possible
 			void AddRelay (uint32_t tag, std::shared_ptr<SSUSession> relay);
 			void RemoveRelay (uint32_t tag);
 			std::shared_ptr<SSUSession> FindRelaySession (uint32_t tag);
@@ -81,6 +89,12 @@ namespace transport
 			void ReceiveV6 ();
 			void HandleReceivedFrom (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet);
 			void HandleReceivedFromV6 (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet);
+#ifdef SSU_BATCHED_IO
+			void HandleReadable (const boost::system::error_code& ecode);
+			void HandleReadableV6 (const boost::system::error_code& ecode);
+			int ReceivePackets (boost::asio::ip::udp::socket& socket, size_t mtu,
+				std::vector<SSUPacket *>& sparePackets, std::vector<SSUPacket *>& packets); // errno if failed
+#endif
 			void HandleReceivedPackets (std::vector<SSUPacket *> packets,
 				std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession> >* sessions);
 
@@ -125,6 +139,9 @@ namespace transport
 			std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession> > m_Sessions, m_SessionsV6;
 			std::map<uint32_t, std::shared_ptr<SSUSession> > m_Relays; // we are introducer
 			std::map<uint32_t, PeerTest> m_PeerTests; // nonce -> creation time in milliseconds
+#ifdef SSU_BATCHED_IO
+			std::vector<SSUPacket *> m_SparePackets, m_SparePacketsV6; // not filled by last recvmmsg
+#endif
 
 		public:
 			// for HTTP only
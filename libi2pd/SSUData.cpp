@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <algorithm>
 #include <boost/bind.hpp>
 #include "Log.h"
 #include "Timestamp.h"
@@ -27,11 +28,45 @@ namespace transport
 		nextFragmentNum++;
 	}
 
+	SSUAIMDCongestionControl::SSUAIMDCongestionControl ():
+		m_Window (SSU_INITIAL_WINDOW), m_SlowStartThreshold (SSU_MAX_WINDOW), m_NumAcked (0), m_LastDecreaseTime (0)
+	{
+	}
+
+	void SSUAIMDCongestionControl::OnAck (int numFragments)
+	{
+		if (m_Window < m_SlowStartThreshold)
+			m_Window += numFragments; // slow start
+		else
+		{
+			// congestion avoidance
+			m_NumAcked += numFragments;
+			if (m_NumAcked >= m_Window)
+			{
+				m_NumAcked -= m_Window;
+				m_Window++;
+			}
+		}
+		if (m_Window > SSU_MAX_WINDOW) m_Window = SSU_MAX_WINDOW;
+	}
+
+	void SSUAIMDCongestionControl::OnLoss (uint64_t ts, int rtt, bool isTimeout)
+	{
+		// losses of the same round trip are one congestion event
+		if (ts < m_LastDecreaseTime + (rtt ? rtt : SSU_INITIAL_RTO)) return;
+		m_LastDecreaseTime = ts;
+		m_SlowStartThreshold = std::max (m_Window/2, SSU_MIN_WINDOW);
+		m_Window = isTimeout ? SSU_MIN_WINDOW : m_SlowStartThreshold;
+		m_NumAcked = 0;
+	}
+
 	SSUData::SSUData (SSUSession& session):
 		m_Session (session), m_ResendTimer (session.GetService ()),
 		m_IncompleteMessagesCleanupTimer (session.GetService ()),
 		m_MaxPacketSize (session.IsV6 () ? SSU_V6_MAX_PACKET_SIZE : SSU_V4_MAX_PACKET_SIZE),
-		m_PacketSize (m_MaxPacketSize), m_LastMessageReceivedTime (0)
+		m_PacketSize (m_MaxPacketSize), m_LastMessageReceivedTime (0),
+		m_RTT (0), m_RTTVar (0), m_RTO (SSU_INITIAL_RTO), m_NextResendTime (0),
+		m_CongestionControl (new SSUAIMDCongestionControl ()), m_NumInFlight (0)
 	{
 	}
 
@@ -47,10 +82,16 @@ namespace transport
 	void SSUData::Stop ()
 	{
 		m_ResendTimer.cancel ();
+		m_NextResendTime = 0;
 		m_IncompleteMessagesCleanupTimer.cancel ();
 		m_IncompleteMessages.clear ();
 		m_SentMessages.clear ();
 		m_ReceivedMessages.clear ();
+		m_SendBatch.clear ();
+		m_AckBuffers.clear ();
+		m_RetransmitBuffers.clear ();
+		m_SendQueue.clear ();
+		m_NumInFlight = 0;
 	}
 
 	void SSUData::AdjustPacketSize (std::shared_ptr<const i2p::data::RouterInfo> remoteRouter)
@@ -91,12 +132,80 @@ namespace transport
 		auto it = m_SentMessages.find (msgID);
 		if (it != m_SentMessages.end ())
 		{
+			auto ts = i2p::util::GetMillisecondsSinceEpoch ();
+			UpdateRTT (ts, *it->second);
+			int numAcked = 0;
+			for (const auto& f: it->second->fragments)
+				if (f.len) numAcked++;
+			m_NumInFlight -= numAcked;
+			m_CongestionControl->OnAck (numAcked);
 			m_SentMessages.erase (it);
 			if (m_SentMessages.empty ())
+			{
 				m_ResendTimer.cancel ();
+				m_NextResendTime = 0;
+			}
 		}
 	}
 
+	void SSUData::ProcessSentFragmentsAck (SentMessage& sentMessage, const uint64_t * acked)
+	{
+		auto& fragments = sentMessage.fragments;
+		int numFragments = fragments.size (), lastAcked = -1, numAcked = 0;
+		for (int i = 0; i < numFragments; i++)
+			if (acked[i >> 6] & ((uint64_t)1 << (i & 0x3F)))
+			{
+				if (fragments[i].len)
+				{
+					fragments[i].len = 0;
+					numAcked++;
+				}
+				lastAcked = i;
+			}
+		if (lastAcked < 0) return;
+		auto ts = i2p::util::GetMillisecondsSinceEpoch ();
+		UpdateRTT (ts, sentMessage);
+		if (numAcked)
+		{
+			m_NumInFlight -= numAcked;
+			m_CongestionControl->OnAck (numAcked);
+		}
+		// fragments sent before acked one are likely lost, don't wait for resend timer
+		for (int i = 0; i < lastAcked; i++)
+			if (fragments[i].len && ++sentMessage.numNacks[i] >= SSU_FAST_RETRANSMIT_NACKS)
+			{
+				LogPrint (eLogDebug, "SSU: fast retransmit of fragment ", i);
+				const auto& fragment = fragments[i];
+				m_RetransmitBuffers.emplace_back (fragment.fragmentNum, fragment.buf, fragment.len, fragment.isLast);
+				m_SendBatch.push_back (boost::asio::buffer (m_RetransmitBuffers.back ().buf, fragment.len));
+				sentMessage.numNacks[i] = 0;
+				sentMessage.sendTime = 0; // ambiguous now
+				m_CongestionControl->OnLoss (ts, m_RTT, false);
+			}
+	}
+
+	void SSUData::UpdateRTT (uint64_t ts, SentMessage& sentMessage)
+	{
+		// sample once per message and never for resent messages, since we can't tell which copy is acked
+		if (!sentMessage.sendTime) return;
+		int rtt = ts > sentMessage.sendTime ? ts - sentMessage.sendTime : 0;
+		sentMessage.sendTime = 0;
+		if (!m_RTT)
+		{
+			m_RTT = rtt;
+			m_RTTVar = rtt/2;
+		}
+		else
+		{
+			m_RTTVar = (3*m_RTTVar + std::abs (m_RTT - rtt))/4;
+			m_RTT = (7*m_RTT + rtt)/8;
+		}
+		if (!m_RTT) m_RTT = 1; // known
+		m_RTO = m_RTT + 4*m_RTTVar;
+		if (m_RTO < SSU_MIN_RTO) m_RTO = SSU_MIN_RTO;
+		if (m_RTO > SSU_MAX_RTO) m_RTO = SSU_MAX_RTO;
+	}
+
 	void SSUData::ProcessAcks (uint8_t *& buf, uint8_t flag)
 	{
 		if (flag & DATA_FLAG_EXPLICIT_ACKS_INCLUDED)
@@ -117,8 +226,8 @@ namespace transport
 			{
 				uint32_t msgID = bufbe32toh (buf);
 				buf += 4; // msgID
-				auto it = m_SentMessages.find (msgID);
-				// process individual Ack bitfields
+				// collect individual Ack bitfields, 7 fragments per byte
+				uint64_t acked[SSU_MAX_NUM_FRAGMENTS/64] = { 0 };
 				bool isNonLast = false;
 				int fragment = 0;
 				do
@@ -126,25 +235,16 @@ namespace transport
 					uint8_t bitfield = *buf;
 					isNonLast = bitfield & 0x80;
 					bitfield &= 0x7F; // clear MSB
-					if (bitfield && it != m_SentMessages.end ())
-					{
-						int numSentFragments = it->second->fragments.size ();
-						// process bits
-						uint8_t mask = 0x01;
-						for (int j = 0; j < 7; j++)
-						{
-							if (bitfield & mask)
-							{
-								if (fragment < numSentFragments)
-									it->second->fragments[fragment].reset (nullptr);
-							}
-							fragment++;
-							mask <<= 1;
-						}
-					}
+					for (int j = 0; j < 7 && bitfield; j++, bitfield >>= 1)
+						if ((bitfield & 0x01) && fragment + j < SSU_MAX_NUM_FRAGMENTS)
+							acked[(fragment + j) >> 6] |= (uint64_t)1 << ((fragment + j) & 0x3F);
+					fragment += 7;
 					buf++;
 				}
 				while (isNonLast);
+				auto it = m_SentMessages.find (msgID);
+				if (it != m_SentMessages.end ())
+					ProcessSentFragmentsAck (*it->second, acked);
 			}
 		}
 	}
@@ -187,20 +287,16 @@ namespace transport
 			{
 				// expected fragment
 				incompleteMessage->AttachNextFragment (buf, fragmentSize);
-				if (!isLast && !incompleteMessage->savedFragments.empty ())
+				auto& savedFragments = incompleteMessage->savedFragments;
+				if (!isLast && !savedFragments.empty ())
 				{
 					// try saved fragments
-					for (auto it1 = incompleteMessage->savedFragments.begin (); it1 != incompleteMessage->savedFragments.end ();)
+					while (incompleteMessage->nextFragmentNum < (int)savedFragments.size () &&
+						savedFragments[incompleteMessage->nextFragmentNum])
 					{
-						auto& savedFragment = *it1;
-						if (savedFragment->fragmentNum == incompleteMessage->nextFragmentNum)
-						{
-							incompleteMessage->AttachNextFragment (savedFragment->buf, savedFragment->len);
-							isLast = savedFragment->isLast;
-							incompleteMessage->savedFragments.erase (it1++);
-						}
-						else
-							break;
+						std::unique_ptr<Fragment> savedFragment (std::move (savedFragments[incompleteMessage->nextFragmentNum]));
+						incompleteMessage->AttachNextFragment (savedFragment->buf, savedFragment->len);
+						isLast = savedFragment->isLast;
 					}
 					if (isLast)
 						LogPrint (eLogDebug, "SSU: Message ", msgID, " complete");
@@ -215,9 +311,14 @@ namespace transport
 				{
 					// missing fragment
 					LogPrint (eLogWarning, "SSU: Missing fragments from ", (int)incompleteMessage->nextFragmentNum, " to ", fragmentNum - 1, " of message ", msgID);
-					auto savedFragment = new Fragment (fragmentNum, buf, fragmentSize, isLast);
-					if (incompleteMessage->savedFragments.insert (std::unique_ptr<Fragment>(savedFragment)).second)
+					auto& savedFragments = incompleteMessage->savedFragments;
+					if (fragmentNum >= savedFragments.size ())
+						savedFragments.resize (fragmentNum + 1);
+					if (!savedFragments[fragmentNum])
+					{
+						savedFragments[fragmentNum].reset (new Fragment (fragmentNum, buf, fragmentSize, isLast));
 						incompleteMessage->lastFragmentInsertTime = i2p::util::GetSecondsSinceEpoch ();
+					}
 					else
 						LogPrint (eLogWarning, "SSU: Fragment ", (int)fragmentNum, " of message ", msgID, " already saved");
 				}
@@ -272,6 +373,7 @@ namespace transport
 
 	void SSUData::FlushReceivedMessage ()
 	{
+		FlushSendBatch (); // acks
 		m_Handler.Flush ();
 	}
 
@@ -284,6 +386,13 @@ namespace transport
 		// process acks if presented
 		if (flag & (DATA_FLAG_ACK_BITFIELDS_INCLUDED | DATA_FLAG_EXPLICIT_ACKS_INCLUDED))
 			ProcessAcks (buf, flag);
+		if (flag & DATA_FLAG_EXPLICIT_CONGESTION_NOTIFICATION)
+		{
+			LogPrint (eLogDebug, "SSU: congestion notification received");
+			m_CongestionControl->OnLoss (i2p::util::GetMillisecondsSinceEpoch (), m_RTT, false);
+		}
+		if (!m_SendQueue.empty ())
+			SendQueuedMessages (); // acks might open window, sent with acks by FlushReceivedMessage
 		// extended data if presented
 		if (flag & DATA_FLAG_EXTENDED_DATA_INCLUDED)
 		{
@@ -297,6 +406,39 @@ namespace transport
 	}
 
 	void SSUData::Send (std::shared_ptr<i2p::I2NPMessage> msg)
+	{
+		if (m_SendQueue.empty () && (!m_NumInFlight ||
+			m_NumInFlight + GetNumFragments (msg) <= m_CongestionControl->GetWindow ()))
+			SendMessage (msg);
+		else if (m_SendQueue.size () < SSU_MAX_SEND_QUEUE_SIZE)
+			m_SendQueue.push_back (msg);
+		else
+			LogPrint (eLogWarning, "SSU: send queue exceeds ", SSU_MAX_SEND_QUEUE_SIZE, " messages, dropped");
+	}
+
+	void SSUData::SendQueuedMessages ()
+	{
+		while (!m_SendQueue.empty () && (!m_NumInFlight ||
+			m_NumInFlight + GetNumFragments (m_SendQueue.front ()) <= m_CongestionControl->GetWindow ()))
+		{
+			SendMessage (m_SendQueue.front ());
+			m_SendQueue.pop_front ();
+		}
+	}
+
+	int SSUData::GetNumFragments (std::shared_ptr<i2p::I2NPMessage> msg) const
+	{
+		int payloadSize = m_PacketSize - sizeof (SSUHeader) - 9;
+		int num = (msg->GetLength () + payloadSize - 1)/payloadSize; // ToSSU makes header shorter
+		return num < SSU_MAX_NUM_FRAGMENTS ? num : SSU_MAX_NUM_FRAGMENTS;
+	}
+
+	uint64_t SSUData::GetPacingRate () const
+	{
+		return (uint64_t)GetCongestionWindow ()*m_PacketSize*1000/(m_RTT ? m_RTT : SSU_INITIAL_RTO);
+	}
+
+	void SSUData::SendMessage (std::shared_ptr<i2p::I2NPMessage> msg)
 	{
 		uint32_t msgID = msg->ToSSU ();
 		if (m_SentMessages.count (msgID) > 0)
@@ -304,27 +446,30 @@ namespace transport
 			LogPrint (eLogWarning, "SSU: message ", msgID, " already sent");
 			return;
 		}
-		if (m_SentMessages.empty ()) // schedule resend at first message only
-			ScheduleResend ();
-
 		auto ret = m_SentMessages.insert (std::make_pair (msgID, std::unique_ptr<SentMessage>(new SentMessage)));
 		std::unique_ptr<SentMessage>& sentMessage = ret.first->second;
 		if (ret.second)
 		{
-			sentMessage->nextResendTime = i2p::util::GetSecondsSinceEpoch () + RESEND_INTERVAL;
+			sentMessage->sendTime = i2p::util::GetMillisecondsSinceEpoch ();
+			sentMessage->nextResendTime = sentMessage->sendTime + m_RTO;
 			sentMessage->numResends = 0;
 		}
+		// timer is set to the earliest resend, RTO might be shorter now
+		if (!m_NextResendTime || sentMessage->nextResendTime < m_NextResendTime)
+			ScheduleResend (sentMessage->nextResendTime);
 		auto& fragments = sentMessage->fragments;
 		size_t payloadSize = m_PacketSize - sizeof (SSUHeader) - 9; // 9  =  flag + #frg(1) + messageID(4) + frag info (3)
 		size_t len = msg->GetLength ();
 		uint8_t * msgBuf = msg->GetSSUHeader ();
 
+		fragments.reserve (GetNumFragments (msg)); // one allocation per message
 		uint32_t fragmentNum = 0;
 		while (len > 0 && fragmentNum <= 127)
 		{
-			Fragment * fragment = new Fragment;
-			fragment->fragmentNum = fragmentNum;
-			uint8_t * buf = fragment->buf;
+			fragments.emplace_back ();
+			auto& fragment = fragments.back ();
+			fragment.fragmentNum = fragmentNum;
+			uint8_t * buf = fragment.buf;
 			uint8_t	* payload = buf + sizeof (SSUHeader);
 			*payload = DATA_FLAG_WANT_REPLY; // for compatibility
 			payload++;
@@ -347,19 +492,11 @@ namespace transport
 			size += payload - buf;
 			if (size & 0x0F) // make sure 16 bytes boundary
 				size = ((size >> 4) + 1) << 4; // (/16 + 1)*16
-			fragment->len = size;
-			fragments.push_back (std::unique_ptr<Fragment> (fragment));
+			fragment.len = size;
+			fragment.isLast = isLast;
 
 			// encrypt message with session key
 			m_Session.FillHeaderAndEncrypt (PAYLOAD_TYPE_DATA, buf, size);
-			try
-			{
-				m_Session.Send (buf, size);
-			}
-			catch (boost::system::system_error& ec)
-			{
-				LogPrint (eLogWarning, "SSU: Can't send data fragment ", ec.what ());
-			}
 			if (!isLast)
 			{
 				len -= payloadSize;
@@ -369,11 +506,17 @@ namespace transport
 				len = 0;
 			fragmentNum++;
 		}
+		for (const auto& it: fragments) // after all are added, since vector might grow
+			m_SendBatch.push_back (boost::asio::buffer (it.buf, it.len));
+		sentMessage->numNacks.resize (fragments.size (), 0);
+		m_NumInFlight += fragments.size ();
 	}
 
 	void SSUData::SendMsgAck (uint32_t msgID)
 	{
-		uint8_t buf[48 + 18] = {0}; // actual length is 44 = 37 + 7 but pad it to multiple of 16
+		m_AckBuffers.emplace_back ();
+		uint8_t * buf = m_AckBuffers.back ().data (); // actual length is 44 = 37 + 7 but pad it to multiple of 16
+		memset (buf, 0, 48 + 18);
 		uint8_t * payload = buf + sizeof (SSUHeader);
 		*payload = DATA_FLAG_EXPLICIT_ACKS_INCLUDED; // flag
 		payload++;
@@ -385,7 +528,7 @@ namespace transport
 
 		// encrypt message with session key
 		m_Session.FillHeaderAndEncrypt (PAYLOAD_TYPE_DATA, buf, 48);
-		m_Session.Send (buf, 48);
+		m_SendBatch.push_back (boost::asio::buffer (buf, 48));
 	}
 
 	void SSUData::SendFragmentAck (uint32_t msgID, int fragmentNum)
@@ -395,7 +538,9 @@ namespace transport
 			LogPrint (eLogWarning, "SSU: Fragment number ", fragmentNum, " exceeds 64");
 			return;
 		}
-		uint8_t buf[64 + 18] = {0};
+		m_AckBuffers.emplace_back ();
+		uint8_t * buf = m_AckBuffers.back ().data ();
+		memset (buf, 0, 64 + 18);
 		uint8_t * payload = buf + sizeof (SSUHeader);
 		*payload = DATA_FLAG_ACK_BITFIELDS_INCLUDED; // flag
 		payload++;
@@ -414,13 +559,31 @@ namespace transport
 		size_t len = d.quot < 4 ? 48 : 64; // 48 = 37 + 7 + 4 (3+1)
 		// encrypt message with session key
 		m_Session.FillHeaderAndEncrypt (PAYLOAD_TYPE_DATA, buf, len);
-		m_Session.Send (buf, len);
+		m_SendBatch.push_back (boost::asio::buffer (buf, len));
+	}
+
+	void SSUData::FlushSendBatch ()
+	{
+		if (m_SendBatch.empty ()) return;
+		try
+		{
+			m_Session.Send (m_SendBatch);
+		}
+		catch (boost::system::system_error& ec)
+		{
+			LogPrint (eLogWarning, "SSU: Can't send ", m_SendBatch.size (), " data packets ", ec.what ());
+		}
+		m_SendBatch.clear ();
+		m_AckBuffers.clear ();
+		m_RetransmitBuffers.clear ();
 	}
 
-	void SSUData::ScheduleResend()
+	void SSUData::ScheduleResend (uint64_t ts)
 	{
 		m_ResendTimer.cancel ();
-		m_ResendTimer.expires_from_now (boost::posix_time::seconds(RESEND_INTERVAL));
+		m_NextResendTime = ts;
+		auto now = i2p::util::GetMillisecondsSinceEpoch ();
+		m_ResendTimer.expires_from_now (boost::posix_time::milliseconds(ts > now ? ts - now : 0));
 		auto s = m_Session.shared_from_this();
 		m_ResendTimer.async_wait ([s](const boost::system::error_code& ecode)
 			{ s->m_Data.HandleResendTimer (ecode); });
@@ -430,49 +593,54 @@ namespace transport
 	{
 		if (ecode != boost::asio::error::operation_aborted)
 		{
-			uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
+			m_NextResendTime = 0; // not scheduled
+			uint64_t ts = i2p::util::GetMillisecondsSinceEpoch (), nextResendTime = 0;
 			int numResent = 0;
 			for (auto it = m_SentMessages.begin (); it != m_SentMessages.end ();)
 			{
-				if (ts >= it->second->nextResendTime)
+				auto& sentMessage = it->second;
+				if (ts >= sentMessage->nextResendTime)
 				{
-					if (it->second->numResends < MAX_NUM_RESENDS)
+					if (sentMessage->numResends < MAX_NUM_RESENDS)
 					{
-						for (auto& f: it->second->fragments)
-							if (f)
+						auto& fragments = sentMessage->fragments;
+						for (size_t i = 0; i < fragments.size (); i++)
+							if (fragments[i].len)
 							{
-								try
-								{
-									m_Session.Send (f->buf, f->len); // resend
-									numResent++;
-								}
-								catch (boost::system::system_error& ec)
-								{
-									LogPrint (eLogWarning, "SSU: Can't resend data fragment ", ec.what ());
-								}
+								m_SendBatch.push_back (boost::asio::buffer (fragments[i].buf, fragments[i].len)); // resend, flushed below
+								sentMessage->numNacks[i] = 0;
+								numResent++;
 							}
-
-						it->second->numResends++;
-						it->second->nextResendTime += it->second->numResends*RESEND_INTERVAL;
-						++it;
+						sentMessage->numResends++;
+						sentMessage->sendTime = 0; // no RTT sample from resent message
+						// exponential backoff
+						sentMessage->nextResendTime = ts + std::min ((int64_t)m_RTO << sentMessage->numResends, (int64_t)SSU_MAX_RTO);
 					}
 					else
 					{
 						LogPrint (eLogInfo, "SSU: message has not been ACKed after ", MAX_NUM_RESENDS, " attempts, deleted");
+						for (const auto& f: sentMessage->fragments)
+							if (f.len) m_NumInFlight--;
 						it = m_SentMessages.erase (it);
+						continue;
 					}
 				}
-				else
-					++it;
+				if (!nextResendTime || sentMessage->nextResendTime < nextResendTime)
+					nextResendTime = sentMessage->nextResendTime;
+				++it;
 			}
-			if (m_SentMessages.empty ()) return; // nothing to resend
-			if (numResent < MAX_OUTGOING_WINDOW_SIZE)
-				ScheduleResend ();
-			else
+			if (numResent)
+				m_CongestionControl->OnLoss (ts, m_RTO, true);
+			SendQueuedMessages (); // deleted messages might open window
+			FlushSendBatch ();
+			if (numResent >= MAX_OUTGOING_WINDOW_SIZE)
 			{
 				LogPrint (eLogError, "SSU: resend window exceeds max size. Session terminated");
 				m_Session.Close ();
+				return;
 			}
+			if (nextResendTime && (!m_NextResendTime || nextResendTime < m_NextResendTime))
+				ScheduleResend (nextResendTime); // unless queued messages have scheduled it already
 		}
 	}
 
@@ -3,8 +3,10 @@
 
 #include <inttypes.h>
 #include <string.h>
-#include <map>
+#include <unordered_map>
 #include <vector>
+#include <deque>
+#include <array>
 #include <unordered_set>
 #include <memory>
 #include <boost/asio.hpp>
@@ -28,12 +30,20 @@ namespace transport
 	const size_t UDP_HEADER_SIZE = 8;
 	const size_t SSU_V4_MAX_PACKET_SIZE = SSU_MTU_V4 - IPV4_HEADER_SIZE - UDP_HEADER_SIZE; // 1456
 	const size_t SSU_V6_MAX_PACKET_SIZE = SSU_MTU_V6 - IPV6_HEADER_SIZE - UDP_HEADER_SIZE; // 1440
-	const int RESEND_INTERVAL = 3; // in seconds
+	const int SSU_INITIAL_RTO = 1000; // in milliseconds, until first RTT sample
+	const int SSU_MIN_RTO = 100; // in milliseconds
+	const int SSU_MAX_RTO = 10000; // in milliseconds, also limits backoff
+	const int SSU_FAST_RETRANSMIT_NACKS = 2; // resend fragment skipped by that many acks of later fragments
+	const int SSU_MAX_NUM_FRAGMENTS = 128; // 7 bits of fragment number
 	const int MAX_NUM_RESENDS = 5;
+	const int MAX_OUTGOING_WINDOW_SIZE = 200; // how many fragments we resend at once before closing session
 	const int DECAY_INTERVAL = 20; // in seconds
 	const int INCOMPLETE_MESSAGES_CLEANUP_TIMEOUT = 30; // in seconds
 	const unsigned int MAX_NUM_RECEIVED_MESSAGES = 1000; // how many msgID we store for duplicates check
-	const int MAX_OUTGOING_WINDOW_SIZE = 200; // how many unacked message we can store
+	const int SSU_MIN_WINDOW = 2; // congestion window in fragments
+	const int SSU_INITIAL_WINDOW = 16;
+	const int SSU_MAX_WINDOW = 1024;
+	const size_t SSU_MAX_SEND_QUEUE_SIZE = 500; // messages waiting for window
 	// data flags
 	const uint8_t DATA_FLAG_EXTENDED_DATA_INCLUDED = 0x02;
 	const uint8_t DATA_FLAG_WANT_REPLY = 0x04;
@@ -54,20 +64,12 @@ namespace transport
 			fragmentNum (n), len (l), isLast (last) { memcpy (buf, b, len); };
 	};
 
-	struct FragmentCmp
-	{
-		bool operator() (const std::unique_ptr<Fragment>& f1, const std::unique_ptr<Fragment>& f2) const
-		{
-			return f1->fragmentNum < f2->fragmentNum;
-		};
-	};
-
 	struct IncompleteMessage
 	{
 		std::shared_ptr<I2NPMessage> msg;
 		int nextFragmentNum;
 		uint32_t lastFragmentInsertTime; // in seconds
-		std::set<std::unique_ptr<Fragment>, FragmentCmp> savedFragments;
+		std::vector<std::unique_ptr<Fragment> > savedFragments; // out of order, indexed by fragment number
 
 		IncompleteMessage (std::shared_ptr<I2NPMessage> m): msg (m), nextFragmentNum (0), lastFragmentInsertTime (0) {};
 		void AttachNextFragment (const uint8_t * fragment, size_t fragmentSize);
@@ -75,11 +77,39 @@ namespace transport
 
 	struct SentMessage
 	{
-		std::vector<std::unique_ptr<Fragment> > fragments;
-		uint32_t nextResendTime; // in seconds
+		std::vector<Fragment> fragments; // indexed by fragment number, len is 0 if acked
+		std::vector<uint8_t> numNacks; // acks of later fragments since last send
+		uint64_t sendTime, nextResendTime; // in milliseconds
 		int numResends;
 	};
 
+	class SSUCongestionControl
+	{
+		// decides how many fragments might be unacked, window and rtt are in fragments and milliseconds
+		public:
+
+			virtual ~SSUCongestionControl () {};
+			virtual void OnAck (int numFragments) = 0;
+			virtual void OnLoss (uint64_t ts, int rtt, bool isTimeout) = 0; // resend or congestion notification
+			virtual int GetWindow () const = 0;
+	};
+
+	class SSUAIMDCongestionControl: public SSUCongestionControl
+	{
+		// slow start, then one fragment per window acked, halved at most once per round trip
+		public:
+
+			SSUAIMDCongestionControl ();
+			void OnAck (int numFragments);
+			void OnLoss (uint64_t ts, int rtt, bool isTimeout);
+			int GetWindow () const { return m_Window; };
+
+		private:
+
+			int m_Window, m_SlowStartThreshold, m_NumAcked;
+			uint64_t m_LastDecreaseTime;
+	};
+
 	class SSUSession;
 	class SSUData
 	{
@@ -93,20 +123,31 @@ namespace transport
 
 			void ProcessMessage (uint8_t * buf, size_t len);
 			void FlushReceivedMessage ();
-			void Send (std::shared_ptr<i2p::I2NPMessage> msg);
+			void Send (std::shared_ptr<i2p::I2NPMessage> msg); // queued until FlushSendBatch
+			void FlushSendBatch ();
 
 			void AdjustPacketSize (std::shared_ptr<const i2p::data::RouterInfo> remoteRouter);
 			void UpdatePacketSize (const i2p::data::IdentHash& remoteIdent);
 
+			int GetRTT () const { return m_RTT; }; // in milliseconds, 0 if unknown
+			int GetRTO () const { return m_RTO; };
+			int GetCongestionWindow () const { return m_CongestionControl->GetWindow (); }; // in fragments
+			uint64_t GetPacingRate () const; // bytes per second, window per round trip, reported only
+
 		private:
 
+			void SendMessage (std::shared_ptr<i2p::I2NPMessage> msg);
+			void SendQueuedMessages (); // as many as window allows
+			int GetNumFragments (std::shared_ptr<i2p::I2NPMessage> msg) const;
 			void SendMsgAck (uint32_t msgID);
 			void SendFragmentAck (uint32_t msgID, int fragmentNum);
 			void ProcessAcks (uint8_t *& buf, uint8_t flag);
 			void ProcessFragments (uint8_t * buf);
 			void ProcessSentMessageAck (uint32_t msgID);
+			void ProcessSentFragmentsAck (SentMessage& sentMessage, const uint64_t * acked);
+			void UpdateRTT (uint64_t ts, SentMessage& sentMessage);
 
-			void ScheduleResend ();
+			void ScheduleResend (uint64_t ts);
 			void HandleResendTimer (const boost::system::error_code& ecode);
 
 			void ScheduleIncompleteMessagesCleanup ();
@@ -116,13 +157,21 @@ namespace transport
 		private:
 
 			SSUSession& m_Session;
-			std::map<uint32_t, std::unique_ptr<IncompleteMessage> > m_IncompleteMessages;
-			std::map<uint32_t, std::unique_ptr<SentMessage> > m_SentMessages;
+			std::unordered_map<uint32_t, std::unique_ptr<IncompleteMessage> > m_IncompleteMessages;
+			std::unordered_map<uint32_t, std::unique_ptr<SentMessage> > m_SentMessages;
 			std::unordered_set<uint32_t> m_ReceivedMessages;
 			boost::asio::deadline_timer m_ResendTimer, m_IncompleteMessagesCleanupTimer;
 			int m_MaxPacketSize, m_PacketSize;
 			i2p::I2NPMessagesHandler m_Handler;
+			std::vector<boost::asio::const_buffer> m_SendBatch; // fragments and acks sent by one call
+			std::deque<std::array<uint8_t, 64 + 18> > m_AckBuffers; // for queued acks
+			std::deque<Fragment> m_RetransmitBuffers; // copies of fast retransmitted fragments, message might be acked before sending
 			uint32_t m_LastMessageReceivedTime; // in second
+			int m_RTT, m_RTTVar, m_RTO; // in milliseconds
+			uint64_t m_NextResendTime; // of scheduled timer in milliseconds, 0 if not scheduled
+			std::unique_ptr<SSUCongestionControl> m_CongestionControl;
+			int m_NumInFlight; // sent fragments not acked yet
+			std::deque<std::shared_ptr<i2p::I2NPMessage> > m_SendQueue; // waiting for window
 	};
 }
 }
@@ -343,6 +343,7 @@ namespace transport
 		if (m_SignedData && m_SignedData->Verify (m_RemoteIdentity, payload))
 		{
 			m_Data.Send (CreateDeliveryStatusMsg (0));
+			m_Data.FlushSendBatch ();
 			Established ();
 		}
 		else
@@ -921,11 +922,15 @@ namespace transport
 
 	void SSUSession::SendI2NPMessages (const std::vector<std::shared_ptr<I2NPMessage> >& msgs)
 	{
-		GetService ().post (std::bind (&SSUSession::PostI2NPMessages, shared_from_this (), msgs));
+		if (msgs.empty ()) return;
+		if (m_OutgoingQueue.Put (msgs)) // post once until the queue is drained
+			GetService ().post (std::bind (&SSUSession::PostI2NPMessages, shared_from_this ()));
 	}
 
-	void SSUSession::PostI2NPMessages (std::vector<std::shared_ptr<I2NPMessage> > msgs)
+	void SSUSession::PostI2NPMessages ()
 	{
+		std::vector<std::shared_ptr<I2NPMessage> > msgs;
+		m_OutgoingQueue.GetAll (msgs);
 		if (m_State == eSessionStateEstablished)
 		{
 			for (const auto& it: msgs)
@@ -936,6 +941,7 @@ namespace transport
 					else
 						LogPrint (eLogError, "SSU: I2NP message of size ", it->GetLength (), " can't be sent. Dropped");
 				}
+			m_Data.FlushSendBatch (); // fragments of all messages at once
 		}
 	}
 
@@ -1201,6 +1207,16 @@ namespace transport
 		i2p::transport::transports.UpdateSentBytes (size);
 		m_Server.Send (buf, size, m_RemoteEndpoint);
 	}
+
+	void SSUSession::Send (const std::vector<boost::asio::const_buffer>& bufs)
+	{
+		size_t size = 0;
+		for (const auto& it: bufs)
+			size += boost::asio::buffer_size (it);
+		m_NumSentBytes += size;
+		i2p::transport::transports.UpdateSentBytes (size);
+		m_Server.Send (bufs, m_RemoteEndpoint);
+	}
 }
 }
 
@@ -93,6 +93,7 @@ namespace transport
 			uint32_t GetRelayTag () const { return m_RelayTag; };
 			const i2p::data::RouterInfo::IntroKey& GetIntroKey () const { return m_IntroKey; };
 			uint32_t GetCreationTime () const { return m_CreationTime; };
+			const SSUData& GetData () const { return m_Data; }; // for HTTP only
 
 			void FlushData ();
 
@@ -101,7 +102,7 @@ namespace transport
 			boost::asio::io_service& GetService ();
 			void CreateAESandMacKey (const uint8_t * pubKey);
 			size_t GetSSUHeaderSize (const uint8_t * buf) const;
-			void PostI2NPMessages (std::vector<std::shared_ptr<I2NPMessage> > msgs);
+			void PostI2NPMessages ();
 			void ProcessMessage (uint8_t * buf, size_t len, const boost::asio::ip::udp::endpoint& senderEndpoint); // call for established session
 			void ProcessSessionRequest (const uint8_t * buf, size_t len, const boost::asio::ip::udp::endpoint& senderEndpoint);
 			void SendSessionRequest ();
@@ -125,6 +126,7 @@ namespace transport
 			void SendSessionDestroyed ();
 			void Send (uint8_t type, const uint8_t * payload, size_t len); // with session key
 			void Send (const uint8_t * buf, size_t size);
+			void Send (const std::vector<boost::asio::const_buffer>& bufs);
 
 			void FillHeaderAndEncrypt (uint8_t payloadType, uint8_t * buf, size_t len, const i2p::crypto::AESKey& aesKey,
 				const uint8_t * iv, const i2p::crypto::MACKey& macKey, uint8_t flag = 0);
@@ -25,29 +25,53 @@ namespace tunnel
 		i2p::transport::transports.UpdateTotalTransitTransmittedBytes (TUNNEL_DATA_MSG_SIZE);
 	}
 
+	void TransitTunnel::EncryptTunnelMsgs (const std::vector<std::shared_ptr<const I2NPMessage> >& in,
+		std::vector<std::shared_ptr<I2NPMessage> >& out)
+	{
+		const int batchSize = 8;
+		const uint8_t * inBufs[batchSize];
+		uint8_t * outBufs[batchSize];
+		size_t num = in.size ();
+		for (size_t i = 0; i < num; i += batchSize)
+		{
+			int n = std::min (num - i, (size_t)batchSize);
+			for (int j = 0; j < n; j++)
+			{
+				auto newMsg = CreateEmptyTunnelDataMsg ();
+				inBufs[j] = in[i + j]->GetPayload () + 4;
+				outBufs[j] = newMsg->GetPayload () + 4;
+				out.push_back (newMsg);
+			}
+			m_Encryption.Encrypt (n, inBufs, outBufs);
+		}
+		i2p::transport::transports.UpdateTotalTransitTransmittedBytes (num*TUNNEL_DATA_MSG_SIZE);
+	}
+
 	TransitTunnelParticipant::~TransitTunnelParticipant ()
 	{
 	}
 
 	void TransitTunnelParticipant::HandleTunnelDataMsg (std::shared_ptr<const i2p::I2NPMessage> tunnelMsg)
 	{
-		auto newMsg = CreateEmptyTunnelDataMsg ();
-		EncryptTunnelMsg (tunnelMsg, newMsg);
-
 		m_NumTransmittedBytes += tunnelMsg->GetLength ();
-		htobe32buf (newMsg->GetPayload (), GetNextTunnelID ());
-		newMsg->FillI2NPMessageHeader (eI2NPTunnelData);
-		m_TunnelDataMsgs.push_back (newMsg);
+		m_ReceivedTunnelDataMsgs.push_back (tunnelMsg);
 	}
 
-	void TransitTunnelParticipant::FlushTunnelDataMsgs ()
+	void TransitTunnelParticipant::FlushTunnelDataMsgs (TunnelTransportSender& sender)
 	{
-		if (!m_TunnelDataMsgs.empty ())
+		if (!m_ReceivedTunnelDataMsgs.empty ())
 		{
+			EncryptTunnelMsgs (m_ReceivedTunnelDataMsgs, m_TunnelDataMsgs);
+			m_ReceivedTunnelDataMsgs.clear ();
+			for (auto& it: m_TunnelDataMsgs)
+			{
+				htobe32buf (it->GetPayload (), GetNextTunnelID ());
+				it->FillI2NPMessageHeader (eI2NPTunnelData);
+			}
 			auto num = m_TunnelDataMsgs.size ();
 			if (num > 1)
 				LogPrint (eLogDebug, "TransitTunnel: ", GetTunnelID (), "->", GetNextTunnelID (), " ", num);
-			i2p::transport::transports.SendMessages (GetNextIdentHash (), m_TunnelDataMsgs);
+			sender.PutTunnelDataMsgs (GetNextIdentHash (), m_TunnelDataMsgs);
 			m_TunnelDataMsgs.clear ();
 		}
 	}
@@ -71,10 +95,10 @@ namespace tunnel
 		m_Gateway.PutTunnelDataMsg (block);
 	}
 
-	void TransitTunnelGateway::FlushTunnelDataMsgs ()
+	void TransitTunnelGateway::FlushTunnelDataMsgs (TunnelTransportSender& sender)
 	{
 		std::unique_lock<std::mutex> l(m_SendMutex);
-		m_Gateway.SendBuffer ();
+		m_Gateway.SendBuffer (sender);
 	}
 
 	void TransitTunnelEndpoint::HandleTunnelDataMsg (std::shared_ptr<const i2p::I2NPMessage> tunnelMsg)
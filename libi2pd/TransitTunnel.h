@@ -29,6 +29,12 @@ namespace tunnel
 			void SendTunnelDataMsg (std::shared_ptr<i2p::I2NPMessage> msg);
 			void HandleTunnelDataMsg (std::shared_ptr<const i2p::I2NPMessage> tunnelMsg);
 			void EncryptTunnelMsg (std::shared_ptr<const I2NPMessage> in, std::shared_ptr<I2NPMessage> out);
+
+		protected:
+
+			void EncryptTunnelMsgs (const std::vector<std::shared_ptr<const I2NPMessage> >& in,
+				std::vector<std::shared_ptr<I2NPMessage> >& out); // appends to out
+
 		private:
 
 			i2p::crypto::TunnelEncryption m_Encryption;
@@ -47,11 +53,12 @@ namespace tunnel
 
 			size_t GetNumTransmittedBytes () const { return m_NumTransmittedBytes; };
 			void HandleTunnelDataMsg (std::shared_ptr<const i2p::I2NPMessage> tunnelMsg);
-			void FlushTunnelDataMsgs ();
+			void FlushTunnelDataMsgs (TunnelTransportSender& sender);
 
 		private:
 
 			size_t m_NumTransmittedBytes;
+			std::vector<std::shared_ptr<const i2p::I2NPMessage> > m_ReceivedTunnelDataMsgs; // encrypted in batch on flush
 			std::vector<std::shared_ptr<i2p::I2NPMessage> > m_TunnelDataMsgs;
 	};
 
@@ -66,7 +73,7 @@ namespace tunnel
 				layerKey, ivKey), m_Gateway(this) {};
 
 			void SendTunnelDataMsg (std::shared_ptr<i2p::I2NPMessage> msg);
-			void FlushTunnelDataMsgs ();
+			void FlushTunnelDataMsgs (TunnelTransportSender& sender);
 			size_t GetNumTransmittedBytes () const { return m_Gateway.GetNumSentBytes (); };
 
 		private:
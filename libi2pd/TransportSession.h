@@ -10,6 +10,7 @@
 #include "RouterInfo.h"
 #include "I2NPProtocol.h"
 #include "Timestamp.h"
+#include "Queue.h"
 
 namespace i2p
 {
@@ -90,6 +91,7 @@ namespace transport
 			bool m_IsOutgoing;
 			int m_TerminationTimeout;
 			uint64_t m_LastActivityTimestamp;
+			i2p::util::MPSCBatchQueue<std::shared_ptr<I2NPMessage> > m_OutgoingQueue; // from any thread, drained by session's thread
 	};
 }
 }
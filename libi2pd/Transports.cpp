@@ -17,23 +17,36 @@ namespace i2p
 {
 namespace transport
 {
-	DHKeysPairSupplier::DHKeysPairSupplier (int size):
-		m_QueueSize (size), m_IsRunning (false), m_Thread (nullptr)
+	template<typename Keys>
+	EphemeralKeysSupplier<Keys>::EphemeralKeysSupplier (int size, int threshold):
+		m_QueueSize (size), m_Threshold (threshold), m_IsRunning (false), m_Thread (nullptr)
 	{
 	}
 
-	DHKeysPairSupplier::~DHKeysPairSupplier ()
+	template<typename Keys>
+	EphemeralKeysSupplier<Keys>::~EphemeralKeysSupplier ()
 	{
 		Stop ();
 	}
 
-	void DHKeysPairSupplier::Start ()
+	template<typename Keys>
+	void EphemeralKeysSupplier<Keys>::SetSize (int size, int threshold)
+	{
+		if (size < 1) size = 1;
+		if (threshold < 1) threshold = 1;
+		if (threshold > size) threshold = size;
+		m_QueueSize = size; m_Threshold = threshold;
+	}
+
+	template<typename Keys>
+	void EphemeralKeysSupplier<Keys>::Start ()
 	{
 		m_IsRunning = true;
-		m_Thread = new std::thread (std::bind (&DHKeysPairSupplier::Run, this));
+		m_Thread = new std::thread (std::bind (&EphemeralKeysSupplier<Keys>::Run, this));
 	}
 
-	void DHKeysPairSupplier::Stop ()
+	template<typename Keys>
+	void EphemeralKeysSupplier<Keys>::Stop ()
 	{
 		{
 			std::unique_lock<std::mutex> l(m_AcquiredMutex);
@@ -48,45 +61,52 @@ namespace transport
 		}
 	}
 
-	void DHKeysPairSupplier::Run ()
+	template<typename Keys>
+	void EphemeralKeysSupplier<Keys>::Run ()
 	{
 		while (m_IsRunning)
 		{
 			int num, total = 0;
-			while ((num = m_QueueSize - (int)m_Queue.size ()) > 0 && total < 10)
+			while ((num = m_QueueSize - GetQueueSize ()) > 0 && total < 2*m_QueueSize)
 			{
-				CreateDHKeysPairs (num);
+				CreateKeysPairs (num);
 				total += num;
 			}
-			if (total >= 10)
+			if (total >= 2*m_QueueSize)
 			{
-				LogPrint (eLogWarning, "Transports: ", total, " DH keys generated at the time");
+				LogPrint (eLogWarning, "Transports: ", total, " ephemeral keys generated at the time");
 				std::this_thread::sleep_for (std::chrono::seconds(1)); // take a break
 			}
 			else
 			{
 				std::unique_lock<std::mutex> l(m_AcquiredMutex);
-				if (!m_IsRunning) break;
-				m_Acquired.wait (l); // wait for element gets acquired
+				while (m_IsRunning && (int)m_Queue.size () >= m_Threshold)
+					m_Acquired.wait (l); // wait for elements get acquired
 			}
 		}
 	}
 
-	void DHKeysPairSupplier::CreateDHKeysPairs (int num)
+	template<typename Keys>
+	void EphemeralKeysSupplier<Keys>::CreateKeysPairs (int num)
 	{
-		if (num > 0)
+		for (int i = 0; i < num; i++)
 		{
-			for (int i = 0; i < num; i++)
-			{
-				auto pair = std::make_shared<i2p::crypto::DHKeys> ();
-				pair->GenerateKeys ();
-				std::unique_lock<std::mutex>	l(m_AcquiredMutex);
-				m_Queue.push (pair);
-			}
+			auto pair = std::make_shared<Keys> ();
+			pair->GenerateKeys ();
+			std::unique_lock<std::mutex>	l(m_AcquiredMutex);
+			m_Queue.push (pair);
 		}
 	}
 
-	std::shared_ptr<i2p::crypto::DHKeys> DHKeysPairSupplier::Acquire ()
+	template<typename Keys>
+	int EphemeralKeysSupplier<Keys>::GetQueueSize ()
+	{
+		std::unique_lock<std::mutex>	l(m_AcquiredMutex);
+		return m_Queue.size ();
+	}
+
+	template<typename Keys>
+	std::shared_ptr<Keys> EphemeralKeysSupplier<Keys>::Acquire ()
 	{
 		{
 			std::unique_lock<std::mutex>	l(m_AcquiredMutex);
@@ -94,17 +114,19 @@ namespace transport
 			{
 				auto pair = m_Queue.front ();
 				m_Queue.pop ();
-				m_Acquired.notify_one ();
+				if ((int)m_Queue.size () < m_Threshold)
+					m_Acquired.notify_one ();
 				return pair;
 			}
 		}
 		// queue is empty, create new
-		auto pair = std::make_shared<i2p::crypto::DHKeys> ();
+		auto pair = std::make_shared<Keys> ();
 		pair->GenerateKeys ();
 		return pair;
 	}
 
-	void DHKeysPairSupplier::Return (std::shared_ptr<i2p::crypto::DHKeys> pair)
+	template<typename Keys>
+	void EphemeralKeysSupplier<Keys>::Return (std::shared_ptr<Keys> pair)
 	{
 		if (pair)
 		{
@@ -113,16 +135,20 @@ namespace transport
 				m_Queue.push (pair);
 		}
 		else
-			LogPrint(eLogError, "Transports: return null DHKeys");
+			LogPrint(eLogError, "Transports: return null keys");
 	}
 
+	template class EphemeralKeysSupplier<i2p::crypto::DHKeys>;
+	template class EphemeralKeysSupplier<i2p::crypto::X25519Keys>;
+
 	Transports transports;
 
 	Transports::Transports ():
 		m_IsOnline (true), m_IsRunning (false), m_IsNAT (true), m_Thread (nullptr), m_Service (nullptr),
 		m_Work (nullptr), m_PeerCleanupTimer (nullptr), m_PeerTestTimer (nullptr),
 		m_NTCPServer (nullptr), m_SSUServer (nullptr), m_NTCP2Server (nullptr),
-		m_DHKeysPairSupplier (5), // 5 pre-generated keys
+		m_DHKeysPairSupplier (5, 5), // 5 pre-generated keys
+		m_X25519KeysPairSupplier (32, 16), // from ntcp2.keyspool in Start
 		m_TotalSentBytes(0), m_TotalReceivedBytes(0), m_TotalTransitTransmittedBytes (0),
 		m_InBandwidth (0), m_OutBandwidth (0), m_TransitBandwidth(0),
 		m_LastInBandwidthUpdateBytes (0), m_LastOutBandwidthUpdateBytes (0),
@@ -200,6 +226,11 @@ namespace transport
 		bool ntcp2;  i2p::config::GetOption("ntcp2.enabled", ntcp2);
 		if (ntcp2)
 		{
+			int keysPoolSize, keysPoolThreshold;
+			i2p::config::GetOption("ntcp2.keyspool", keysPoolSize);
+			i2p::config::GetOption("ntcp2.keyspoolthreshold", keysPoolThreshold);
+			m_X25519KeysPairSupplier.SetSize (keysPoolSize, keysPoolThreshold);
+			m_X25519KeysPairSupplier.Start ();
 			m_NTCP2Server = new NTCP2Server ();
 			m_NTCP2Server->Start ();
 		}	
@@ -260,7 +291,11 @@ namespace transport
 	{
 		if (m_PeerCleanupTimer) m_PeerCleanupTimer->cancel ();
 		if (m_PeerTestTimer) m_PeerTestTimer->cancel ();
-		m_Peers.clear ();
+		for (auto& shard: m_Peers)
+		{
+			std::unique_lock<std::mutex> l(shard.mutex);
+			shard.peers.clear ();
+		}
 		if (m_SSUServer)
 		{
 			m_SSUServer->Stop ();
@@ -282,6 +317,7 @@ namespace transport
 		}
 
 		m_DHKeysPairSupplier.Stop ();
+		m_X25519KeysPairSupplier.Stop ();
 		m_IsRunning = false;
 		if (m_Service) m_Service->stop ();
 		if (m_Thread)
@@ -294,6 +330,7 @@ namespace transport
 
 	void Transports::Run ()
 	{
+		i2p::util::SetThreadAffinity ("transports");
 		while (m_IsRunning && m_Service)
 		{
 			try
@@ -349,9 +386,57 @@ namespace transport
 #ifdef WITH_EVENTS
 		QueueIntEvent("transport.send", ident.ToBase64(), msgs.size());
 #endif
+		if (SendMessagesToConnectedPeer (ident, msgs)) return;
 		m_Service->post (std::bind (&Transports::PostMessages, this, ident, msgs));
 	}
 
+	void Transports::SendMessages (std::map<i2p::data::IdentHash, std::vector<std::shared_ptr<i2p::I2NPMessage> > >&& msgs)
+	{
+#ifdef WITH_EVENTS
+		for (const auto& it: msgs)
+			QueueIntEvent("transport.send", it.first.ToBase64(), it.second.size());
+#endif
+		for (auto it = msgs.begin (); it != msgs.end ();)
+		{
+			if (SendMessagesToConnectedPeer (it->first, it->second))
+				it = msgs.erase (it);
+			else
+				it++;
+		}
+		if (msgs.empty ()) return;
+		auto peersMsgs = std::make_shared<std::map<i2p::data::IdentHash, std::vector<std::shared_ptr<i2p::I2NPMessage> > > >(std::move (msgs));
+		// single post for all peers to connect
+		m_Service->post ([this, peersMsgs]()
+			{
+				for (auto& it: *peersMsgs)
+					PostMessages (it.first, std::move (it.second));
+			});
+	}
+
+	bool Transports::SendMessagesToConnectedPeer (const i2p::data::IdentHash& ident, const std::vector<std::shared_ptr<i2p::I2NPMessage> >& msgs)
+	{
+		// called from any thread, session queues messages without transports thread
+		// messages to ourself and with restricted routes are left for PostMessages to check
+		if (ident == i2p::context.GetRouterInfo ().GetIdentHash () || RoutesRestricted ()) return false;
+		std::shared_ptr<TransportSession> session;
+		{
+			auto& shard = GetPeersShard (ident);
+			std::unique_lock<std::mutex> l(shard.mutex);
+			auto it = shard.peers.find (ident);
+			if (it == shard.peers.end () || it->second.sessions.empty ()) return false;
+			session = it->second.sessions.front ();
+		}
+		session->SendI2NPMessages (msgs);
+		return true;
+	}
+
+	void Transports::ErasePeer (const i2p::data::IdentHash& ident)
+	{
+		auto& shard = GetPeersShard (ident);
+		std::unique_lock<std::mutex> l(shard.mutex);
+		shard.peers.erase (ident);
+	}
+
 	void Transports::PostMessages (i2p::data::IdentHash ident, std::vector<std::shared_ptr<i2p::I2NPMessage> > msgs)
 	{
 		if (ident == i2p::context.GetRouterInfo ().GetIdentHash ())
@@ -363,16 +448,17 @@ namespace transport
 			return;
 		}
 		if(RoutesRestricted() && ! IsRestrictedPeer(ident)) return;
-		auto it = m_Peers.find (ident);
-		if (it == m_Peers.end ())
+		auto& shard = GetPeersShard (ident);
+		auto it = shard.peers.find (ident);
+		if (it == shard.peers.end ())
 		{
 			bool connected = false;
 			try
 			{
 				auto r = netdb.FindRouter (ident);
 				{
-					std::unique_lock<std::mutex>	l(m_PeersMutex);
-					it = m_Peers.insert (std::pair<i2p::data::IdentHash, Peer>(ident, { 0, r, {},
+					std::unique_lock<std::mutex>	l(shard.mutex);
+					it = shard.peers.insert (std::pair<i2p::data::IdentHash, Peer>(ident, { 0, r, {},
 						i2p::util::GetSecondsSinceEpoch (), {} })).first;
 				}
 				connected = ConnectToPeer (ident, it->second);
@@ -395,8 +481,8 @@ namespace transport
 			else
 			{
 				LogPrint (eLogWarning, "Transports: delayed messages queue size exceeds ", MAX_NUM_DELAYED_MESSAGES);
-				std::unique_lock<std::mutex> l(m_PeersMutex);
-				m_Peers.erase (it);
+				std::unique_lock<std::mutex> l(shard.mutex);
+				shard.peers.erase (it);
 			}
 		}
 	}
@@ -484,8 +570,7 @@ namespace transport
 			}
 			LogPrint (eLogInfo, "Transports: No NTCP or SSU addresses available");
 			peer.Done ();
-			std::unique_lock<std::mutex> l(m_PeersMutex);
-			m_Peers.erase (ident);
+			ErasePeer (ident);
 			return false;
 		}
 		else // otherwise request RI
@@ -504,8 +589,9 @@ namespace transport
 
 	void Transports::HandleRequestComplete (std::shared_ptr<const i2p::data::RouterInfo> r, i2p::data::IdentHash ident)
 	{
-		auto it = m_Peers.find (ident);
-		if (it != m_Peers.end ())
+		auto& shard = GetPeersShard (ident);
+		auto it = shard.peers.find (ident);
+		if (it != shard.peers.end ())
 		{
 			if (r)
 			{
@@ -516,8 +602,8 @@ namespace transport
 			else
 			{
 				LogPrint (eLogWarning, "Transports: RouterInfo not found, Failed to send messages");
-				std::unique_lock<std::mutex> l(m_PeersMutex);
-				m_Peers.erase (it);
+				std::unique_lock<std::mutex> l(shard.mutex);
+				shard.peers.erase (it);
 			}
 		}
 	}
@@ -609,6 +695,11 @@ namespace transport
 		m_DHKeysPairSupplier.Return (pair);
 	}
 
+	std::shared_ptr<i2p::crypto::X25519Keys> Transports::GetNextX25519KeysPair ()
+	{
+		return m_X25519KeysPairSupplier.Acquire ();
+	}
+
 	void Transports::PeerConnected (std::shared_ptr<TransportSession> session)
 	{
 		m_Service->post([session, this]()
@@ -616,8 +707,9 @@ namespace transport
 			auto remoteIdentity = session->GetRemoteIdentity ();
 			if (!remoteIdentity) return;
 			auto ident = remoteIdentity->GetIdentHash ();
-			auto it = m_Peers.find (ident);
-			if (it != m_Peers.end ())
+			auto& shard = GetPeersShard (ident);
+			auto it = shard.peers.find (ident);
+			if (it != shard.peers.end ())
 			{
 #ifdef WITH_EVENTS
 				EmitEvent({{"type" , "transport.connected"}, {"ident", ident.ToBase64()}, {"inbound", "false"}});
@@ -635,9 +727,11 @@ namespace transport
 					session->SendLocalRouterInfo ();
 				else
 					session->SetTerminationTimeout (10); // most likely it's publishing, no follow-up messages expected, set timeout to 10 seconds
-				it->second.sessions.push_back (session);
+				// delayed messages first, other threads send to the session directly once it's added
 				session->SendI2NPMessages (it->second.delayedMessages);
 				it->second.delayedMessages.clear ();
+				std::unique_lock<std::mutex> l(shard.mutex);
+				it->second.sessions.push_back (session);
 			}
 			else // incoming connection
 			{
@@ -651,8 +745,8 @@ namespace transport
 				EmitEvent({{"type" , "transport.connected"}, {"ident", ident.ToBase64()}, {"inbound", "true"}});
 #endif
 				session->SendI2NPMessages ({ CreateDatabaseStoreMsg () }); // send DatabaseStore
-				std::unique_lock<std::mutex>	l(m_PeersMutex);
-				m_Peers.insert (std::make_pair (ident, Peer{ 0, nullptr, { session }, i2p::util::GetSecondsSinceEpoch (), {} }));
+				std::unique_lock<std::mutex>	l(shard.mutex);
+				shard.peers.insert (std::make_pair (ident, Peer{ 0, nullptr, { session }, i2p::util::GetSecondsSinceEpoch (), {} }));
 			}
 		});
 	}
@@ -667,18 +761,22 @@ namespace transport
 #ifdef WITH_EVENTS
 			EmitEvent({{"type" , "transport.disconnected"}, {"ident", ident.ToBase64()}});
 #endif
-			auto it = m_Peers.find (ident);
-			if (it != m_Peers.end ())
+			auto& shard = GetPeersShard (ident);
+			auto it = shard.peers.find (ident);
+			if (it != shard.peers.end ())
 			{
-				it->second.sessions.remove (session);
+				{
+					std::unique_lock<std::mutex> l(shard.mutex);
+					it->second.sessions.remove (session);
+				}
 				if (it->second.sessions.empty ()) // TODO: why?
 				{
 					if (it->second.delayedMessages.size () > 0)
 						ConnectToPeer (ident, it->second);
 					else
 					{
-						std::unique_lock<std::mutex> l(m_PeersMutex);
-						m_Peers.erase (it);
+						std::unique_lock<std::mutex> l(shard.mutex);
+						shard.peers.erase (it);
 					}
 				}
 			}
@@ -687,9 +785,21 @@ namespace transport
 
 	bool Transports::IsConnected (const i2p::data::IdentHash& ident) const
 	{
-		std::unique_lock<std::mutex> l(m_PeersMutex);
-		auto it = m_Peers.find (ident);
-		return it != m_Peers.end ();
+		auto& shard = GetPeersShard (ident);
+		std::unique_lock<std::mutex> l(shard.mutex);
+		auto it = shard.peers.find (ident);
+		return it != shard.peers.end ();
+	}
+
+	size_t Transports::GetNumPeers () const
+	{
+		size_t num = 0;
+		for (auto& shard: m_Peers)
+		{
+			std::unique_lock<std::mutex> l(shard.mutex);
+			num += shard.peers.size ();
+		}
+		return num;
 	}
 
 	void Transports::HandlePeerCleanupTimer (const boost::system::error_code& ecode)
@@ -697,21 +807,24 @@ namespace transport
 		if (ecode != boost::asio::error::operation_aborted)
 		{
 			auto ts = i2p::util::GetSecondsSinceEpoch ();
-			for (auto it = m_Peers.begin (); it != m_Peers.end (); )
+			for (auto& shard: m_Peers)
 			{
-				if (it->second.sessions.empty () && ts > it->second.creationTime + SESSION_CREATION_TIMEOUT)
+				for (auto it = shard.peers.begin (); it != shard.peers.end (); )
 				{
-					LogPrint (eLogWarning, "Transports: Session to peer ", it->first.ToBase64 (), " has not been created in ", SESSION_CREATION_TIMEOUT, " seconds");
-					auto profile = i2p::data::GetRouterProfile(it->first);
-					if (profile)
+					if (it->second.sessions.empty () && ts > it->second.creationTime + SESSION_CREATION_TIMEOUT)
 					{
-						profile->TunnelNonReplied();
+						LogPrint (eLogWarning, "Transports: Session to peer ", it->first.ToBase64 (), " has not been created in ", SESSION_CREATION_TIMEOUT, " seconds");
+						auto profile = i2p::data::GetRouterProfile(it->first);
+						if (profile)
+						{
+							profile->TunnelNonReplied();
+						}
+						std::unique_lock<std::mutex>	l(shard.mutex);
+						it = shard.peers.erase (it);
 					}
-					std::unique_lock<std::mutex>	l(m_PeersMutex);
-					it = m_Peers.erase (it);
+					else
+						++it;
 				}
-				else
-					++it;
 			}
 			UpdateBandwidth (); // TODO: use separate timer(s) for it
 			if (i2p::context.GetStatus () == eRouterStatusTesting) // if still testing,	 repeat peer test
@@ -733,11 +846,21 @@ namespace transport
 
 	std::shared_ptr<const i2p::data::RouterInfo> Transports::GetRandomPeer () const
 	{
-		if (m_Peers.empty ()) return nullptr;
-		std::unique_lock<std::mutex> l(m_PeersMutex);
-		auto it = m_Peers.begin ();
-		std::advance (it, rand () % m_Peers.size ());
-		return it != m_Peers.end () ? it->second.router : nullptr;
+		auto num = GetNumPeers ();
+		if (!num) return nullptr;
+		size_t ind = rand () % num;
+		for (auto& shard: m_Peers)
+		{
+			std::unique_lock<std::mutex> l(shard.mutex);
+			if (ind < shard.peers.size ())
+			{
+				auto it = shard.peers.begin ();
+				std::advance (it, ind);
+				return it->second.router;
+			}
+			ind -= shard.peers.size ();
+		}
+		return nullptr;
 	}
 	void Transports::RestrictRoutesToFamilies(std::set<std::string> families)
 	{
@@ -6,6 +6,7 @@
 #include <condition_variable>
 #include <functional>
 #include <map>
+#include <array>
 #include <vector>
 #include <queue>
 #include <string>
@@ -24,32 +25,38 @@ namespace i2p
 {
 namespace transport
 {
-	class DHKeysPairSupplier
+	template<typename Keys>
+	class EphemeralKeysSupplier
 	{
+		// pre-generates key pairs in own thread, Keys must have GenerateKeys ()
 		public:
 
-			DHKeysPairSupplier (int size);
-			~DHKeysPairSupplier ();
+			EphemeralKeysSupplier (int size, int threshold);
+			~EphemeralKeysSupplier ();
+			void SetSize (int size, int threshold); // before Start
 			void Start ();
 			void Stop ();
-			std::shared_ptr<i2p::crypto::DHKeys> Acquire ();
-			void Return (std::shared_ptr<i2p::crypto::DHKeys> pair);
+			std::shared_ptr<Keys> Acquire ();
+			void Return (std::shared_ptr<Keys> pair);
 
 		private:
 
 			void Run ();
-			void CreateDHKeysPairs (int num);
+			void CreateKeysPairs (int num);
+			int GetQueueSize ();
 
 		private:
 
-			const int m_QueueSize;
-			std::queue<std::shared_ptr<i2p::crypto::DHKeys> > m_Queue;
+			int m_QueueSize, m_Threshold; // refilled up to m_QueueSize when less than m_Threshold left
+			std::queue<std::shared_ptr<Keys> > m_Queue;
 
 			bool m_IsRunning;
 			std::thread * m_Thread;
 			std::condition_variable m_Acquired;
 			std::mutex m_AcquiredMutex;
 	};
+	typedef EphemeralKeysSupplier<i2p::crypto::DHKeys> DHKeysPairSupplier;
+	typedef EphemeralKeysSupplier<i2p::crypto::X25519Keys> X25519KeysPairSupplier;
 
 	struct Peer
 	{
@@ -69,6 +76,7 @@ namespace transport
 	const size_t SESSION_CREATION_TIMEOUT = 10; // in seconds
 	const int PEER_TEST_INTERVAL = 71; // in minutes
 	const int MAX_NUM_DELAYED_MESSAGES = 50;
+	const int NUM_PEERS_SHARDS = 16;
 	class Transports
 	{
 		public:
@@ -89,9 +97,11 @@ namespace transport
 			boost::asio::io_service& GetService () { return *m_Service; };
 			std::shared_ptr<i2p::crypto::DHKeys> GetNextDHKeysPair ();
 			void ReuseDHKeysPair (std::shared_ptr<i2p::crypto::DHKeys> pair);
+			std::shared_ptr<i2p::crypto::X25519Keys> GetNextX25519KeysPair ();
 
 			void SendMessage (const i2p::data::IdentHash& ident, std::shared_ptr<i2p::I2NPMessage> msg);
 			void SendMessages (const i2p::data::IdentHash& ident, const std::vector<std::shared_ptr<i2p::I2NPMessage> >& msgs);
+			void SendMessages (std::map<i2p::data::IdentHash, std::vector<std::shared_ptr<i2p::I2NPMessage> > >&& msgs); // ident->msgs
 			void CloseSession (std::shared_ptr<const i2p::data::RouterInfo> router);
 
 			void PeerConnected (std::shared_ptr<TransportSession> session);
@@ -109,7 +119,7 @@ namespace transport
 			uint32_t GetTransitBandwidth () const { return m_TransitBandwidth; };
 			bool IsBandwidthExceeded () const;
 			bool IsTransitBandwidthExceeded () const;
-			size_t GetNumPeers () const { return m_Peers.size (); };
+			size_t GetNumPeers () const;
 			std::shared_ptr<const i2p::data::RouterInfo> GetRandomPeer () const;
 
     /** get a trusted first hop for restricted routes */
@@ -127,6 +137,18 @@ namespace transport
 
 		private:
 
+			struct PeersShard
+			{
+				// modified by transports thread only, locked for modifications and for access from other threads
+				mutable std::mutex mutex;
+				std::map<i2p::data::IdentHash, Peer> peers;
+			};
+
+			PeersShard& GetPeersShard (const i2p::data::IdentHash& ident) { return m_Peers[ident.GetLL ()[0] % NUM_PEERS_SHARDS]; };
+			const PeersShard& GetPeersShard (const i2p::data::IdentHash& ident) const { return m_Peers[ident.GetLL ()[0] % NUM_PEERS_SHARDS]; };
+			bool SendMessagesToConnectedPeer (const i2p::data::IdentHash& ident, const std::vector<std::shared_ptr<i2p::I2NPMessage> >& msgs);
+			void ErasePeer (const i2p::data::IdentHash& ident);
+
 			void Run ();
 			void RequestComplete (std::shared_ptr<const i2p::data::RouterInfo> r, const i2p::data::IdentHash& ident);
 			void HandleRequestComplete (std::shared_ptr<const i2p::data::RouterInfo> r, i2p::data::IdentHash ident);
@@ -150,10 +172,10 @@ namespace transport
 			NTCPServer * m_NTCPServer;
 			SSUServer * m_SSUServer;
 			NTCP2Server * m_NTCP2Server;
-			mutable std::mutex m_PeersMutex;
-			std::map<i2p::data::IdentHash, Peer> m_Peers;
+			std::array<PeersShard, NUM_PEERS_SHARDS> m_Peers; // by ident
 
 			DHKeysPairSupplier m_DHKeysPairSupplier;
+			X25519KeysPairSupplier m_X25519KeysPairSupplier;
 
 			std::atomic<uint64_t> m_TotalSentBytes, m_TotalReceivedBytes, m_TotalTransitTransmittedBytes;
 			uint32_t m_InBandwidth, m_OutBandwidth, m_TransitBandwidth; // bytes per second
@@ -176,7 +198,6 @@ namespace transport
 			const NTCPServer * GetNTCPServer () const { return m_NTCPServer; };
 			const SSUServer * GetSSUServer () const { return m_SSUServer; };
 			const NTCP2Server * GetNTCP2Server () const { return m_NTCP2Server; };
-			const decltype(m_Peers)& GetPeers () const { return m_Peers; };
 	};
 
 	extern Transports transports;
@@ -11,6 +11,7 @@
 #include "Transports.h"
 #include "NetDb.hpp"
 #include "Config.h"
+#include "util.h"
 #include "Tunnel.h"
 #include "TunnelPool.h"
 #ifdef WITH_EVENTS
@@ -331,9 +332,172 @@ namespace tunnel
 		s << GetTunnelID () << ":me &#8658; ";
 	}
 
+	TunnelsShard::TunnelsShard (int index): m_Index (index), m_IsRunning (false), m_Thread (nullptr)
+	{
+	}
+
+	TunnelsShard::~TunnelsShard ()
+	{
+		Stop ();
+	}
+
+	void TunnelsShard::Start ()
+	{
+		m_IsRunning = true;
+		m_Thread = new std::thread (std::bind (&TunnelsShard::Run, this));
+	}
+
+	void TunnelsShard::Stop ()
+	{
+		m_IsRunning = false;
+		m_Queue.WakeUp ();
+		if (m_Thread)
+		{
+			m_Thread->join ();
+			delete m_Thread;
+			m_Thread = 0;
+		}
+	}
+
+	std::shared_ptr<TunnelBase> TunnelsShard::GetTunnel (uint32_t tunnelID)
+	{
+		std::unique_lock<std::mutex> l(m_TunnelsMutex);
+		return m_Tunnels.Get (tunnelID);
+	}
+
+	bool TunnelsShard::AddTunnel (std::shared_ptr<TunnelBase> tunnel, uint32_t generation)
+	{
+		std::unique_lock<std::mutex> l(m_TunnelsMutex);
+		return m_Tunnels.Insert (tunnel->GetTunnelID (), tunnel, generation);
+	}
+
+	void TunnelsShard::RemoveTunnel (uint32_t tunnelID)
+	{
+		std::unique_lock<std::mutex> l(m_TunnelsMutex);
+		m_Tunnels.Remove (tunnelID);
+	}
+
+	void TunnelsShard::ExpireTunnels (uint32_t generation)
+	{
+		std::unique_lock<std::mutex> l(m_TunnelsMutex);
+		m_Tunnels.Expire (generation, [](std::shared_ptr<TunnelBase> tunnel)
+			{
+				LogPrint (eLogDebug, "Tunnel: Transit tunnel with id ", tunnel->GetTunnelID (), " expired");
+			});
+	}
+
+	void TunnelsShard::Run ()
+	{
+		i2p::util::SetThreadAffinity ("tunnels");
+		std::this_thread::sleep_for (std::chrono::seconds(1)); // wait for other parts are ready
+
+		uint64_t lastTs = 0;
+		std::vector<std::shared_ptr<I2NPMessage> > msgs;
+		msgs.reserve (TUNNELS_SHARD_BATCH_SIZE);
+		while (m_IsRunning)
+		{
+			try
+			{
+				auto msg = m_Queue.GetNextWithTimeout (1000); // 1 sec
+				if (msg)
+				{
+					uint32_t prevTunnelID = 0;
+					std::shared_ptr<TunnelBase> prevTunnel;
+					msgs.push_back (msg);
+					m_Queue.GetBatch (msgs, TUNNELS_SHARD_BATCH_SIZE - 1);
+					do
+					{
+						for (auto& it: msgs)
+						{
+							std::shared_ptr<TunnelBase> tunnel;
+							uint8_t typeID = it->GetTypeID ();
+							uint32_t tunnelID = bufbe32toh (it->GetPayload ());
+							if (tunnelID == prevTunnelID)
+								tunnel = prevTunnel;
+							else if (prevTunnel)
+								prevTunnel->FlushTunnelDataMsgs (m_TransportSender);
+
+							if (!tunnel)
+								tunnel = GetTunnel (tunnelID);
+							if (tunnel)
+							{
+								if (typeID == eI2NPTunnelData)
+									tunnel->HandleTunnelDataMsg (it);
+								else // tunnel gateway assumed
+									HandleTunnelGatewayMsg (tunnel, it);
+							}
+							else
+								LogPrint (eLogWarning, "Tunnel: tunnel not found, tunnelID=", tunnelID, " previousTunnelID=", prevTunnelID, " type=", (int)typeID);
+							prevTunnelID = tunnelID;
+							prevTunnel = tunnel;
+						}
+						msgs.clear ();
+						// same next hop of different tunnels goes in one vector
+						if (prevTunnel)
+							prevTunnel->FlushTunnelDataMsgs (m_TransportSender);
+						m_TransportSender.Flush ();
+					}
+					while (m_Queue.GetBatch (msgs, TUNNELS_SHARD_BATCH_SIZE));
+				}
+
+				uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
+				if (ts - lastTs >= TUNNELS_MANAGE_INTERVAL)
+				{
+					CleanupTunnels ();
+					lastTs = ts;
+				}
+			}
+			catch (std::exception& ex)
+			{
+				msgs.clear ();
+				LogPrint (eLogError, "Tunnel: shard ", m_Index, " runtime exception: ", ex.what ());
+			}
+		}
+	}
+
+	void TunnelsShard::HandleTunnelGatewayMsg (std::shared_ptr<TunnelBase> tunnel, std::shared_ptr<I2NPMessage> msg)
+	{
+		if (!tunnel)
+		{
+			LogPrint (eLogError, "Tunnel: missing tunnel for gateway");
+			return;
+		}
+		const uint8_t * payload = msg->GetPayload ();
+		uint16_t len = bufbe16toh(payload + TUNNEL_GATEWAY_HEADER_LENGTH_OFFSET);
+		// we make payload as new I2NP message to send
+		msg->offset += I2NP_HEADER_SIZE + TUNNEL_GATEWAY_HEADER_SIZE;
+		if (msg->offset + len > msg->len)
+		{
+			LogPrint (eLogError, "Tunnel: gateway payload ", (int)len, " exceeds message length ", (int)msg->len);
+			return;
+		}
+		msg->len = msg->offset + len;
+		auto typeID = msg->GetTypeID ();
+		LogPrint (eLogDebug, "Tunnel: gateway of ", (int) len, " bytes for tunnel ", tunnel->GetTunnelID (), ", msg type ", (int)typeID);
+
+		if (IsRouterInfoMsg (msg) || typeID == eI2NPDatabaseSearchReply)
+			// transit DatabaseStore my contain new/updated RI
+			// or DatabaseSearchReply with new routers
+			i2p::data::netdb.PostI2NPMsg (CopyI2NPMessage (msg));
+		tunnel->SendTunnelDataMsg (msg);
+	}
+
+	void TunnelsShard::CleanupTunnels ()
+	{
+		// endpoints are not thread safe, so we clean them up from the thread handling their messages
+		std::vector<std::shared_ptr<TunnelBase> > tunnels;
+		{
+			std::unique_lock<std::mutex> l(m_TunnelsMutex);
+			tunnels.reserve (m_Tunnels.GetSize ());
+			m_Tunnels.ForEach ([&tunnels](std::shared_ptr<TunnelBase> tunnel) { tunnels.push_back (tunnel); });
+		}
+		for (auto& it: tunnels)
+			it->Cleanup ();
+	}
+
 	Tunnels tunnels;
 
-	Tunnels::Tunnels (): m_IsRunning (false), m_Thread (nullptr),
+	Tunnels::Tunnels (): m_IsRunning (false), m_Thread (nullptr), m_NumShards (0),
 		m_NumSuccesiveTunnelCreations (0), m_NumFailedTunnelCreations (0)
 	{
 	}
@@ -344,10 +508,8 @@ namespace tunnel
 
 	std::shared_ptr<TunnelBase> Tunnels::GetTunnel (uint32_t tunnelID)
 	{
-		auto it = m_Tunnels.find(tunnelID);
-		if (it != m_Tunnels.end ())
-			return it->second;
-		return nullptr;
+		if (!m_NumShards) return nullptr;
+		return GetShard (tunnelID).GetTunnel (tunnelID);
 	}
 
 	std::shared_ptr<InboundTunnel> Tunnels::GetPendingInboundTunnel (uint32_t replyMsgID)
@@ -437,14 +599,33 @@ namespace tunnel
 
 	void Tunnels::AddTransitTunnel (std::shared_ptr<TransitTunnel> tunnel)
 	{
-		if (m_Tunnels.emplace (tunnel->GetTunnelID (), tunnel).second)
+		if (GetShard (tunnel->GetTunnelID ()).AddTunnel (tunnel, tunnel->GetCreationTime ()))
+		{
+			std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
 			m_TransitTunnels.push_back (tunnel);
+		}
 		else
 			LogPrint (eLogError, "Tunnel: tunnel with id ", tunnel->GetTunnelID (), " already exists");
 	}
 
 	void Tunnels::Start ()
 	{
+		if (!m_NumShards)
+		{
+			uint16_t numShards; i2p::config::GetOption("limits.tunnelthreads", numShards);
+			if (!numShards) numShards = 1;
+			if (numShards > MAX_NUM_TUNNELS_SHARDS) numShards = MAX_NUM_TUNNELS_SHARDS;
+			for (int i = 0; i < numShards; i++)
+				m_Shards[i].reset (new TunnelsShard (i));
+			m_NumShards = numShards;
+			LogPrint (eLogInfo, "Tunnel: ", numShards, " tunnel data threads");
+		}
+		uint16_t numBuildThreads; i2p::config::GetOption("limits.buildthreads", numBuildThreads);
+		if (!numBuildThreads) numBuildThreads = 1;
+		if (numBuildThreads > MAX_NUM_TUNNEL_BUILD_THREADS) numBuildThreads = MAX_NUM_TUNNEL_BUILD_THREADS;
+		m_BuildRequestsPool.reset (new i2p::worker::ThreadPool<TunnelBuildRequest>(numBuildThreads, MAX_TUNNEL_BUILD_REQUESTS_BACKLOG));
+		for (int i = 0; i < m_NumShards; i++)
+			m_Shards[i]->Start ();
 		m_IsRunning = true;
 		m_Thread = new std::thread (std::bind (&Tunnels::Run, this));
 	}
@@ -459,10 +640,15 @@ namespace tunnel
 			delete m_Thread;
 			m_Thread = 0;
 		}
+		m_BuildRequestsPool = nullptr; // finishes pending requests
+		// shards are kept to accept messages from transports until exit
+		for (int i = 0; i < m_NumShards; i++)
+			m_Shards[i]->Stop ();
 	}
 
 	void Tunnels::Run ()
 	{
+		i2p::util::SetThreadAffinity ("tunnels");
 		std::this_thread::sleep_for (std::chrono::seconds(1)); // wait for other parts are ready
 
 		uint64_t lastTs = 0;
@@ -471,63 +657,31 @@ namespace tunnel
 			try
 			{
 				auto msg = m_Queue.GetNextWithTimeout (1000); // 1 sec
-				if (msg)
+				while (msg)
 				{
-					uint32_t prevTunnelID = 0, tunnelID = 0;
-					std::shared_ptr<TunnelBase> prevTunnel;
-					do
+					uint8_t typeID = msg->GetTypeID ();
+					switch (typeID)
 					{
-						std::shared_ptr<TunnelBase> tunnel;
-						uint8_t typeID = msg->GetTypeID ();
-						switch (typeID)
-						{
-							case eI2NPTunnelData:
-							case eI2NPTunnelGateway:
-							{
-								tunnelID = bufbe32toh (msg->GetPayload ());
-								if (tunnelID == prevTunnelID)
-									tunnel = prevTunnel;
-								else if (prevTunnel)
-									prevTunnel->FlushTunnelDataMsgs ();
-
-								if (!tunnel)
-									tunnel = GetTunnel (tunnelID);
-								if (tunnel)
-								{
-									if (typeID == eI2NPTunnelData)
-										tunnel->HandleTunnelDataMsg (msg);
-									else // tunnel gateway assumed
-										HandleTunnelGatewayMsg (tunnel, msg);
-								}
-								else
-									LogPrint (eLogWarning, "Tunnel: tunnel not found, tunnelID=", tunnelID, " previousTunnelID=", prevTunnelID, " type=", (int)typeID);
-
-								break;
-							}
-							case eI2NPVariableTunnelBuild:
-							case eI2NPVariableTunnelBuildReply:
-							case eI2NPTunnelBuild:
-							case eI2NPTunnelBuildReply:
-								HandleI2NPMessage (msg->GetBuffer (), msg->GetLength ());
-							break;
-							default:
-								LogPrint (eLogWarning, "Tunnel: unexpected message type ", (int) typeID);
-						}
-
-						msg = m_Queue.Get ();
-						if (msg)
-						{
-							prevTunnelID = tunnelID;
-							prevTunnel = tunnel;
-						}
-						else if (tunnel)
-							tunnel->FlushTunnelDataMsgs ();
+						case eI2NPTunnelData:
+						case eI2NPTunnelGateway:
+							// arrived before shards were created
+							GetShard (bufbe32toh (msg->GetPayload ())).PostTunnelData (msg);
+						break;
+						case eI2NPVariableTunnelBuild:
+						case eI2NPVariableTunnelBuildReply:
+						case eI2NPTunnelBuild:
+						case eI2NPTunnelBuildReply:
+							HandleI2NPMessage (msg->GetBuffer (), msg->GetLength ());
+						break;
+						default:
+							LogPrint (eLogWarning, "Tunnel: unexpected message type ", (int) typeID);
 					}
-					while (msg);
+					msg = m_Queue.Get ();
 				}
+				HandleTunnelBuildResults ();
 
 				uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
-				if (ts - lastTs >= 15) // manage tunnels every 15 seconds
+				if (ts - lastTs >= TUNNELS_MANAGE_INTERVAL)
 				{
 					ManageTunnels ();
 					lastTs = ts;
@@ -540,31 +694,43 @@ namespace tunnel
 		}
 	}
 
-	void Tunnels::HandleTunnelGatewayMsg (std::shared_ptr<TunnelBase> tunnel, std::shared_ptr<I2NPMessage> msg)
+	bool Tunnels::PostTunnelBuildRequest (std::shared_ptr<TunnelBuildRequest> request)
 	{
-		if (!tunnel)
+		if (!m_BuildRequestsPool)
 		{
-			LogPrint (eLogError, "Tunnel: missing tunnel for gateway");
-			return;
+			DecryptTunnelBuildRequest (request);
+			HandleTunnelBuildRequest (request);
+			return true;
 		}
-		const uint8_t * payload = msg->GetPayload ();
-		uint16_t len = bufbe16toh(payload + TUNNEL_GATEWAY_HEADER_LENGTH_OFFSET);
-		// we make payload as new I2NP message to send
-		msg->offset += I2NP_HEADER_SIZE + TUNNEL_GATEWAY_HEADER_SIZE;
-		if (msg->offset + len > msg->len)
+		return m_BuildRequestsPool->Offer ({request, [request]()
+			{
+				DecryptTunnelBuildRequest (request);
+				return [request]() { HandleTunnelBuildRequest (request); };
+			}});
+	}
+
+	void Tunnels::PostTunnelBuildResult (const std::function<void(void)>& result)
+	{
+		bool wasEmpty;
 		{
-			LogPrint (eLogError, "Tunnel: gateway payload ", (int)len, " exceeds message length ", (int)msg->len);
-			return;
+			std::unique_lock<std::mutex> l(m_BuildResultsMutex);
+			wasEmpty = m_BuildResults.empty ();
+			m_BuildResults.push_back (result);
 		}
-		msg->len = msg->offset + len;
-		auto typeID = msg->GetTypeID ();
-		LogPrint (eLogDebug, "Tunnel: gateway of ", (int) len, " bytes for tunnel ", tunnel->GetTunnelID (), ", msg type ", (int)typeID);
+		// empty message through the queue, since waking up without it might be missed between handling and waiting
+		if (wasEmpty) m_Queue.Put (nullptr);
+	}
 
-		if (IsRouterInfoMsg (msg) || typeID == eI2NPDatabaseSearchReply)
-			// transit DatabaseStore my contain new/updated RI
-			// or DatabaseSearchReply with new routers
-			i2p::data::netdb.PostI2NPMsg (CopyI2NPMessage (msg));
-		tunnel->SendTunnelDataMsg (msg);
+	void Tunnels::HandleTunnelBuildResults ()
+	{
+		std::vector<std::function<void(void)> > results;
+		{
+			std::unique_lock<std::mutex> l(m_BuildResultsMutex);
+			if (m_BuildResults.empty ()) return;
+			results.swap (m_BuildResults);
+		}
+		for (auto& it: results)
+			it ();
 	}
 
 	void Tunnels::ManageTunnels ()
@@ -715,7 +881,7 @@ namespace tunnel
 					auto pool = tunnel->GetTunnelPool ();
 					if (pool)
 						pool->TunnelExpired (tunnel);
-					m_Tunnels.erase (tunnel->GetTunnelID ());
+					GetShard (tunnel->GetTunnelID ()).RemoveTunnel (tunnel->GetTunnelID ());
 					it = m_InboundTunnels.erase (it);
 				}
 				else
@@ -735,8 +901,6 @@ namespace tunnel
 
 						if (ts + TUNNEL_EXPIRATION_THRESHOLD > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
 							tunnel->SetState (eTunnelStateExpiring);
-						else // we don't need to cleanup expiring tunnels
-							tunnel->Cleanup ();
 					}
 					it++;
 				}
@@ -780,20 +944,19 @@ namespace tunnel
 	void Tunnels::ManageTransitTunnels ()
 	{
 		uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
-		for (auto it = m_TransitTunnels.begin (); it != m_TransitTunnels.end ();)
+		uint32_t generation = ts - TUNNEL_EXPIRATION_TIMEOUT; // transit tunnels are added with creation time
+		for (int i = 0; i < m_NumShards; i++)
+			m_Shards[i]->ExpireTunnels (generation);
+		std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
+		for (size_t i = 0; i < m_TransitTunnels.size ();)
 		{
-			auto tunnel = *it;
-			if (ts > tunnel->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
+			if (m_TransitTunnels[i]->GetCreationTime () < generation)
 			{
-				LogPrint (eLogDebug, "Tunnel: Transit tunnel with id ", tunnel->GetTunnelID (), " expired");
-				m_Tunnels.erase (tunnel->GetTunnelID ());
-				it = m_TransitTunnels.erase (it);
+				m_TransitTunnels[i] = m_TransitTunnels.back ();
+				m_TransitTunnels.pop_back ();
 			}
 			else
-			{
-				tunnel->Cleanup ();
-				it++;
-			}
+				i++;
 		}
 	}
 
@@ -810,14 +973,52 @@ namespace tunnel
 		}
 	}
 
+	bool Tunnels::IsTunnelDataMsg (std::shared_ptr<const I2NPMessage> msg) const
+	{
+		auto typeID = msg->GetTypeID ();
+		return typeID == eI2NPTunnelData || typeID == eI2NPTunnelGateway;
+	}
+
 	void Tunnels::PostTunnelData (std::shared_ptr<I2NPMessage> msg)
 	{
-		if (msg) m_Queue.Put (msg);
+		if (!msg) return;
+		if (m_NumShards && IsTunnelDataMsg (msg))
+			GetShard (bufbe32toh (msg->GetPayload ())).PostTunnelData (msg);
+		else
+			m_Queue.Put (msg);
 	}
 
 	void Tunnels::PostTunnelData (const std::vector<std::shared_ptr<I2NPMessage> >& msgs)
 	{
-		m_Queue.Put (msgs);
+		int numShards = m_NumShards;
+		if (numShards == 1)
+		{
+			// messages of the same tunnel go together, keep the batch as is
+			bool allData = true;
+			for (const auto& it: msgs)
+				if (!IsTunnelDataMsg (it)) { allData = false; break; }
+			if (allData)
+			{
+				m_Shards[0]->PostTunnelData (msgs);
+				return;
+			}
+		}
+		if (numShards > 0)
+		{
+			// split by shard preserving order within each of them
+			std::vector<std::shared_ptr<I2NPMessage> > shardMsgs[MAX_NUM_TUNNELS_SHARDS];
+			for (const auto& it: msgs)
+			{
+				if (IsTunnelDataMsg (it))
+					shardMsgs[bufbe32toh (it->GetPayload ()) % numShards].push_back (it);
+				else
+					m_Queue.Put (it);
+			}
+			for (int i = 0; i < numShards; i++)
+				m_Shards[i]->PostTunnelData (shardMsgs[i]);
+		}
+		else
+			m_Queue.Put (msgs);
 	}
 
 	template<class TTunnel>
@@ -870,7 +1071,7 @@ namespace tunnel
 
 	void Tunnels::AddInboundTunnel (std::shared_ptr<InboundTunnel> newTunnel)
 	{
-		if (m_Tunnels.emplace (newTunnel->GetTunnelID (), newTunnel).second)
+		if (GetShard (newTunnel->GetTunnelID ()).AddTunnel (newTunnel))
 		{
 			m_InboundTunnels.push_back (newTunnel);
 			auto pool = newTunnel->GetTunnelPool ();
@@ -899,7 +1100,7 @@ namespace tunnel
 		auto inboundTunnel = std::make_shared<ZeroHopsInboundTunnel> ();
 		inboundTunnel->SetState (eTunnelStateEstablished);
 		m_InboundTunnels.push_back (inboundTunnel);
-		m_Tunnels[inboundTunnel->GetTunnelID ()] = inboundTunnel;
+		GetShard (inboundTunnel->GetTunnelID ()).AddTunnel (inboundTunnel);
 		return inboundTunnel;
 	}
 
@@ -916,7 +1117,7 @@ namespace tunnel
 	{
 		int timeout = 0;
 		uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
-		// TODO: possible race condition with I2PControl
+		std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
 		for (const auto& it : m_TransitTunnels)
 		{
 			int t = it->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT - ts;
@@ -925,9 +1126,23 @@ namespace tunnel
 		return timeout;
 	}
 
+	int Tunnels::GetQueueSize ()
+	{
+		int size = m_Queue.GetSize ();
+		for (int i = 0; i < m_NumShards; i++)
+			size += m_Shards[i]->GetQueueSize ();
+		return size;
+	}
+
+	std::vector<std::shared_ptr<TransitTunnel> > Tunnels::GetTransitTunnels () const
+	{
+		std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
+		return m_TransitTunnels;
+	}
+
 	size_t Tunnels::CountTransitTunnels() const
 	{
-		// TODO: locking
+		std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
 		return m_TransitTunnels.size();
 	}
 
@@ -10,12 +10,17 @@
 #include <thread>
 #include <mutex>
 #include <memory>
+#include <array>
+#include <atomic>
+#include <functional>
 #include "Queue.h"
+#include "CryptoWorker.h"
 #include "Crypto.h"
 #include "TunnelConfig.h"
 #include "TunnelPool.h"
 #include "TransitTunnel.h"
 #include "TunnelEndpoint.h"
+#include "TunnelsTable.h"
 #include "TunnelGateway.h"
 #include "TunnelBase.h"
 #include "I2NPProtocol.h"
@@ -67,6 +72,11 @@ namespace tunnel
 	const int TUNNEL_RECREATION_THRESHOLD = 90; // 1.5 minutes
 	const int TUNNEL_CREATION_TIMEOUT = 30; // 30 seconds
 	const int STANDARD_NUM_RECORDS = 5; // in VariableTunnelBuild message
+	const int TUNNELS_MANAGE_INTERVAL = 15; // 15 seconds
+	const int MAX_NUM_TUNNELS_SHARDS = 64;
+	const size_t TUNNELS_SHARD_BATCH_SIZE = 256;
+	const int MAX_NUM_TUNNEL_BUILD_THREADS = 16;
+	const size_t MAX_TUNNEL_BUILD_REQUESTS_BACKLOG = 64; // requests above are dropped
 
 	enum TunnelState
 	{
@@ -212,6 +222,41 @@ namespace tunnel
 			size_t m_NumSentBytes;
 	};
 
+	class TunnelsShard
+	{
+		public:
+
+			TunnelsShard (int index);
+			~TunnelsShard ();
+			void Start ();
+			void Stop ();
+
+			int GetIndex () const { return m_Index; };
+			std::shared_ptr<TunnelBase> GetTunnel (uint32_t tunnelID);
+			bool AddTunnel (std::shared_ptr<TunnelBase> tunnel, uint32_t generation = 0); // false if already exists
+			void RemoveTunnel (uint32_t tunnelID);
+			void ExpireTunnels (uint32_t generation); // remove tunnels added with older generation
+			void PostTunnelData (std::shared_ptr<I2NPMessage> msg) { m_Queue.Put (msg); };
+			void PostTunnelData (const std::vector<std::shared_ptr<I2NPMessage> >& msgs) { m_Queue.Put (msgs); };
+			int GetQueueSize () { return m_Queue.GetSize (); };
+
+		private:
+
+			void Run ();
+			void HandleTunnelGatewayMsg (std::shared_ptr<TunnelBase> tunnel, std::shared_ptr<I2NPMessage> msg);
+			void CleanupTunnels ();
+
+		private:
+
+			int m_Index;
+			bool m_IsRunning;
+			std::thread * m_Thread;
+			std::mutex m_TunnelsMutex;
+			TunnelsTable<TunnelBase> m_Tunnels; // tunnelID->tunnel known by this id
+			i2p::util::Queue<std::shared_ptr<I2NPMessage> > m_Queue; // TunnelData and TunnelGateway only
+			TunnelTransportSender m_TransportSender; // flushed after every batch
+	};
+
 	class Tunnels
 	{
 		public:
@@ -235,6 +280,8 @@ namespace tunnel
 			std::shared_ptr<OutboundTunnel> CreateOutboundTunnel (std::shared_ptr<TunnelConfig> config);
 			void PostTunnelData (std::shared_ptr<I2NPMessage> msg);
 			void PostTunnelData (const std::vector<std::shared_ptr<I2NPMessage> >& msgs);
+			bool PostTunnelBuildRequest (std::shared_ptr<TunnelBuildRequest> request); // false if backlog is full
+			void PostTunnelBuildResult (const std::function<void(void)>& result);
 			void AddPendingTunnel (uint32_t replyMsgID, std::shared_ptr<InboundTunnel> tunnel);
 			void AddPendingTunnel (uint32_t replyMsgID, std::shared_ptr<OutboundTunnel> tunnel);
 			std::shared_ptr<TunnelPool> CreateTunnelPool (int numInboundHops,
@@ -250,9 +297,11 @@ namespace tunnel
 			template<class TTunnel>
 			std::shared_ptr<TTunnel> GetPendingTunnel (uint32_t replyMsgID, const std::map<uint32_t, std::shared_ptr<TTunnel> >& pendingTunnels);
 
-			void HandleTunnelGatewayMsg (std::shared_ptr<TunnelBase> tunnel, std::shared_ptr<I2NPMessage> msg);
+			TunnelsShard& GetShard (uint32_t tunnelID) { return *m_Shards[tunnelID % m_NumShards]; };
+			bool IsTunnelDataMsg (std::shared_ptr<const I2NPMessage> msg) const;
 
 			void Run ();
+			void HandleTunnelBuildResults ();
 			void ManageTunnels ();
 			void ManageOutboundTunnels ();
 			void ManageInboundTunnels ();
@@ -273,12 +322,17 @@ namespace tunnel
 			std::map<uint32_t, std::shared_ptr<OutboundTunnel> > m_PendingOutboundTunnels; // by replyMsgID
 			std::list<std::shared_ptr<InboundTunnel> > m_InboundTunnels;
 			std::list<std::shared_ptr<OutboundTunnel> > m_OutboundTunnels;
-			std::list<std::shared_ptr<TransitTunnel> > m_TransitTunnels;
-			std::unordered_map<uint32_t, std::shared_ptr<TunnelBase> > m_Tunnels; // tunnelID->tunnel known by this id
+			mutable std::mutex m_TransitTunnelsMutex;
+			std::vector<std::shared_ptr<TransitTunnel> > m_TransitTunnels; // unordered
+			std::array<std::unique_ptr<TunnelsShard>, MAX_NUM_TUNNELS_SHARDS> m_Shards; // TunnelData and TunnelGateway by tunnelID
+			std::atomic<int> m_NumShards; // 0 until started
 			std::mutex m_PoolsMutex;
 			std::list<std::shared_ptr<TunnelPool>> m_Pools;
 			std::shared_ptr<TunnelPool> m_ExploratoryPool;
-			i2p::util::Queue<std::shared_ptr<I2NPMessage> > m_Queue;
+			i2p::util::Queue<std::shared_ptr<I2NPMessage> > m_Queue; // tunnel build messages, nullptr if build results are posted
+			std::unique_ptr<i2p::worker::ThreadPool<TunnelBuildRequest> > m_BuildRequestsPool;
+			std::mutex m_BuildResultsMutex;
+			std::vector<std::function<void(void)> > m_BuildResults; // from build requests pool
 
 			// some stats
 			int m_NumSuccesiveTunnelCreations, m_NumFailedTunnelCreations;
@@ -288,13 +342,14 @@ namespace tunnel
 			// for HTTP only
 			const decltype(m_OutboundTunnels)& GetOutboundTunnels () const { return m_OutboundTunnels; };
 			const decltype(m_InboundTunnels)& GetInboundTunnels () const { return m_InboundTunnels; };
-			const decltype(m_TransitTunnels)& GetTransitTunnels () const { return m_TransitTunnels; };
+			decltype(m_TransitTunnels) GetTransitTunnels () const; // copy, since updated by tunnels thread
 
 			size_t CountTransitTunnels() const;
 			size_t CountInboundTunnels() const;
 			size_t CountOutboundTunnels() const;
 
-			int GetQueueSize () { return m_Queue.GetSize (); };
+			int GetQueueSize ();
+			int GetNumShards () const { return m_NumShards; };
 			int GetTunnelCreationSuccessRate () const // in percents
 			{
 				int totalNum = m_NumSuccesiveTunnelCreations + m_NumFailedTunnelCreations;
@@ -304,6 +359,18 @@ namespace tunnel
 
 	extern Tunnels tunnels;
 }
+
+namespace worker
+{
+	template<>
+	struct ResultPoster<TunnelBuildRequest> // back to tunnels thread
+	{
+		static void Post (std::shared_ptr<TunnelBuildRequest> /*request*/, const std::function<void(void)>& result)
+		{
+			i2p::tunnel::tunnels.PostTunnelBuildResult (result);
+		}
+	};
+}
 }
 
 #endif
@@ -21,6 +21,7 @@ namespace tunnel
 		eDeliveryTypeTunnel = 1,
 		eDeliveryTypeRouter = 2
 	};
+	class TunnelTransportSender;
 	struct TunnelMessageBlock
 	{
 		TunnelDeliveryType deliveryType;
@@ -41,7 +42,7 @@ namespace tunnel
 
 			virtual void HandleTunnelDataMsg (std::shared_ptr<const i2p::I2NPMessage> tunnelMsg) = 0;
 			virtual void SendTunnelDataMsg (std::shared_ptr<i2p::I2NPMessage> msg) = 0;
-			virtual void FlushTunnelDataMsgs () {};
+			virtual void FlushTunnelDataMsgs (TunnelTransportSender& /*sender*/) {};
 			virtual void EncryptTunnelMsg (std::shared_ptr<const I2NPMessage> in, std::shared_ptr<I2NPMessage> out) = 0;
 			uint32_t GetNextTunnelID () const { return m_NextTunnelID; };
 			const i2p::data::IdentHash& GetNextIdentHash () const { return m_NextIdent; };
@@ -44,7 +44,7 @@ namespace tunnel
 				bool isFollowOnFragment = flag & 0x80, isLastFragment = true;
 				uint32_t msgID = 0;
 				int fragmentNum = 0;
-				TunnelMessageBlockEx m;
+				TunnelMessageBlock m;
 				if (!isFollowOnFragment)
 				{
 					// first fragment
@@ -96,42 +96,30 @@ namespace tunnel
 					LogPrint (eLogError, "TunnelMessage: fragment is too long ", (int)size);
 					return;
 				}
-				if (fragment + size < decrypted + TUNNEL_DATA_ENCRYPTED_SIZE)
-				{
-					// this is not last message. we have to copy it
-					m.data = NewI2NPTunnelMessage ();
-					m.data->offset += TUNNEL_GATEWAY_HEADER_SIZE; // reserve room for TunnelGateway header
-					m.data->len += TUNNEL_GATEWAY_HEADER_SIZE;
-					*(m.data) = *msg;
-				}
-				else
-					m.data = msg;
-
 				if (!isFollowOnFragment && isLastFragment)
-					HandleNextMessage (m);
-				else
 				{
-					if (msgID) // msgID is presented, assume message is fragmented
+					if (fragment + size < decrypted + TUNNEL_DATA_ENCRYPTED_SIZE)
 					{
-						if (!isFollowOnFragment) // create new incomlete message
-						{
-							m.nextFragmentNum = 1;
-							m.receiveTime = i2p::util::GetMillisecondsSinceEpoch ();
-							auto ret = m_IncompleteMessages.insert (std::pair<uint32_t, TunnelMessageBlockEx>(msgID, m));
-							if (ret.second)
-								HandleOutOfSequenceFragments (msgID, ret.first->second);
-							else
-								LogPrint (eLogError, "TunnelMessage: Incomplete message ", msgID, " already exists");
-						}
-						else
-						{
-							m.nextFragmentNum = fragmentNum;
-							HandleFollowOnFragment (msgID, isLastFragment, m);
-						}
+						// this is not last message. we have to copy it
+						m.data = NewI2NPTunnelMessage ();
+						m.data->offset += TUNNEL_GATEWAY_HEADER_SIZE; // reserve room for TunnelGateway header
+						m.data->len += TUNNEL_GATEWAY_HEADER_SIZE;
+						*(m.data) = *msg;
 					}
 					else
-						LogPrint (eLogError, "TunnelMessage: Message is fragmented, but msgID is not presented");
+						m.data = msg;
+					HandleNextMessage (m);
+				}
+				else if (msgID) // msgID is presented, assume message is fragmented
+				{
+					// fragments are copied straight to the message being assembled
+					if (!isFollowOnFragment)
+						HandleFirstFragment (msgID, m, fragment, size);
+					else
+						HandleFollowOnFragment (msgID, fragmentNum, isLastFragment, fragment, size);
 				}
+				else
+					LogPrint (eLogError, "TunnelMessage: Message is fragmented, but msgID is not presented");
 
 				fragment += size;
 			}
@@ -140,27 +128,59 @@ namespace tunnel
 			LogPrint (eLogError, "TunnelMessage: zero not found");
 	}
 
-	void TunnelEndpoint::HandleFollowOnFragment (uint32_t msgID, bool isLastFragment, const TunnelMessageBlockEx& m)
+	void TunnelEndpoint::HandleFirstFragment (uint32_t msgID, const TunnelMessageBlock& m, const uint8_t * fragment, size_t size)
 	{
-		auto fragment = m.data->GetBuffer ();
-		auto size = m.data->GetLength ();
+		// I2NP header tells total size, so the message is assembled in one buffer
+		size_t totalSize = (size >= I2NP_HEADER_SIZE) ? I2NP_HEADER_SIZE + bufbe16toh (fragment + I2NP_HEADER_SIZE_OFFSET) : I2NP_MAX_MESSAGE_SIZE;
+		if (totalSize < size || totalSize > I2NP_MAX_MESSAGE_SIZE)
+		{
+			LogPrint (eLogError, "TunnelMessage: Invalid size ", totalSize, " of message ", msgID, ", dropped");
+			return;
+		}
 		auto it = m_IncompleteMessages.find (msgID);
-		if (it != m_IncompleteMessages.end())
+		if (it != m_IncompleteMessages.end ())
+		{
+			if (it->second.data)
+			{
+				LogPrint (eLogError, "TunnelMessage: Incomplete message ", msgID, " already exists");
+				return;
+			}
+		}
+		else
+		{
+			it = m_IncompleteMessages.emplace (msgID, IncompleteMessage ()).first;
+			it->second.outOfSequenceFragments = 0;
+		}
+		auto& msg = it->second;
+		static_cast<TunnelMessageBlock&>(msg) = m;
+		msg.data = NewI2NPMessage (totalSize + TUNNEL_GATEWAY_HEADER_SIZE);
+		if (msg.data->offset + TUNNEL_GATEWAY_HEADER_SIZE + totalSize <= msg.data->maxLen)
+			msg.data->offset += TUNNEL_GATEWAY_HEADER_SIZE; // reserve room for TunnelGateway header
+		msg.data->len = msg.data->offset;
+		if (msg.data->offset + totalSize > msg.data->maxLen)
+		{
+			LogPrint (eLogError, "TunnelMessage: I2NP buffer ", msg.data->maxLen, " is not enough for message ", msgID);
+			m_IncompleteMessages.erase (it);
+			return;
+		}
+		msg.data->Concat (fragment, size);
+		msg.totalSize = totalSize;
+		msg.nextFragmentNum = 1;
+		msg.receiveTime = i2p::util::GetMillisecondsSinceEpoch ();
+		HandleOutOfSequenceFragments (msgID, msg);
+	}
+
+	void TunnelEndpoint::HandleFollowOnFragment (uint32_t msgID, uint8_t fragmentNum, bool isLastFragment, const uint8_t * fragment, size_t size)
+	{
+		auto it = m_IncompleteMessages.find (msgID);
+		if (it != m_IncompleteMessages.end() && it->second.data)
 		{
 			auto& msg = it->second;
-			if (m.nextFragmentNum == msg.nextFragmentNum)
+			if (fragmentNum == msg.nextFragmentNum)
 			{
-				if (msg.data->len + size < I2NP_MAX_MESSAGE_SIZE) // check if message is not too long
+				if (msg.data->GetLength () + size <= msg.totalSize) // check if message is not too long
 				{
-					if (msg.data->len + size > msg.data->maxLen)
-					{
-					//	LogPrint (eLogWarning, "TunnelMessage: I2NP message size ", msg.data->maxLen, " is not enough");
-						auto newMsg = NewI2NPMessage ();
-						*newMsg = *(msg.data);
-						msg.data = newMsg;
-					}
-					if (msg.data->Concat (fragment, size) < size) // concatenate fragment
-						LogPrint (eLogError, "TunnelMessage: I2NP buffer overflow ", msg.data->maxLen);
+					msg.data->Concat (fragment, size); // concatenate fragment
 					if (isLastFragment)
 					{
 						// message complete
@@ -175,30 +195,52 @@ namespace tunnel
 				}
 				else
 				{
-					LogPrint (eLogError, "TunnelMessage: Fragment ", m.nextFragmentNum, " of message ", msgID, "exceeds max I2NP message size, message dropped");
+					LogPrint (eLogError, "TunnelMessage: Fragment ", (int)fragmentNum, " of message ", msgID, " exceeds message size ", msg.totalSize, ", message dropped");
 					m_IncompleteMessages.erase (it);
 				}
 			}
 			else
 			{
-				LogPrint (eLogWarning, "TunnelMessage: Unexpected fragment ", (int)m.nextFragmentNum, " instead ", (int)msg.nextFragmentNum, " of message ", msgID, ", saved");
-				AddOutOfSequenceFragment (msgID, m.nextFragmentNum, isLastFragment, m.data);
+				LogPrint (eLogWarning, "TunnelMessage: Unexpected fragment ", (int)fragmentNum, " instead ", (int)msg.nextFragmentNum, " of message ", msgID, ", saved");
+				AddOutOfSequenceFragment (msgID, fragmentNum, isLastFragment, fragment, size);
 			}
 		}
 		else
 		{
 			LogPrint (eLogWarning, "TunnelMessage: First fragment of message ", msgID, " not found, saved");
-			AddOutOfSequenceFragment (msgID, m.nextFragmentNum, isLastFragment, m.data);
+			AddOutOfSequenceFragment (msgID, fragmentNum, isLastFragment, fragment, size);
 		}
 	}
 
-	void TunnelEndpoint::AddOutOfSequenceFragment (uint32_t msgID, uint8_t fragmentNum, bool isLastFragment, std::shared_ptr<I2NPMessage> data)
+	void TunnelEndpoint::AddOutOfSequenceFragment (uint32_t msgID, uint8_t fragmentNum, bool isLastFragment, const uint8_t * fragment, size_t size)
 	{
-		if (!m_OutOfSequenceFragments.insert ({{msgID, fragmentNum}, {isLastFragment, data, i2p::util::GetMillisecondsSinceEpoch () }}).second)
-			LogPrint (eLogInfo, "TunnelMessage: duplicate out-of-sequence fragment ", fragmentNum, " of message ", msgID);
+		auto it = m_IncompleteMessages.find (msgID);
+		if (it == m_IncompleteMessages.end ())
+		{
+			it = m_IncompleteMessages.emplace (msgID, IncompleteMessage ()).first;
+			it->second.nextFragmentNum = 0;
+			it->second.totalSize = 0;
+			it->second.outOfSequenceFragments = 0;
+			it->second.receiveTime = i2p::util::GetMillisecondsSinceEpoch ();
+		}
+		auto& msg = it->second;
+		uint64_t mask = (uint64_t)1 << fragmentNum; // fragment# is 6 bits
+		if (msg.outOfSequenceFragments & mask)
+		{
+			LogPrint (eLogInfo, "TunnelMessage: duplicate out-of-sequence fragment ", (int)fragmentNum, " of message ", msgID);
+			return;
+		}
+		if (msg.fragmentsData.size () + size > I2NP_MAX_MESSAGE_SIZE)
+		{
+			LogPrint (eLogError, "TunnelMessage: Out-of-sequence fragments of message ", msgID, " exceed max I2NP message size, dropped");
+			return;
+		}
+		msg.outOfSequenceFragments |= mask;
+		msg.fragments.push_back ({fragmentNum, isLastFragment, (uint16_t)size, msg.fragmentsData.size ()});
+		msg.fragmentsData.insert (msg.fragmentsData.end (), fragment, fragment + size);
 	}
 
-	void TunnelEndpoint::HandleOutOfSequenceFragments (uint32_t msgID, TunnelMessageBlockEx& msg)
+	void TunnelEndpoint::HandleOutOfSequenceFragments (uint32_t msgID, IncompleteMessage& msg)
 	{
 		while (ConcatNextOutOfSequenceFragment (msgID, msg))
 		{
@@ -211,30 +253,32 @@ namespace tunnel
 		}
 	}
 
-	bool TunnelEndpoint::ConcatNextOutOfSequenceFragment (uint32_t msgID, TunnelMessageBlockEx& msg)
+	bool TunnelEndpoint::ConcatNextOutOfSequenceFragment (uint32_t msgID, IncompleteMessage& msg)
 	{
-		auto it = m_OutOfSequenceFragments.find ({msgID, msg.nextFragmentNum});
-		if (it != m_OutOfSequenceFragments.end ())
-		{
-			LogPrint (eLogDebug, "TunnelMessage: Out-of-sequence fragment ", (int)msg.nextFragmentNum, " of message ", msgID, " found");
-			size_t size = it->second.data->GetLength ();
-			if (msg.data->len + size > msg.data->maxLen)
+		if (msg.nextFragmentNum >= 64 || !(msg.outOfSequenceFragments & ((uint64_t)1 << msg.nextFragmentNum))) return false;
+		for (const auto& it: msg.fragments)
+			if (it.fragmentNum == msg.nextFragmentNum)
 			{
-				LogPrint (eLogWarning, "TunnelMessage: Tunnel endpoint I2NP message size ", msg.data->maxLen, " is not enough");
-				auto newMsg = NewI2NPMessage ();
-				*newMsg = *(msg.data);
-				msg.data = newMsg;
+				LogPrint (eLogDebug, "TunnelMessage: Out-of-sequence fragment ", (int)msg.nextFragmentNum, " of message ", msgID, " found");
+				if (msg.data->GetLength () + it.size > msg.totalSize)
+				{
+					LogPrint (eLogError, "TunnelMessage: Out-of-sequence fragment ", (int)msg.nextFragmentNum, " of message ", msgID, " exceeds message size ", msg.totalSize);
+					return false;
+				}
+				msg.data->Concat (msg.fragmentsData.data () + it.offset, it.size); // concatenate out-of-sync fragment
+				msg.outOfSequenceFragments &= ~((uint64_t)1 << msg.nextFragmentNum);
+				if (it.isLastFragment)
+					// message complete
+					msg.nextFragmentNum = 0;
+				else
+					msg.nextFragmentNum++;
+				if (!msg.outOfSequenceFragments)
+				{
+					msg.fragments.clear ();
+					msg.fragmentsData.clear ();
+				}
+				return true;
 			}
-			if (msg.data->Concat (it->second.data->GetBuffer (), size) < size) // concatenate out-of-sync fragment
-				LogPrint (eLogError, "TunnelMessage: Tunnel endpoint I2NP buffer overflow ", msg.data->maxLen);
-			if (it->second.isLastFragment)
-				// message complete
-				msg.nextFragmentNum = 0;
-			else
-				msg.nextFragmentNum++;
-			m_OutOfSequenceFragments.erase (it);
-			return true;
-		}
 		return false;
 	}
 
@@ -277,15 +321,7 @@ namespace tunnel
 	void TunnelEndpoint::Cleanup ()
 	{
 		auto ts = i2p::util::GetMillisecondsSinceEpoch ();
-		// out-of-sequence fragments
-		for (auto it = m_OutOfSequenceFragments.begin (); it != m_OutOfSequenceFragments.end ();)
-		{
-			if (ts > it->second.receiveTime + i2p::I2NP_MESSAGE_EXPIRATION_TIMEOUT)
-				it = m_OutOfSequenceFragments.erase (it);
-			else
-				++it;
-		}
-		// incomplete messages
+		// incomplete messages and out-of-sequence fragments
 		for (auto it = m_IncompleteMessages.begin (); it != m_IncompleteMessages.end ();)
 		{
 			if (ts > it->second.receiveTime + i2p::I2NP_MESSAGE_EXPIRATION_TIMEOUT)
@@ -2,7 +2,8 @@
 #define TUNNEL_ENDPOINT_H__
 
 #include <inttypes.h>
-#include <map>
+#include <unordered_map>
+#include <vector>
 #include <string>
 #include "I2NPProtocol.h"
 #include "TunnelBase.h"
@@ -13,17 +14,22 @@ namespace tunnel
 {
 	class TunnelEndpoint
 	{
-		struct TunnelMessageBlockEx: public TunnelMessageBlock
+		struct Fragment
 		{
-			uint64_t receiveTime; // milliseconds since epoch
-			uint8_t nextFragmentNum;
+			uint8_t fragmentNum;
+			bool isLastFragment;
+			uint16_t size;
+			size_t offset; // in fragmentsData
 		};
 
-		struct Fragment
+		struct IncompleteMessage: public TunnelMessageBlock // data is nullptr until first fragment arrives
 		{
-			bool isLastFragment;
-			std::shared_ptr<I2NPMessage> data;
 			uint64_t receiveTime; // milliseconds since epoch
+			uint8_t nextFragmentNum;
+			size_t totalSize; // from I2NP header of first fragment
+			uint64_t outOfSequenceFragments; // bitmap of fragment# received before their turn
+			std::vector<Fragment> fragments; // out-of-sequence
+			std::vector<uint8_t> fragmentsData;
 		};
 
 		public:
@@ -37,17 +43,17 @@ namespace tunnel
 
 		private:
 
-			void HandleFollowOnFragment (uint32_t msgID, bool isLastFragment, const TunnelMessageBlockEx& m);
+			void HandleFirstFragment (uint32_t msgID, const TunnelMessageBlock& m, const uint8_t * fragment, size_t size);
+			void HandleFollowOnFragment (uint32_t msgID, uint8_t fragmentNum, bool isLastFragment, const uint8_t * fragment, size_t size);
 			void HandleNextMessage (const TunnelMessageBlock& msg);
 
-			void AddOutOfSequenceFragment (uint32_t msgID, uint8_t fragmentNum, bool isLastFragment, std::shared_ptr<I2NPMessage> data);
-			bool ConcatNextOutOfSequenceFragment (uint32_t msgID, TunnelMessageBlockEx& msg); // true if something added
-			void HandleOutOfSequenceFragments (uint32_t msgID, TunnelMessageBlockEx& msg);
+			void AddOutOfSequenceFragment (uint32_t msgID, uint8_t fragmentNum, bool isLastFragment, const uint8_t * fragment, size_t size);
+			bool ConcatNextOutOfSequenceFragment (uint32_t msgID, IncompleteMessage& msg); // true if something added
+			void HandleOutOfSequenceFragments (uint32_t msgID, IncompleteMessage& msg);
 
 		private:
 
-			std::map<uint32_t, TunnelMessageBlockEx> m_IncompleteMessages;
-			std::map<std::pair<uint32_t, uint8_t>, Fragment> m_OutOfSequenceFragments; // (msgID, fragment#)->fragment
+			std::unordered_map<uint32_t, IncompleteMessage> m_IncompleteMessages; // msgID -> message being assembled
 			bool m_IsInbound;
 			size_t m_NumReceivedBytes;
 	};
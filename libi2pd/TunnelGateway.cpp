@@ -201,8 +201,21 @@ namespace tunnel
 
 	void TunnelGateway::SendBuffer ()
 	{
-		m_Buffer.CompleteCurrentTunnelDataMessage ();
 		std::vector<std::shared_ptr<I2NPMessage> > newTunnelMsgs;
+		CreateTunnelDataMsgs (newTunnelMsgs);
+		i2p::transport::transports.SendMessages (m_Tunnel->GetNextIdentHash (), newTunnelMsgs);
+	}
+
+	void TunnelGateway::SendBuffer (TunnelTransportSender& sender)
+	{
+		std::vector<std::shared_ptr<I2NPMessage> > newTunnelMsgs;
+		CreateTunnelDataMsgs (newTunnelMsgs);
+		sender.PutTunnelDataMsgs (m_Tunnel->GetNextIdentHash (), newTunnelMsgs);
+	}
+
+	void TunnelGateway::CreateTunnelDataMsgs (std::vector<std::shared_ptr<I2NPMessage> >& newTunnelMsgs)
+	{
+		m_Buffer.CompleteCurrentTunnelDataMessage ();
 		const auto& tunnelDataMsgs = m_Buffer.GetTunnelDataMsgs ();
 		for (auto& tunnelMsg : tunnelDataMsgs)
 		{
@@ -214,7 +227,20 @@ namespace tunnel
 			m_NumSentBytes += TUNNEL_DATA_MSG_SIZE;
 		}
 		m_Buffer.ClearTunnelDataMsgs ();
-		i2p::transport::transports.SendMessages (m_Tunnel->GetNextIdentHash (), newTunnelMsgs);
+	}
+
+	void TunnelTransportSender::PutTunnelDataMsgs (const i2p::data::IdentHash& to, const std::vector<std::shared_ptr<I2NPMessage> >& msgs)
+	{
+		if (msgs.empty ()) return;
+		auto& peerMsgs = m_TunnelDataMsgs[to];
+		peerMsgs.insert (peerMsgs.end (), msgs.begin (), msgs.end ());
+	}
+
+	void TunnelTransportSender::Flush ()
+	{
+		if (m_TunnelDataMsgs.empty ()) return;
+		i2p::transport::transports.SendMessages (std::move (m_TunnelDataMsgs));
+		m_TunnelDataMsgs.clear ();
 	}
 }
 }
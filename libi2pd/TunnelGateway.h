@@ -3,6 +3,7 @@
 
 #include <inttypes.h>
 #include <vector>
+#include <map>
 #include <memory>
 #include "I2NPProtocol.h"
 #include "TunnelBase.h"
@@ -33,6 +34,18 @@ namespace tunnel
 			uint8_t m_NonZeroRandomBuffer[TUNNEL_DATA_MAX_PAYLOAD_SIZE];
 	};
 
+	class TunnelTransportSender // collects TunnelData messages of different tunnels by next hop
+	{
+		public:
+
+			void PutTunnelDataMsgs (const i2p::data::IdentHash& to, const std::vector<std::shared_ptr<I2NPMessage> >& msgs);
+			void Flush (); // one vector per peer in one post to transports
+
+		protected:
+
+			std::map<i2p::data::IdentHash, std::vector<std::shared_ptr<I2NPMessage> > > m_TunnelDataMsgs;
+	};
+
 	class TunnelGateway
 	{
 		public:
@@ -42,8 +55,13 @@ namespace tunnel
 			void SendTunnelDataMsg (const TunnelMessageBlock& block);
 			void PutTunnelDataMsg (const TunnelMessageBlock& block);
 			void SendBuffer ();
+			void SendBuffer (TunnelTransportSender& sender);
 			size_t GetNumSentBytes () const { return m_NumSentBytes; };
 
+		private:
+
+			void CreateTunnelDataMsgs (std::vector<std::shared_ptr<I2NPMessage> >& msgs);
+
 		private:
 
 			TunnelBase * m_Tunnel;
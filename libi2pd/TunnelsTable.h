@@ -0,0 +1,133 @@
+#ifndef TUNNELS_TABLE_H__
+#define TUNNELS_TABLE_H__
+
+#include <inttypes.h>
+#include <vector>
+#include <memory>
+
+namespace i2p
+{
+namespace tunnel
+{
+	// open addressing table tunnelID->tunnel with linear probing
+	// removed entries are backward shifted, so no tombstones and lookup stops at first empty slot
+	template<typename T>
+	class TunnelsTable
+	{
+		struct Slot
+		{
+			uint32_t tunnelID;
+			uint32_t generation; // 0 - never expires
+			std::shared_ptr<T> tunnel; // nullptr if empty
+		};
+
+		public:
+
+			TunnelsTable (size_t capacity = 64): m_Size (0) { Resize (capacity); };
+
+			size_t GetSize () const { return m_Size; };
+			size_t GetCapacity () const { return m_Slots.size (); };
+
+			std::shared_ptr<T> Get (uint32_t tunnelID) const
+			{
+				for (size_t i = Index (tunnelID);; i = (i + 1) & m_Mask)
+				{
+					const auto& slot = m_Slots[i];
+					if (!slot.tunnel) return nullptr;
+					if (slot.tunnelID == tunnelID) return slot.tunnel;
+				}
+			}
+
+			bool Insert (uint32_t tunnelID, std::shared_ptr<T> tunnel, uint32_t generation = 0) // false if already exists
+			{
+				if ((m_Size + 1)*2 > m_Slots.size ()) Resize (m_Slots.size ()*2); // keep load factor below 1/2
+				size_t i = Index (tunnelID);
+				for (; m_Slots[i].tunnel; i = (i + 1) & m_Mask)
+					if (m_Slots[i].tunnelID == tunnelID) return false;
+				m_Slots[i] = { tunnelID, generation, tunnel };
+				m_Size++;
+				return true;
+			}
+
+			bool Remove (uint32_t tunnelID)
+			{
+				for (size_t i = Index (tunnelID); m_Slots[i].tunnel; i = (i + 1) & m_Mask)
+					if (m_Slots[i].tunnelID == tunnelID)
+					{
+						RemoveAt (i);
+						return true;
+					}
+				return false;
+			}
+
+			template<typename Expired>
+			size_t Expire (uint32_t generation, Expired expired) // remove entries older than generation, calls expired (tunnel)
+			{
+				size_t num = 0;
+				for (size_t i = 0; i < m_Slots.size ();)
+				{
+					auto& slot = m_Slots[i];
+					if (slot.tunnel && slot.generation && slot.generation < generation)
+					{
+						expired (slot.tunnel);
+						RemoveAt (i); // next entry might be shifted here
+						num++;
+					}
+					else
+						i++;
+				}
+				return num;
+			}
+
+			template<typename Visitor>
+			void ForEach (Visitor v) const
+			{
+				for (const auto& it: m_Slots)
+					if (it.tunnel) v (it.tunnel);
+			}
+
+		private:
+
+			size_t Index (uint32_t tunnelID) const
+			{
+				// tunnelIDs of a shard share low bits, so mix them by multiplicative hashing
+				return ((tunnelID * 2654435769U) >> (32 - m_Bits)) & m_Mask;
+			}
+
+			void RemoveAt (size_t i)
+			{
+				// shift following entries back if their probe sequence passes through the hole
+				for (size_t j = (i + 1) & m_Mask; m_Slots[j].tunnel; j = (j + 1) & m_Mask)
+				{
+					size_t k = Index (m_Slots[j].tunnelID);
+					if (((j - k) & m_Mask) >= ((j - i) & m_Mask))
+					{
+						m_Slots[i] = std::move (m_Slots[j]);
+						i = j;
+					}
+				}
+				m_Slots[i].tunnel = nullptr;
+				m_Size--;
+			}
+
+			void Resize (size_t capacity)
+			{
+				int bits = 1;
+				while (((size_t)1 << bits) < capacity) bits++;
+				std::vector<Slot> slots (((size_t)1 << bits));
+				m_Slots.swap (slots);
+				m_Bits = bits; m_Mask = m_Slots.size () - 1; m_Size = 0;
+				for (auto& it: slots)
+					if (it.tunnel) Insert (it.tunnelID, it.tunnel, it.generation);
+			}
+
+		private:
+
+			std::vector<Slot> m_Slots; // power of 2
+			size_t m_Size, m_Mask;
+			int m_Bits;
+	};
+}
+}
+
+#endif
@@ -1,9 +1,12 @@
 #include <cstdlib>
+#include <cstring>
 #include <string>
+#include <sstream>
 #include <boost/asio.hpp>
 
 #include "util.h"
 #include "Log.h"
+#include "Config.h"
 
 #ifdef WIN32
 #include <stdlib.h>
@@ -51,10 +54,73 @@ int inet_pton(int af, const char *src, void *dst)
 #include <ifaddrs.h>
 #endif
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace i2p
 {
 namespace util
 {
+	bool SetThreadCPUs (const std::string& cpus)
+	{
+		if (cpus.empty ()) return true;
+#if defined(__linux__)
+		cpu_set_t cpuset;
+		CPU_ZERO (&cpuset);
+		std::stringstream ss(cpus);
+		std::string range;
+		while (std::getline (ss, range, ','))
+		{
+			if (range.empty ()) continue;
+			try
+			{
+				auto pos = range.find ('-');
+				int first = std::stoi (range.substr (0, pos)), last = first;
+				if (pos != std::string::npos) last = std::stoi (range.substr (pos + 1));
+				if (first < 0 || last < first || last >= CPU_SETSIZE) throw std::out_of_range (range);
+				for (int i = first; i <= last; i++)
+					CPU_SET (i, &cpuset);
+			}
+			catch (std::exception&)
+			{
+				LogPrint (eLogError, "Util: invalid CPU range '", range, "' in ", cpus);
+				return false;
+			}
+		}
+		if (!CPU_COUNT (&cpuset)) return false;
+		int err = pthread_setaffinity_np (pthread_self (), sizeof (cpuset), &cpuset);
+		if (err)
+		{
+			LogPrint (eLogError, "Util: can't set thread CPUs ", cpus, ": ", strerror (err));
+			return false;
+		}
+		return true;
+#else
+		LogPrint (eLogWarning, "Util: thread affinity is not supported on this platform");
+		return false;
+#endif
+	}
+
+	void SetThreadAffinity (const char * subsystem)
+	{
+		std::string name ("cpuaffinity."), cpus;
+		name += subsystem;
+		i2p::config::GetOption (name, cpus);
+		if (cpus.empty ())
+		{
+			// transport receive threads share CPUs with tunnel shards, but not a particular shard's CPU:
+			// messages of a session go to shards by tunnel ID and shards themselves run on the whole set
+			bool colocate = false;
+			i2p::config::GetOption ("cpuaffinity.colocate", colocate);
+			if (colocate && (!strcmp (subsystem, "ntcp2") || !strcmp (subsystem, "ssu")))
+				i2p::config::GetOption ("cpuaffinity.tunnels", cpus);
+		}
+		if (!cpus.empty () && SetThreadCPUs (cpus))
+			LogPrint (eLogInfo, "Util: ", subsystem, " thread pinned to CPUs ", cpus);
+	}
+
 namespace net
 {
 #ifdef WIN32
@@ -122,6 +122,9 @@ namespace util
 			std::mutex m_Mutex;
 	};
 
+	bool SetThreadCPUs (const std::string& cpus); // cpus as "0-3,8", empty - don't change
+	void SetThreadAffinity (const char * subsystem); // from cpuaffinity.<subsystem>
+
 	namespace net
 	{
 		int GetMTU (const boost::asio::ip::address& localAddress);
@@ -30,6 +30,7 @@ SOURCES += DaemonQT.cpp mainwindow.cpp \
     ../../libi2pd/LeaseSet.cpp \
     ../../libi2pd/Log.cpp \
     ../../libi2pd/NetDb.cpp \
+    ../../libi2pd/NetDbStorage.cpp \
     ../../libi2pd/NetDbRequests.cpp \
     ../../libi2pd/NTCPSession.cpp \
     ../../libi2pd/Profiling.cpp \
@@ -110,10 +111,12 @@ HEADERS  += DaemonQT.h mainwindow.h \
     ../../libi2pd/I2NPProtocol.h \
     ../../libi2pd/I2PEndian.h \
     ../../libi2pd/Identity.h \
+    ../../libi2pd/KadDHT.h \
     ../../libi2pd/LeaseSet.h \
     ../../libi2pd/LittleBigEndian.h \
     ../../libi2pd/Log.h \
     ../../libi2pd/NetDb.hpp \
+    ../../libi2pd/NetDbStorage.h \
     ../../libi2pd/NetDbRequests.h \
     ../../libi2pd/NTCPSession.h \
     ../../libi2pd/Profiling.h \
@@ -137,6 +140,7 @@ HEADERS  += DaemonQT.h mainwindow.h \
     ../../libi2pd/TunnelEndpoint.h \
     ../../libi2pd/TunnelGateway.h \
     ../../libi2pd/TunnelPool.h \
+    ../../libi2pd/TunnelsTable.h \
     ../../libi2pd/util.h \
     ../../libi2pd/version.h \
     ../../libi2pd_client/AddressBook.h \
@@ -0,0 +1,42 @@
+#include <stdlib.h>
+#include <malloc.h>
+#include <atomic>
+#include <new>
+
+#include "bench-allocations.h"
+
+static std::atomic<uint64_t> g_NumAllocations (0);
+static std::atomic<int64_t> g_NumAllocatedBlocks (0), g_NumAllocatedBytes (0);
+
+void * operator new (size_t size)
+{
+	void * p = malloc (size);
+	if (!p) throw std::bad_alloc ();
+	g_NumAllocations++;
+	g_NumAllocatedBlocks++;
+	g_NumAllocatedBytes += malloc_usable_size (p);
+	return p;
+}
+
+void operator delete (void * p) noexcept
+{
+	if (!p) return;
+	g_NumAllocatedBlocks--;
+	g_NumAllocatedBytes -= malloc_usable_size (p);
+	free (p);
+}
+
+uint64_t GetNumAllocations ()
+{
+	return g_NumAllocations;
+}
+
+int64_t GetNumAllocatedBlocks ()
+{
+	return g_NumAllocatedBlocks;
+}
+
+int64_t GetNumAllocatedBytes ()
+{
+	return g_NumAllocatedBytes;
+}
@@ -0,0 +1,12 @@
+#ifndef BENCH_ALLOCATIONS_H__
+#define BENCH_ALLOCATIONS_H__
+
+#include <inttypes.h>
+
+// operator new and delete of benchmarks linked with bench-allocations.cpp count heap blocks
+
+uint64_t GetNumAllocations (); // since start
+int64_t GetNumAllocatedBlocks (); // not deleted yet
+int64_t GetNumAllocatedBytes (); // usable size of not deleted blocks
+
+#endif
@@ -0,0 +1,141 @@
+#include <cassert>
+#include <inttypes.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <list>
+#include <set>
+#include <memory>
+#include <random>
+#include <chrono>
+
+#include "KadDHT.h"
+
+// compares linear scan of std::list against i2p::data::DHTTable
+// for closest floodfill and closest 3 floodfills to random routing keys, some floodfills excluded
+
+using i2p::data::IdentHash;
+using i2p::data::XORMetric;
+
+const int NUM_LOOKUPS = 20000;
+const int NUM_LIST_LOOKUPS = 500; // linear scan is too slow for all
+const size_t NUM_CLOSEST = 3;
+
+struct Router
+{
+	IdentHash ident;
+	bool unreachable;
+	const IdentHash& GetIdentHash () const { return ident; };
+};
+
+static XORMetric Distance (const IdentHash& key1, const IdentHash& key2)
+{
+	XORMetric m;
+	for (int i = 0; i < 32; i++) m.metric[i] = key1[i] ^ key2[i];
+	return m;
+}
+
+static IdentHash CreateRandomKey (std::mt19937& rng)
+{
+	IdentHash key;
+	for (int i = 0; i < 32; i++) key[i] = rng ();
+	return key;
+}
+
+static double Elapsed (std::chrono::steady_clock::time_point start, int num)
+{
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now () - start).count ()/num;
+}
+
+static void Run (int numFloodfills)
+{
+	std::mt19937 rng (numFloodfills);
+	std::list<std::shared_ptr<Router> > list;
+	i2p::data::DHTTable<Router> table;
+	std::set<IdentHash> excluded;
+	for (int i = 0; i < numFloodfills; i++)
+	{
+		auto r = std::make_shared<Router>(Router{CreateRandomKey (rng), i % 16 == 0});
+		list.push_back (r);
+		table.Insert (r);
+		if (i % 16 == 1) excluded.insert (r->ident);
+	}
+	std::vector<IdentHash> keys;
+	for (int i = 0; i < NUM_LOOKUPS; i++)
+		keys.push_back (CreateRandomKey (rng));
+	auto filter = [&excluded](const std::shared_ptr<Router>& r)->bool
+		{
+			return !r->unreachable && !excluded.count (r->ident);
+		};
+
+	// list, same as NetDb did before, excluded checked for candidates only
+	std::vector<std::shared_ptr<Router> > closest, closest1;
+	auto start = std::chrono::steady_clock::now ();
+	for (int i = 0; i < NUM_LIST_LOOKUPS; i++)
+	{
+		std::shared_ptr<Router> r;
+		XORMetric minMetric; minMetric.SetMax ();
+		for (const auto& it: list)
+			if (!it->unreachable)
+			{
+				XORMetric m = Distance (keys[i], it->ident);
+				if (m < minMetric && !excluded.count (it->ident)) { minMetric = m; r = it; }
+			}
+		closest.push_back (r);
+	}
+	double listClosest = Elapsed (start, NUM_LIST_LOOKUPS);
+	start = std::chrono::steady_clock::now ();
+	for (int i = 0; i < NUM_LIST_LOOKUPS; i++)
+	{
+		std::vector<std::pair<XORMetric, std::shared_ptr<Router> > > sorted; // sorted by metric, up to NUM_CLOSEST
+		for (const auto& it: list)
+			if (!it->unreachable)
+			{
+				XORMetric m = Distance (keys[i], it->ident);
+				if ((sorted.size () < NUM_CLOSEST || m < sorted.back ().first) && !excluded.count (it->ident))
+				{
+					auto pos = sorted.begin ();
+					while (pos != sorted.end () && pos->first < m) pos++;
+					sorted.insert (pos, { m, it });
+					if (sorted.size () > NUM_CLOSEST) sorted.pop_back ();
+				}
+			}
+		for (auto& it: sorted) closest1.push_back (it.second);
+	}
+	double listClosestN = Elapsed (start, NUM_LIST_LOOKUPS);
+
+	// DHTTable
+	std::vector<std::shared_ptr<Router> > closest2, closest3;
+	start = std::chrono::steady_clock::now ();
+	for (const auto& key: keys)
+		closest2.push_back (table.FindClosest (key, filter));
+	double tableClosest = Elapsed (start, NUM_LOOKUPS);
+	start = std::chrono::steady_clock::now ();
+	for (const auto& key: keys)
+		table.FindClosest (key, NUM_CLOSEST, filter, closest3);
+	double tableClosestN = Elapsed (start, NUM_LOOKUPS);
+	assert (std::equal (closest.begin (), closest.end (), closest2.begin ()) &&
+		std::equal (closest1.begin (), closest1.end (), closest3.begin ()));
+
+	// update
+	start = std::chrono::steady_clock::now ();
+	for (const auto& it: list) table.Remove (it->ident);
+	for (const auto& it: list) table.Insert (it);
+	double tableUpdate = Elapsed (start, numFloodfills*2);
+	assert (table.GetSize () == list.size ());
+
+	std::cout << std::setw (6) << numFloodfills << " floodfills: closest "
+		<< std::setw (9) << listClosest << " ns (list) "
+		<< std::setw (6) << tableClosest << " ns (DHTTable), closest " << NUM_CLOSEST << " "
+		<< std::setw (9) << listClosestN << " ns (list) "
+		<< std::setw (6) << tableClosestN << " ns (DHTTable), insert/remove "
+		<< std::setw (5) << tableUpdate << " ns" << std::endl;
+}
+
+int main ()
+{
+	for (int numFloodfills: { 5000, 10000, 20000, 50000 })
+		Run (numFloodfills);
+	return 0;
+}
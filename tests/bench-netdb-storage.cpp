@@ -0,0 +1,118 @@
+#include <cassert>
+#include <inttypes.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <boost/filesystem.hpp>
+
+#include "Crypto.h"
+#include "Identity.h"
+#include "RouterInfo.h"
+#include "NetDbStorage.h"
+#include "bench-routerinfos.h"
+
+// saves synthetic RouterInfos to file per router and to single append-only log, loads them back
+// then updates 10% and removes 5% of them like SaveUpdated does, and migrates between storages
+
+using namespace i2p::data;
+
+const int UPDATED_PERCENT = 10;
+const int REMOVED_PERCENT = 5;
+
+static double Elapsed (std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now () - start).count ()/1000.0;
+}
+
+static size_t Load (NetDbStorage& storage)
+{
+	std::vector<std::shared_ptr<RouterInfo> > loaded;
+	storage.Load (loaded);
+	size_t num = 0;
+	for (const auto& it: loaded)
+		if (it) num++;
+	return num;
+}
+
+static void Run (const std::string& type, const std::vector<SyntheticRouterInfo>& routers, const std::string& place)
+{
+	size_t num = routers.size ();
+	auto start = std::chrono::steady_clock::now ();
+	{
+		auto storage = CreateNetDbStorage (type, place);
+		storage->Init ();
+		for (const auto& it: routers)
+			storage->Save (it.ident, it.buf.data (), it.buf.size ());
+		storage->Flush ();
+	}
+	double save = Elapsed (start);
+
+	start = std::chrono::steady_clock::now ();
+	auto storage = CreateNetDbStorage (type, place);
+	storage->Init ();
+	size_t numLoaded = Load (*storage);
+	double load = Elapsed (start);
+	assert (numLoaded == num);
+
+	size_t numUpdated = num*UPDATED_PERCENT/100, numRemoved = num*REMOVED_PERCENT/100;
+	start = std::chrono::steady_clock::now ();
+	for (int round = 0; round < 10; round++)
+	{
+		for (size_t i = 0; i < numUpdated; i++)
+		{
+			const auto& r = routers[(round*numUpdated + i) % num];
+			storage->Save (r.ident, r.buf.data (), r.buf.size ());
+		}
+		storage->Flush ();
+	}
+	double update = Elapsed (start)/10;
+	for (size_t i = 0; i < numRemoved; i++)
+		storage->Remove (routers[i].ident);
+	storage->Flush ();
+	uint8_t buf[MAX_RI_BUFFER_SIZE];
+	assert (!storage->Read (routers[0].ident, buf, sizeof (buf)));
+	assert (storage->Read (routers[num - 1].ident, buf, sizeof (buf)) == routers[num - 1].buf.size ());
+	storage->Close ();
+
+	storage = CreateNetDbStorage (type, place);
+	storage->Init ();
+	numLoaded = Load (*storage);
+	assert (numLoaded == num - numRemoved);
+	std::string log;
+	if (type == NETDB_STORAGE_LOG)
+		log = std::string (", log ") + std::to_string (static_cast<NetDbLogStorage *>(storage.get ())->GetSize ()/1024) + " KB";
+
+	// migrate to other storage and back
+	auto other = CreateNetDbStorage (type == NETDB_STORAGE_LOG ? NETDB_STORAGE_FILES : NETDB_STORAGE_LOG, place);
+	other->Init ();
+	start = std::chrono::steady_clock::now ();
+	size_t numMigrated = MigrateNetDbStorage (*storage, *other);
+	double migrate = Elapsed (start);
+	assert (numMigrated == numLoaded && storage->IsEmpty ());
+	storage->Init ();
+	assert (MigrateNetDbStorage (*other, *storage) == numLoaded && other->IsEmpty ());
+	storage->Clear ();
+
+	std::cout << std::setw (6) << num << " routers, " << std::setw (5) << type << ": save "
+		<< std::setw (8) << save << " ms, load " << std::setw (7) << load << " ms, update "
+		<< UPDATED_PERCENT << "% " << std::setw (7) << update << " ms, migrate " << std::setw (8) << migrate << " ms"
+		<< log << std::endl;
+}
+
+int main ()
+{
+	i2p::crypto::InitCrypto (false);
+	auto place = (boost::filesystem::temp_directory_path () / boost::filesystem::unique_path ()).string ();
+	boost::filesystem::create_directories (place);
+	for (int num: { 2000, 10000 })
+	{
+		auto routers = CreateSyntheticRouterInfos (num);
+		Run (NETDB_STORAGE_FILES, routers, place);
+		Run (NETDB_STORAGE_LOG, routers, place);
+	}
+	boost::filesystem::remove_all (place);
+	i2p::crypto::TerminateCrypto ();
+	return 0;
+}
@@ -0,0 +1,77 @@
+#include <cassert>
+#include <inttypes.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+
+#include "Queue.h"
+
+// i2p::util::Queue with 1-16 producers and one consumer draining it per element or in batches
+
+const int NUM_MSGS = 400000;
+const size_t BATCH_SIZE = 256;
+
+struct Item
+{
+	int producer, seq;
+};
+
+static void Run (int numProducers, size_t batchSize)
+{
+	i2p::util::Queue<std::shared_ptr<Item> > queue;
+	std::atomic<int> numFinished (0);
+	int numPerProducer = NUM_MSGS/numProducers;
+	auto start = std::chrono::steady_clock::now ();
+	std::vector<std::thread> producers;
+	for (int i = 0; i < numProducers; i++)
+		producers.emplace_back ([&queue, &numFinished, i, numPerProducer]()
+			{
+				for (int j = 0; j < numPerProducer; j++)
+					queue.Put (std::make_shared<Item>(Item{i, j}));
+				numFinished++;
+			});
+
+	// consumer
+	std::vector<int> lastSeq (numProducers, -1);
+	std::vector<std::shared_ptr<Item> > items;
+	int numReceived = 0;
+	for (;;)
+	{
+		bool finished = numFinished == numProducers;
+		auto item = queue.GetNextWithTimeout (10);
+		if (item)
+		{
+			items.push_back (item);
+			if (batchSize > 1) queue.GetBatch (items, batchSize - 1);
+			for (auto& it: items)
+			{
+				assert (it->seq > lastSeq[it->producer]); // FIFO per producer
+				lastSeq[it->producer] = it->seq;
+			}
+			numReceived += items.size ();
+			items.clear ();
+		}
+		else if (finished)
+			break;
+	}
+	for (auto& it: producers) it.join ();
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now () - start).count ();
+	int numSent = numPerProducer*numProducers;
+	std::cout << "batch " << std::setw (4) << batchSize << std::setw (4) << numProducers << " producers: "
+		<< std::setw (8) << (double)ns/numSent << " ns/msg, " << std::setw (10) << (uint64_t)(numReceived*1e9/ns) << " msgs/sec" << std::endl;
+	assert (numReceived == numSent);
+}
+
+int main ()
+{
+	for (int numProducers: { 1, 2, 4, 8, 16 })
+	{
+		Run (numProducers, 1);
+		Run (numProducers, BATCH_SIZE);
+	}
+	return 0;
+}
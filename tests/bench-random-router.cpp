@@ -0,0 +1,55 @@
+#include <cassert>
+#include <inttypes.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <functional>
+
+#include "Crypto.h"
+#include "Identity.h"
+#include "RouterInfo.h"
+#include "NetDb.hpp"
+#include "bench-routerinfos.h"
+
+// random router selection as done per tunnel hop, peer test and introduction over NetDb of synthetic routers
+
+using namespace i2p::data;
+
+const int NUM_LOOKUPS = 20000;
+
+static void AddRouters (int num)
+{
+	for (const auto& it: CreateSyntheticRouterInfos (num))
+		netdb.AddRouterInfo (it.buf.data (), it.buf.size ());
+}
+
+static void Measure (const char * name, std::function<std::shared_ptr<const RouterInfo> ()> select)
+{
+	int numFound = 0;
+	auto start = std::chrono::steady_clock::now ();
+	for (int i = 0; i < NUM_LOOKUPS; i++)
+		if (select ()) numFound++;
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now () - start).count ();
+	assert (numFound == NUM_LOOKUPS);
+	std::cout << std::setw (30) << name << ": " << std::setw (8) << ns/NUM_LOOKUPS << " ns" << std::endl;
+}
+
+int main ()
+{
+	i2p::crypto::InitCrypto (false);
+	for (int num: { 1000, 10000 })
+	{
+		AddRouters (num - netdb.GetNumRouters ());
+		std::cout << netdb.GetNumRouters () << " routers" << std::endl;
+		auto compatibleWith = netdb.GetRandomRouter ();
+		Measure ("GetRandomRouter", []() { return netdb.GetRandomRouter (); });
+		Measure ("GetRandomRouter (compatible)", [compatibleWith]() { return netdb.GetRandomRouter (compatibleWith); });
+		Measure ("GetHighBandwidthRandomRouter", [compatibleWith]() { return netdb.GetHighBandwidthRandomRouter (compatibleWith); });
+		Measure ("GetRandomPeerTestRouter", []() { return netdb.GetRandomPeerTestRouter (); });
+		Measure ("GetRandomIntroducer", []() { return netdb.GetRandomIntroducer (); });
+	}
+	i2p::crypto::TerminateCrypto ();
+	return 0;
+}
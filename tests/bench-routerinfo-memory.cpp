@@ -0,0 +1,73 @@
+#include <cassert>
+#include <inttypes.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <unistd.h>
+
+#include "Crypto.h"
+#include "Identity.h"
+#include "RouterInfo.h"
+#include "NetDb.hpp"
+#include "bench-allocations.h"
+#include "bench-routerinfos.h"
+
+// heap and RSS taken by RouterInfos as NetDb keeps them after saving: received (verified) and loaded from storage
+// and time of GetHighBandwidthRandomRouter over NetDb filled with them
+
+using namespace i2p::data;
+
+const int NUM_ROUTERS = 10000;
+const int NUM_LOOKUPS = 20000;
+
+static int64_t GetRSS ()
+{
+	std::ifstream f ("/proc/self/statm");
+	int64_t size = 0, resident = 0;
+	f >> size >> resident;
+	return resident*sysconf (_SC_PAGESIZE);
+}
+
+static std::vector<std::shared_ptr<RouterInfo> > Measure (const char * name, const std::vector<SyntheticRouterInfo>& buffers, bool isStored)
+{
+	int64_t numBlocks = GetNumAllocatedBlocks (), numBytes = GetNumAllocatedBytes (), rss = GetRSS ();
+	std::vector<std::shared_ptr<RouterInfo> > routers;
+	routers.reserve (buffers.size ());
+	for (const auto& it: buffers)
+	{
+		auto r = std::make_shared<RouterInfo> (it.buf.data (), it.buf.size (), isStored);
+		assert (!r->IsUnreachable ());
+		r->DeleteBuffer (); // as NetDb does after saving
+		routers.push_back (r);
+	}
+	int num = routers.size ();
+	std::cout << std::setw (9) << name << ": " << std::setw (6) << (GetNumAllocatedBytes () - numBytes)/num << " bytes in "
+		<< std::setw (4) << (double)(GetNumAllocatedBlocks () - numBlocks)/num << " heap blocks per router, RSS "
+		<< std::setw (6) << (GetRSS () - rss)/1024 << " KB for " << num << " routers" << std::endl;
+	return routers; // keep for RSS of next measurement
+}
+
+int main ()
+{
+	i2p::crypto::InitCrypto (false);
+	auto buffers = CreateSyntheticRouterInfos (NUM_ROUTERS);
+	auto received = Measure ("received", buffers, false);
+	auto stored = Measure ("stored", buffers, true);
+
+	for (const auto& it: buffers)
+		netdb.AddRouterInfo (it.buf.data (), it.buf.size ());
+	auto compatibleWith = netdb.GetRandomRouter ();
+	int numFound = 0;
+	auto start = std::chrono::steady_clock::now ();
+	for (int i = 0; i < NUM_LOOKUPS; i++)
+		if (netdb.GetHighBandwidthRandomRouter (compatibleWith)) numFound++;
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now () - start).count ();
+	assert (numFound == NUM_LOOKUPS);
+	std::cout << "GetHighBandwidthRandomRouter: " << ns/NUM_LOOKUPS << " ns for " << netdb.GetNumRouters () << " routers" << std::endl;
+	i2p::crypto::TerminateCrypto ();
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <string>
+#include <boost/asio.hpp>
+#include <openssl/rand.h>
+
+#include "RouterInfo.h"
+#include "bench-routerinfos.h"
+
+using namespace i2p::data;
+
+static std::string RandomIP (int i, bool v6)
+{
+	if (v6)
+	{
+		boost::asio::ip::address_v6::bytes_type bytes;
+		RAND_bytes (bytes.data (), bytes.size ());
+		bytes[0] = 0x20; bytes[1] = 0x01;
+		return boost::asio::ip::address_v6 (bytes).to_string ();
+	}
+	return std::to_string (1 + i % 223) + "." + std::to_string (rand () % 256) + "." + std::to_string (rand () % 256) + "." + std::to_string (rand () % 256);
+}
+
+std::vector<SyntheticRouterInfo> CreateSyntheticRouterInfos (int num)
+{
+	std::vector<SyntheticRouterInfo> routers;
+	routers.reserve (num);
+	uint8_t key[32], iv[16];
+	for (int i = 0; i < num; i++)
+	{
+		auto keys = PrivateKeys::CreateRandomKeys (SIGNING_KEY_TYPE_EDDSA_SHA512_ED25519);
+		RouterInfo ri;
+		ri.SetRouterIdentity (keys.GetPublic ());
+		bool firewalled = i % 8 == 4; // "LU"
+		auto host = RandomIP (i, false);
+		int port = 9000 + rand () % 20000;
+		if (!firewalled) ri.AddNTCPAddress (host.c_str (), port);
+		RAND_bytes (key, 32); RAND_bytes (iv, 16);
+		ri.AddNTCP2Address (key, iv, firewalled ? boost::asio::ip::address () : boost::asio::ip::address::from_string (host), firewalled ? 0 : port);
+		RAND_bytes (key, 32);
+		ri.AddSSUAddress (host.c_str (), port, key, 1484);
+		if (i % 4 == 0)
+		{
+			auto host6 = RandomIP (i, true);
+			if (!firewalled) ri.AddNTCPAddress (host6.c_str (), port);
+			ri.AddSSUAddress (host6.c_str (), port, key, 1488);
+		}
+		if (firewalled)
+			for (int j = 0; j < 3; j++)
+			{
+				RouterInfo::Introducer introducer;
+				introducer.iHost = boost::asio::ip::address::from_string (RandomIP (i + j, false));
+				introducer.iPort = 9000 + j;
+				RAND_bytes (introducer.iKey, 32);
+				introducer.iTag = rand ();
+				introducer.iExp = 0;
+				ri.AddIntroducer (introducer);
+			}
+		// 5/8 high bandwidth, 1/2 SSU testing and introducers
+		static const char * caps[] = { "LRBC", "OfRBC", "PR", "XRBC", "LU", "NR", "ORBC", "LR" };
+		ri.SetCaps (caps[i % 8]);
+		ri.SetProperty ("coreVersion", "0.9.40");
+		ri.SetProperty ("netId", "2");
+		ri.SetProperty ("router.version", "0.9.40");
+		ri.SetProperty ("stat_uptime", "90m");
+		if (i % 8 == 1) // floodfill
+		{
+			ri.SetProperty ("netdb.knownLeaseSets", std::to_string (rand () % 1000));
+			ri.SetProperty ("netdb.knownRouters", std::to_string (rand () % 5000));
+		}
+		ri.CreateBuffer (keys);
+		routers.push_back (SyntheticRouterInfo{ ri.GetIdentHash (), std::vector<uint8_t>(ri.GetBuffer (), ri.GetBuffer () + ri.GetBufferLen ()) });
+	}
+	return routers;
+}
@@ -0,0 +1,18 @@
+#ifndef BENCH_ROUTERINFOS_H__
+#define BENCH_ROUTERINFOS_H__
+
+#include <vector>
+#include <inttypes.h>
+#include "Identity.h"
+
+struct SyntheticRouterInfo
+{
+	i2p::data::IdentHash ident;
+	std::vector<uint8_t> buf; // signed
+};
+
+// like live netDb: NTCP, published NTCP2 and SSU, 1/4 also on IPv6, 1/8 firewalled with introducers, 1/8 floodfills
+// crypto must be initialized
+std::vector<SyntheticRouterInfo> CreateSyntheticRouterInfos (int num);
+
+#endif
@@ -0,0 +1,102 @@
+#include <cassert>
+#include <inttypes.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <boost/asio.hpp>
+
+#include "Queue.h"
+
+// tunnel threads sending to sessions of one transport thread:
+// post per SendI2NPMessages call against i2p::util::MPSCBatchQueue with a post only if it was empty
+
+const int NUM_MSGS = 800000;
+const int NUM_SESSIONS = 64;
+const size_t BATCH_SIZE = 4; // messages per call, few per peer from a tunnel batch
+
+struct Msg
+{
+	int producer, seq;
+};
+
+struct Session
+{
+	std::vector<int> lastSeq;
+	i2p::util::MPSCBatchQueue<std::shared_ptr<Msg> > queue;
+	Session (int numProducers): lastSeq (numProducers, -1) {};
+
+	void Process (const std::vector<std::shared_ptr<Msg> >& msgs, std::atomic<int>& numReceived)
+	{
+		for (auto& it: msgs)
+		{
+			assert (it->seq > lastSeq[it->producer]); // FIFO per producer
+			lastSeq[it->producer] = it->seq;
+		}
+		numReceived += msgs.size ();
+	}
+};
+
+static void Run (bool batchQueue, int numProducers)
+{
+	boost::asio::io_service service;
+	std::unique_ptr<boost::asio::io_service::work> work (new boost::asio::io_service::work (service));
+	std::thread consumer ([&service]() { service.run (); });
+	std::vector<std::unique_ptr<Session> > sessions;
+	for (int i = 0; i < NUM_SESSIONS; i++)
+		sessions.emplace_back (new Session (numProducers));
+	std::atomic<int> numReceived (0), numPosts (0);
+	int numCalls = NUM_MSGS/BATCH_SIZE/numProducers;
+
+	auto start = std::chrono::steady_clock::now ();
+	std::vector<std::thread> producers;
+	for (int i = 0; i < numProducers; i++)
+		producers.emplace_back ([&, i]()
+			{
+				for (int j = 0; j < numCalls; j++)
+				{
+					auto session = sessions[(i + j) % NUM_SESSIONS].get ();
+					std::vector<std::shared_ptr<Msg> > msgs;
+					for (size_t k = 0; k < BATCH_SIZE; k++)
+						msgs.push_back (std::make_shared<Msg>(Msg{i, (int)(j*BATCH_SIZE + k)}));
+					if (!batchQueue)
+					{
+						numPosts++;
+						service.post ([session, msgs, &numReceived]() { session->Process (msgs, numReceived); });
+					}
+					else if (session->queue.Put (msgs))
+					{
+						numPosts++;
+						service.post ([session, &numReceived]()
+							{
+								std::vector<std::shared_ptr<Msg> > msgs;
+								session->queue.GetAll (msgs);
+								session->Process (msgs, numReceived);
+							});
+					}
+				}
+			});
+	for (auto& it: producers) it.join ();
+	int numSent = numCalls*BATCH_SIZE*numProducers;
+	while (numReceived < numSent) std::this_thread::yield ();
+	auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now () - start).count ();
+	work.reset ();
+	consumer.join ();
+
+	std::cout << std::setw (14) << (batchQueue ? "MPSCBatchQueue" : "post per call") << std::setw (4) << numProducers << " producers: "
+		<< std::setw (8) << (double)ns/numSent << " ns/msg, " << std::setw (10) << (uint64_t)(numSent*1e9/ns) << " msgs/sec, "
+		<< std::setw (6) << (double)numPosts/numSent << " posts/msg" << std::endl;
+}
+
+int main ()
+{
+	for (int numProducers: { 1, 2, 4, 8 })
+	{
+		Run (false, numProducers);
+		Run (true, numProducers);
+	}
+	return 0;
+}
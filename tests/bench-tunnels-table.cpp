@@ -0,0 +1,101 @@
+#include <cassert>
+#include <inttypes.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <random>
+#include <chrono>
+
+#include "TunnelsTable.h"
+
+// compares std::unordered_map + std::list against i2p::tunnel::TunnelsTable
+// for tunnelID lookup and expiry of half of transit tunnels
+
+const int NUM_LOOKUPS = 4000000;
+
+struct Tunnel
+{
+	uint32_t tunnelID, creationTime;
+};
+
+static double Elapsed (std::chrono::steady_clock::time_point start, int num)
+{
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now () - start).count ()/num;
+}
+
+static void Run (int numTunnels)
+{
+	std::mt19937 rng (numTunnels);
+	std::vector<std::shared_ptr<Tunnel> > tunnels;
+	std::unordered_map<uint32_t, int> ids;
+	while ((int)tunnels.size () < numTunnels)
+	{
+		uint32_t id = rng ();
+		if (id && ids.emplace (id, 0).second) // unique tunnelIDs
+			tunnels.push_back (std::make_shared<Tunnel>(Tunnel{id, (uint32_t)(1000 + tunnels.size () % 2)}));
+	}
+	std::vector<uint32_t> lookups;
+	for (int i = 0; i < NUM_LOOKUPS; i++)
+		lookups.push_back (tunnels[rng () % numTunnels]->tunnelID);
+
+	// unordered_map and list
+	std::unordered_map<uint32_t, std::shared_ptr<Tunnel> > map;
+	std::list<std::shared_ptr<Tunnel> > list;
+	for (auto& it: tunnels) { map.emplace (it->tunnelID, it); list.push_back (it); }
+	auto start = std::chrono::steady_clock::now ();
+	size_t found = 0;
+	for (auto id: lookups)
+	{
+		auto it = map.find (id);
+		if (it != map.end ()) found += it->second->creationTime;
+	}
+	double mapLookup = Elapsed (start, NUM_LOOKUPS);
+	start = std::chrono::steady_clock::now ();
+	for (auto it = list.begin (); it != list.end ();)
+	{
+		if ((*it)->creationTime < 1001)
+		{
+			map.erase ((*it)->tunnelID);
+			it = list.erase (it);
+		}
+		else
+			it++;
+	}
+	double mapExpire = Elapsed (start, numTunnels);
+	assert (map.size () == list.size ());
+
+	// TunnelsTable
+	i2p::tunnel::TunnelsTable<Tunnel> table;
+	for (auto& it: tunnels) table.Insert (it->tunnelID, it, it->creationTime);
+	start = std::chrono::steady_clock::now ();
+	size_t found1 = 0;
+	for (auto id: lookups)
+	{
+		auto tunnel = table.Get (id);
+		if (tunnel) found1 += tunnel->creationTime;
+	}
+	double tableLookup = Elapsed (start, NUM_LOOKUPS);
+	assert (found == found1);
+	start = std::chrono::steady_clock::now ();
+	size_t numExpired = table.Expire (1001, [](std::shared_ptr<Tunnel>){});
+	double tableExpire = Elapsed (start, numTunnels);
+	assert (table.GetSize () == map.size () && numExpired == tunnels.size () - map.size ());
+	for (auto& it: tunnels)
+		assert ((table.Get (it->tunnelID) != nullptr) == (it->creationTime >= 1001));
+
+	std::cout << std::setw (7) << numTunnels << " tunnels: lookup "
+		<< std::setw (6) << mapLookup << " ns (unordered_map) "
+		<< std::setw (6) << tableLookup << " ns (TunnelsTable), expiry "
+		<< std::setw (6) << mapExpire << " ns/tunnel (list) "
+		<< std::setw (6) << tableExpire << " ns/tunnel (TunnelsTable)" << std::endl;
+}
+
+int main ()
+{
+	for (int numTunnels: { 1000, 10000, 50000, 200000 })
+		Run (numTunnels);
+	return 0;
+}
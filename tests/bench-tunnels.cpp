@@ -0,0 +1,212 @@
+#include <cassert>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include "Crypto.h"
+#include "Log.h"
+#include "Identity.h"
+#include "I2NPProtocol.h"
+#include "TunnelConfig.h"
+#include "TunnelGateway.h"
+#include "TransitTunnel.h"
+#include "Tunnel.h"
+#include "bench-allocations.h"
+
+// pumps synthetic messages through outbound and inbound tunnels of fake hops in-process, no network
+// outbound: OutboundTunnel gateway -> TransitTunnelParticipant(s) -> TransitTunnelEndpoint
+// inbound: TransitTunnelGateway -> TransitTunnelParticipant(s) -> InboundTunnel
+
+using namespace i2p::tunnel;
+
+const int NUM_HOPS = 3;
+const int NUM_ROUNDS = 2000;
+const int ROUND_SIZE = 64; // I2NP messages per round, like a batch of tunnels shard
+const size_t MSG_SIZES[] = { 100, 900, 2500 }; // single, one and few fragments
+
+struct Stage
+{
+	const char * name;
+	uint64_t ns, numMsgs, numAllocations;
+};
+
+template<typename F>
+void Measure (Stage& stage, F f)
+{
+	uint64_t numAllocations = GetNumAllocations ();
+	auto start = std::chrono::steady_clock::now ();
+	f ();
+	stage.ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now () - start).count ();
+	stage.numAllocations += GetNumAllocations () - numAllocations;
+}
+
+static std::shared_ptr<TunnelConfig> CreateConfig ()
+{
+	std::vector<std::shared_ptr<const i2p::data::IdentityEx> > peers;
+	for (int i = 0; i < NUM_HOPS; i++)
+		peers.push_back (i2p::data::PrivateKeys::CreateRandomKeys (i2p::data::SIGNING_KEY_TYPE_EDDSA_SHA512_ED25519).GetPublic ());
+	// outbound form, because inbound requires router context
+	return std::make_shared<TunnelConfig> (peers, 1, peers[0]->GetIdentHash ());
+}
+
+static void Establish (std::shared_ptr<Tunnel> tunnel, std::shared_ptr<TunnelConfig> config)
+{
+	// build reply with all records accepted, reverse of Tunnel::HandleTunnelBuildResponse
+	std::vector<TunnelHopConfig *> hops;
+	for (auto hop = config->GetFirstHop (); hop; hop = hop->next)
+	{
+		hop->recordIndex = hops.size ();
+		hops.push_back (hop);
+	}
+	std::vector<uint8_t> reply (1 + hops.size ()*i2p::TUNNEL_BUILD_RECORD_SIZE, 0);
+	reply[0] = hops.size ();
+	i2p::crypto::CBCEncryption encryption;
+	for (size_t i = 0; i < hops.size (); i++)
+	{
+		encryption.SetKey (hops[i]->replyKey);
+		for (size_t j = 0; j <= i; j++)
+		{
+			encryption.SetIV (hops[i]->replyIV);
+			uint8_t * record = reply.data () + 1 + hops[j]->recordIndex*i2p::TUNNEL_BUILD_RECORD_SIZE;
+			encryption.Encrypt (record, i2p::TUNNEL_BUILD_RECORD_SIZE, record);
+		}
+	}
+	bool established = tunnel->HandleTunnelBuildResponse (reply.data (), reply.size ());
+	assert (established && tunnel->GetNumHops () == NUM_HOPS);
+	(void)established;
+}
+
+static std::vector<std::shared_ptr<TransitTunnel> > CreateTransitTunnels (std::shared_ptr<TunnelConfig> config, bool isInbound)
+{
+	std::vector<std::shared_ptr<TransitTunnel> > tunnels;
+	for (auto hop = config->GetFirstHop (); hop; hop = hop->next)
+		tunnels.push_back (CreateTransitTunnel (hop->tunnelID, hop->nextIdent, hop->nextTunnelID,
+			hop->layerKey, hop->ivKey, isInbound && !hop->prev, !isInbound && !hop->next));
+	return tunnels;
+}
+
+static std::vector<std::shared_ptr<i2p::I2NPMessage> > CreateDataMsgs (int round)
+{
+	static uint8_t buf[2500];
+	std::vector<std::shared_ptr<i2p::I2NPMessage> > msgs;
+	for (int i = 0; i < ROUND_SIZE; i++)
+		msgs.push_back (i2p::CreateI2NPMessage (i2p::eI2NPData, buf, MSG_SIZES[(round + i) % 3]));
+	return msgs;
+}
+
+class CollectingSender: public TunnelTransportSender // takes messages instead of flushing them to transports
+{
+	public:
+
+		std::vector<std::shared_ptr<i2p::I2NPMessage> > Collect ()
+		{
+			std::vector<std::shared_ptr<i2p::I2NPMessage> > msgs;
+			for (const auto& it: m_TunnelDataMsgs)
+				msgs.insert (msgs.end (), it.second.begin (), it.second.end ());
+			m_TunnelDataMsgs.clear ();
+			return msgs;
+		}
+};
+
+int main ()
+{
+	i2p::log::Logger ().SetLogLevel ("none");
+	i2p::crypto::InitCrypto (false);
+
+	auto outboundConfig = CreateConfig ();
+	auto outbound = std::make_shared<OutboundTunnel> (outboundConfig);
+	Establish (outbound, outboundConfig);
+	auto outboundHops = CreateTransitTunnels (outboundConfig, false);
+	auto inboundConfig = CreateConfig ();
+	auto inbound = std::make_shared<InboundTunnel> (inboundConfig);
+	Establish (inbound, inboundConfig);
+	auto inboundHops = CreateTransitTunnels (inboundConfig, true);
+
+	Stage stages[] =
+	{
+		{ "OutboundTunnel", 0, 0, 0 },
+		{ "TransitTunnelParticipant", 0, 0, 0 },
+		{ "TransitTunnelEndpoint", 0, 0, 0 },
+		{ "TransitTunnelGateway", 0, 0, 0 },
+		{ "InboundTunnel", 0, 0, 0 }
+	};
+	auto& outboundStage = stages[0], & participantStage = stages[1], & endpointStage = stages[2],
+		& gatewayStage = stages[3], & inboundStage = stages[4];
+
+	TunnelGateway outboundGateway (outbound.get ());
+	CollectingSender sender;
+	auto pumpParticipants = [&](std::vector<std::shared_ptr<TransitTunnel> >::iterator begin,
+		std::vector<std::shared_ptr<TransitTunnel> >::iterator end, std::vector<std::shared_ptr<i2p::I2NPMessage> >& msgs)
+	{
+		for (auto hop = begin; hop != end; hop++)
+		{
+			Measure (participantStage, [&]()
+				{
+					for (auto& it: msgs)
+						(*hop)->HandleTunnelDataMsg (it);
+					(*hop)->FlushTunnelDataMsgs (sender);
+				});
+			participantStage.numMsgs += msgs.size ();
+			msgs = sender.Collect ();
+		}
+	};
+
+	for (int round = 0; round < NUM_ROUNDS; round++)
+	{
+		// outbound
+		auto msgs = CreateDataMsgs (round);
+		Measure (outboundStage, [&]()
+			{
+				for (auto& it: msgs)
+				{
+					TunnelMessageBlock block;
+					block.deliveryType = eDeliveryTypeLocal;
+					block.data = it;
+					outboundGateway.PutTunnelDataMsg (block);
+				}
+				outboundGateway.SendBuffer (sender);
+			});
+		auto tunnelMsgs = sender.Collect ();
+		outboundStage.numMsgs += tunnelMsgs.size ();
+		pumpParticipants (outboundHops.begin (), outboundHops.end () - 1, tunnelMsgs);
+		Measure (endpointStage, [&]()
+			{
+				for (auto& it: tunnelMsgs)
+					outboundHops.back ()->HandleTunnelDataMsg (it);
+			});
+		endpointStage.numMsgs += tunnelMsgs.size ();
+
+		// inbound
+		msgs = CreateDataMsgs (round);
+		Measure (gatewayStage, [&]()
+			{
+				for (auto& it: msgs)
+					inboundHops.front ()->SendTunnelDataMsg (it);
+				inboundHops.front ()->FlushTunnelDataMsgs (sender);
+			});
+		tunnelMsgs = sender.Collect ();
+		gatewayStage.numMsgs += tunnelMsgs.size ();
+		pumpParticipants (inboundHops.begin () + 1, inboundHops.end (), tunnelMsgs);
+		Measure (inboundStage, [&]()
+			{
+				for (auto& it: tunnelMsgs)
+					inbound->HandleTunnelDataMsg (it);
+			});
+		inboundStage.numMsgs += tunnelMsgs.size ();
+	}
+	assert (inbound->GetNumReceivedBytes () == inboundStage.numMsgs*TUNNEL_DATA_MSG_SIZE);
+
+	std::cout << NUM_ROUNDS*ROUND_SIZE << " I2NP messages each way through " << NUM_HOPS << " hops, per TunnelData message:" << std::endl;
+	for (const auto& it: stages)
+		std::cout << std::setw (26) << it.name << ": "
+			<< std::setw (8) << (double)it.ns/it.numMsgs << " ns/msg, "
+			<< std::setw (10) << (uint64_t)(it.numMsgs*1e9/it.ns) << " msgs/sec, "
+			<< std::setw (6) << (double)it.numAllocations/it.numMsgs << " allocs/msg" << std::endl;
+
+	i2p::crypto::TerminateCrypto ();
+	return 0;
+}
@@ -1,8 +1,16 @@
 #include <cassert>
 #include <inttypes.h>
 #include <string.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
 
 #include "Crypto.h"
+#include "I2PEndian.h"
+#include "CPU.h"
+#include "ChaCha20.h"
+#include "Poly1305.h"
 
 char text[] = "Ladies and Gentlemen of the class of '99: If I could offer you "
 "only one tip for the future, sunscreen would be it."; // 114 bytes
@@ -40,6 +48,214 @@ uint8_t encrypted[114] =
     0x61, 0x16
 };
 
+// SIMD kernels, selected by i2p::cpu flags
+struct Kernel
+{
+	const char * name;
+	bool sse2, avx2, avx512, neon;
+};
+
+const Kernel kernels[] =
+{
+	{ "scalar", false, false, false, false },
+	{ "SSE2", true, false, false, false },
+	{ "AVX2", true, true, false, false },
+	{ "AVX-512", true, true, true, false },
+	{ "NEON", false, false, false, true }
+};
+
+static bool SelectKernel (const Kernel& kernel)
+{
+	i2p::cpu::Detect ();
+	if ((kernel.sse2 && !i2p::cpu::sse2) || (kernel.avx2 && !i2p::cpu::avx2) ||
+		(kernel.avx512 && !i2p::cpu::avx512) || (kernel.neon && !i2p::cpu::neon))
+		return false;
+	i2p::cpu::sse2 = kernel.sse2; i2p::cpu::avx2 = kernel.avx2;
+	i2p::cpu::avx512 = kernel.avx512; i2p::cpu::neon = kernel.neon;
+	return true;
+}
+
+static void Chacha20 (uint8_t * buf, size_t len, uint32_t counter)
+{
+	i2p::crypto::chacha::Chacha20State state;
+	i2p::crypto::chacha::Chacha20Init (state, nonce, key, counter);
+	i2p::crypto::chacha::Chacha20Encrypt (state, buf, len);
+}
+
+static void Poly1305 (const uint8_t * buf, size_t len, uint8_t * tag)
+{
+	i2p::crypto::Poly1305HMAC ((uint64_t *)tag, (const uint64_t *)key, buf, len);
+}
+
+#if OPENSSL_AEAD_CHACHA20_POLY1305
+static void EVPChacha20 (uint8_t * buf, size_t len, uint32_t counter)
+{
+	uint8_t iv[16];
+	htole32buf (iv, counter); memcpy (iv + 4, nonce, 12);
+	int outlen = 0;
+	EVP_CIPHER_CTX * ctx = EVP_CIPHER_CTX_new ();
+	EVP_EncryptInit_ex (ctx, EVP_chacha20 (), 0, key, iv);
+	EVP_EncryptUpdate (ctx, buf, &outlen, buf, len);
+	EVP_CIPHER_CTX_free (ctx);
+}
+#endif
+
+#ifdef EVP_PKEY_POLY1305
+static void EVPPoly1305 (const uint8_t * buf, size_t len, uint8_t * tag)
+{
+	EVP_PKEY * pkey = EVP_PKEY_new_raw_private_key (EVP_PKEY_POLY1305, nullptr, key, 32);
+	EVP_MD_CTX * ctx = EVP_MD_CTX_create ();
+	EVP_DigestSignInit (ctx, nullptr, nullptr, nullptr, pkey);
+	size_t l = 16;
+	EVP_DigestSign (ctx, tag, &l, buf, len);
+	EVP_MD_CTX_destroy (ctx);
+	EVP_PKEY_free (pkey);
+}
+#endif
+
+static void TestKernels ()
+{
+	// every kernel against scalar and OpenSSL for lengths around block and vector widths
+	for (const auto& kernel: kernels)
+	{
+		if (!SelectKernel (kernel)) continue;
+		for (size_t len = 0; len < 2100; len += (len < 300) ? 1 : 61)
+		{
+			std::vector<uint8_t> buf (len), buf1 (len);
+			for (size_t i = 0; i < len; i++) buf[i] = buf1[i] = i*7 + len;
+			uint8_t tag[16], tag1[16];
+			SelectKernel (kernels[0]);
+			Chacha20 (buf1.data (), len, 1);
+			Poly1305 (buf1.data (), len, tag1);
+			SelectKernel (kernel);
+			Chacha20 (buf.data (), len, 1);
+			assert (buf == buf1);
+			Poly1305 (buf.data (), len, tag);
+			assert (!memcmp (tag, tag1, 16));
+#ifdef EVP_PKEY_POLY1305
+			EVPPoly1305 (buf1.data (), len, tag1);
+			assert (!memcmp (tag, tag1, 16));
+#endif
+#if OPENSSL_AEAD_CHACHA20_POLY1305
+			EVPChacha20 (buf.data (), len, 1); // decrypt
+			for (size_t i = 0; i < len; i++) assert (buf[i] == (uint8_t)(i*7 + len));
+#endif
+		}
+	}
+}
+
+static std::vector<i2p::crypto::AEADChaCha20Poly1305Frame> CreateFrames (std::vector<std::vector<uint8_t> >& bufs,
+	size_t num, size_t len)
+{
+	// frames of length len (or mixed if zero) with own keys and nonces
+	std::vector<i2p::crypto::AEADChaCha20Poly1305Frame> frames (num);
+	bufs.resize (num);
+	for (size_t i = 0; i < num; i++)
+	{
+		size_t l = len ? len : ((i % 10 == 9) ? 9000 + i : (i*i*37 + i) % 2000);
+		bufs[i].resize (l + 16 + 32);
+		for (size_t j = 0; j < bufs[i].size (); j++) bufs[i][j] = i + j*3;
+		frames[i].buf = bufs[i].data () + 32; frames[i].len = l;
+		frames[i].key = bufs[i].data ();
+		memcpy (frames[i].nonce, bufs[i].data () + 20, 12);
+	}
+	return frames;
+}
+
+static void TestBatch ()
+{
+	for (const auto& kernel: kernels)
+	{
+		if (!SelectKernel (kernel)) continue;
+		std::vector<std::vector<uint8_t> > bufs;
+		auto frames = CreateFrames (bufs, 41, 0);
+		auto orig = bufs;
+		i2p::crypto::AEADChaCha20Poly1305Batch (frames, true);
+		for (size_t i = 0; i < frames.size (); i++)
+		{
+			const auto& frame = frames[i];
+			assert (frame.result);
+			std::vector<uint8_t> plain (frame.len + 1);
+			assert (i2p::crypto::AEADChaCha20Poly1305 (frame.buf, frame.len, nullptr, 0, frame.key, frame.nonce, plain.data (), frame.len, false));
+			assert (!memcmp (plain.data (), orig[i].data () + 32, frame.len));
+		}
+		frames[7].buf[frames[7].len] ^= 1; // corrupt tag
+		i2p::crypto::AEADChaCha20Poly1305Batch (frames, false);
+		for (size_t i = 0; i < frames.size (); i++)
+		{
+			assert (frames[i].result == (i != 7));
+			assert (!memcmp (frames[i].buf, orig[i].data () + 32, frames[i].len));
+		}
+	}
+	i2p::cpu::Detect ();
+}
+
+const size_t BENCH_BYTES = 64*1024*1024;
+
+template<typename F>
+static double Measure (size_t len, F f) // MB/s
+{
+	std::vector<uint8_t> buf (len, 0x5A);
+	auto start = std::chrono::steady_clock::now ();
+	for (size_t n = 0; n < BENCH_BYTES; n += len)
+		f (buf.data (), len);
+	return BENCH_BYTES/(double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now () - start).count ();
+}
+
+static void PrintRow (const char * name, size_t len, double chacha, double poly)
+{
+	std::cout << std::setw (8) << name << std::setw (7) << len << " bytes: ChaCha20 "
+		<< std::setw (7) << (int)chacha << " MB/s, Poly1305 " << std::setw (7) << (int)poly << " MB/s" << std::endl;
+}
+
+static void Benchmark ()
+{
+	uint8_t tag[16];
+	for (size_t len: { 1024, 16384 })
+	{
+		for (const auto& kernel: kernels)
+		{
+			if (!SelectKernel (kernel)) continue;
+			PrintRow (kernel.name, len,
+				Measure (len, [](uint8_t * buf, size_t len) { Chacha20 (buf, len, 1); }),
+				Measure (len, [&tag](uint8_t * buf, size_t len) { Poly1305 (buf, len, tag); }));
+		}
+#if OPENSSL_AEAD_CHACHA20_POLY1305 && defined(EVP_PKEY_POLY1305)
+		PrintRow ("OpenSSL", len,
+			Measure (len, [](uint8_t * buf, size_t len) { EVPChacha20 (buf, len, 1); }),
+			Measure (len, [&tag](uint8_t * buf, size_t len) { EVPPoly1305 (buf, len, tag); }));
+#endif
+	}
+}
+
+static void BenchmarkBatch ()
+{
+	i2p::cpu::Detect ();
+	const size_t numFrames = 32;
+	for (size_t len: { 256, 1024, 16384 })
+	{
+		std::vector<std::vector<uint8_t> > bufs;
+		auto frames = CreateFrames (bufs, numFrames, len);
+		double speed[2];
+		for (int batch = 0; batch < 2; batch++)
+		{
+			auto start = std::chrono::steady_clock::now ();
+			for (size_t n = 0; n < BENCH_BYTES; n += numFrames*len)
+			{
+				if (batch)
+					i2p::crypto::AEADChaCha20Poly1305Batch (frames, true);
+				else
+					for (auto& it: frames)
+						i2p::crypto::AEADChaCha20Poly1305 (it.buf, it.len, nullptr, 0, it.key, it.nonce, it.buf, it.len + 16, true);
+			}
+			speed[batch] = BENCH_BYTES/(double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now () - start).count ();
+		}
+		std::cout << numFrames << " frames of " << std::setw (5) << len << " bytes: AEAD one by one "
+			<< std::setw (5) << (int)speed[0] << " MB/s, batch " << std::setw (5) << (int)speed[1] << " MB/s"
+			<< (i2p::crypto::IsAEADChaCha20Poly1305BatchSupported () ? "" : " (not interleaved)") << std::endl;
+	}
+}
+
 int main ()
 {
 	uint8_t buf[114+16];
@@ -57,4 +273,9 @@ int main ()
 	i2p::crypto::AEADChaCha20Poly1305Encrypt (bufs, key, nonce, buf + 114);
 	i2p::crypto::AEADChaCha20Poly1305 (buf, 114, nullptr, 0, key, nonce, buf1, 114, false);
 	assert (memcmp (buf1, text, 114) == 0);
+
+	TestKernels ();
+	TestBatch ();
+	Benchmark ();
+	BenchmarkBatch ();
 }
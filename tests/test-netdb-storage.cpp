@@ -0,0 +1,167 @@
+#include <cassert>
+#include <inttypes.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <boost/filesystem.hpp>
+
+#include "NetDbStorage.h"
+
+// NetDbLogStorage recovery: log cut at and between records, stale or missing index, compaction
+
+using namespace i2p::data;
+
+const int NUM_RECORDS = 16;
+
+static IdentHash Ident (int i)
+{
+	uint8_t buf[32];
+	memset (buf, i + 1, 32);
+	return IdentHash (buf);
+}
+
+static std::vector<uint8_t> Data (int i, int version = 0)
+{
+	return std::vector<uint8_t> (100 + i*10, (uint8_t)(i*7 + version));
+}
+
+static bool Save (NetDbLogStorage& storage, int i, int version = 0)
+{
+	auto data = Data (i, version);
+	return storage.Save (Ident (i), data.data (), data.size ());
+}
+
+static bool Check (NetDbLogStorage& storage, int i, int version = 0)
+{
+	uint8_t buf[MAX_RI_BUFFER_SIZE];
+	auto data = Data (i, version);
+	return storage.Read (Ident (i), buf, sizeof (buf)) == data.size () && !memcmp (buf, data.data (), data.size ());
+}
+
+static bool IsRemoved (NetDbLogStorage& storage, int i)
+{
+	uint8_t buf[MAX_RI_BUFFER_SIZE];
+	return !storage.Read (Ident (i), buf, sizeof (buf));
+}
+
+static void Copy (const std::string& from, const std::string& to)
+{
+	boost::filesystem::copy_file (from, to, boost::filesystem::copy_option::overwrite_if_exists);
+}
+
+int main ()
+{
+	auto place = (boost::filesystem::temp_directory_path () / boost::filesystem::unique_path ()).string ();
+	boost::filesystem::create_directories (place);
+	auto log = place + "/" + NETDB_LOG_FILENAME, index = place + "/" + NETDB_LOG_INDEX_FILENAME;
+	auto savedLog = log + ".saved", savedIndex = index + ".saved";
+
+	// truncated at each record boundary, in record's header and in its data, with index of full log and without
+	std::vector<uint64_t> boundaries; // size of log after each record
+	{
+		NetDbLogStorage storage (place);
+		assert (storage.Init ());
+		boundaries.push_back (storage.GetSize ());
+		for (int i = 0; i < NUM_RECORDS; i++)
+		{
+			assert (Save (storage, i));
+			boundaries.push_back (storage.GetSize ());
+		}
+		storage.Close ();
+	}
+	Copy (log, savedLog);
+	Copy (index, savedIndex);
+	for (int withIndex = 0; withIndex < 2; withIndex++)
+		for (int n = 0; n <= NUM_RECORDS; n++)
+			for (uint64_t cut: { (uint64_t)0, (uint64_t)1, (uint64_t)NETDB_LOG_RECORD_HEADER_SIZE + 1 })
+			{
+				if (n == NUM_RECORDS && cut) continue;
+				Copy (savedLog, log);
+				boost::filesystem::resize_file (log, boundaries[n] + cut);
+				if (withIndex)
+					Copy (savedIndex, index);
+				else
+					boost::filesystem::remove (index);
+				NetDbLogStorage storage (place);
+				assert (storage.Init ());
+				assert (storage.GetSize () == boundaries[n]); // partial record is cut
+				assert (boost::filesystem::file_size (log) == boundaries[n]);
+				for (int i = 0; i < NUM_RECORDS; i++)
+					assert (i < n ? Check (storage, i) : IsRemoved (storage, i));
+				assert (Save (storage, n % NUM_RECORDS, 1)); // appended after last complete record
+				assert (Check (storage, n % NUM_RECORDS, 1));
+			}
+	boost::filesystem::remove (savedLog);
+	boost::filesystem::remove (savedIndex);
+
+	// index older than log, then missing and partial index
+	{
+		NetDbLogStorage storage (place);
+		storage.Clear ();
+		assert (storage.Init ());
+		for (int i = 0; i < NUM_RECORDS/2; i++)
+			assert (Save (storage, i));
+		storage.Flush ();
+		Copy (index, savedIndex);
+		for (int i = NUM_RECORDS/2; i < NUM_RECORDS; i++)
+			assert (Save (storage, i));
+		assert (Save (storage, 0, 1));
+		storage.Remove (Ident (1));
+		storage.Close ();
+	}
+	Copy (savedIndex, index);
+	boost::filesystem::remove (savedIndex);
+	for (int round = 0; round < 3; round++)
+	{
+		if (round == 1) boost::filesystem::remove (index);
+		if (round == 2) boost::filesystem::resize_file (index, boost::filesystem::file_size (index) - 1);
+		NetDbLogStorage storage (place);
+		assert (storage.Init ());
+		assert (Check (storage, 0, 1));
+		assert (IsRemoved (storage, 1));
+		for (int i = 2; i < NUM_RECORDS; i++)
+			assert (Check (storage, i));
+		// index is saved by destructor
+	}
+
+	// compaction once garbage exceeds live records, then reload from compacted log
+	int version = 1;
+	uint64_t compactedSize = 0;
+	{
+		NetDbLogStorage storage (place);
+		storage.Clear ();
+		assert (storage.Init ());
+		for (int i = 0; i < NUM_RECORDS; i++)
+			assert (Save (storage, i));
+		for (;; version++)
+		{
+			for (int i = 0; i < NUM_RECORDS; i++)
+				assert (Save (storage, i, version));
+			auto garbageSize = storage.GetGarbageSize ();
+			if (garbageSize > NETDB_LOG_MIN_COMPACTION_SIZE && garbageSize > storage.GetSize () - sizeof (NETDB_LOG_MAGIC) - garbageSize)
+				break;
+			storage.Flush ();
+			assert (storage.GetGarbageSize () == garbageSize); // not compacted yet
+		}
+		storage.Flush ();
+		assert (!storage.GetGarbageSize ());
+		compactedSize = storage.GetSize ();
+		assert (boost::filesystem::file_size (log) == compactedSize);
+		for (int i = 0; i < NUM_RECORDS; i++)
+			assert (Check (storage, i, version));
+		storage.Remove (Ident (0));
+		storage.Close ();
+	}
+	{
+		NetDbLogStorage storage (place);
+		assert (storage.Init ());
+		assert (storage.GetSize () == compactedSize + NETDB_LOG_RECORD_HEADER_SIZE);
+		assert (IsRemoved (storage, 0));
+		for (int i = 1; i < NUM_RECORDS; i++)
+			assert (Check (storage, i, version));
+		storage.Clear ();
+	}
+
+	boost::filesystem::remove_all (place);
+	return 0;
+}